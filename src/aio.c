@@ -7,6 +7,16 @@
 
 static int nano_interrupt = 0;
 
+typedef struct nano_aio_pool_s {
+  nano_aio *head;
+  int count;
+  double hits;
+  double misses;
+} nano_aio_pool;
+
+static nano_aio_pool nano_pool[2];
+static int nano_pool_max = NANONEXT_POOL_SIZE;
+
 static SEXP mk_error_aio(const int xc, SEXP env) {
 
   SEXP err = PROTECT(Rf_ScalarInteger(xc));
@@ -18,63 +28,273 @@ static SEXP mk_error_aio(const int xc, SEXP env) {
 
 }
 
+static void saio_complete(void *);
+static void raio_complete(void *);
+
+// aio pools - only accessed from the R thread ---------------------------------
+
+static nano_aio *nano_aio_take(const int idx) {
+
+  nano_aio_pool *pool = &nano_pool[idx];
+  nano_aio *xaio = pool->head;
+
+  if (xaio != NULL) {
+    pool->head = (nano_aio *) xaio->next;
+    pool->count--;
+    pool->hits++;
+    xaio->next = NULL;
+    return xaio;
+  }
+
+  pool->misses++;
+  xaio = calloc(1, sizeof(nano_aio));
+  if (xaio == NULL)
+    return NULL;
+
+  if (nng_aio_alloc(&xaio->aio, idx ? raio_complete : saio_complete, xaio)) {
+    free(xaio);
+    return NULL;
+  }
+  xaio->pool = 1;
+
+  return xaio;
+
+}
+
+static void nano_aio_give(nano_aio *xaio) {
+
+  nano_aio_pool *pool = &nano_pool[xaio->type != SENDAIO];
+
+  if (pool->count >= nano_pool_max) {
+    nng_aio_free(xaio->aio);
+    free(xaio);
+    return;
+  }
+
+  nng_aio_set_msg(xaio->aio, NULL);
+  xaio->data = NULL;
+  xaio->cb = NULL;
+  xaio->link = NULL;
+  xaio->queue = NULL;
+  xaio->result = 0;
+  atomic_store_explicit(&xaio->state, 0, memory_order_relaxed);
+  xaio->mode = 0;
+  xaio->routed = 0;
+  xaio->hist = NULL;
+  xaio->start = 0;
+  xaio->next = pool->head;
+  pool->head = xaio;
+  pool->count++;
+
+}
+
+static void nano_aio_pool_trim(const int max) {
+
+  for (int i = 0; i < 2; i++) {
+    nano_aio_pool *pool = &nano_pool[i];
+    while (pool->count > max) {
+      nano_aio *xaio = pool->head;
+      pool->head = (nano_aio *) xaio->next;
+      pool->count--;
+      nng_aio_free(xaio->aio);
+      free(xaio);
+    }
+  }
+
+}
+
+static void nano_batch_free(nano_batch *batch) {
+
+  for (int i = 0; i < batch->n; i++) {
+    nng_aio_free(batch->aios[i].aio);
+    if (batch->aios[i].data != NULL)
+      nano_msg_drop((nng_msg *) batch->aios[i].data);
+  }
+  nng_mtx_free(batch->mtx);
+  free(batch->aios);
+  free(batch);
+
+}
+
+static void saio_free(nano_aio *saio) {
+
+  if (saio->pool) {
+    nano_aio_give(saio);
+    return;
+  }
+
+  nng_aio_free(saio->aio);
+  if (saio->type == BATCH_SENDAIO) {
+    nano_batch_free((nano_batch *) saio->data);
+  } else if (saio->data != NULL) {
+    free(saio->data);
+  }
+  if (saio->type == IOV_SENDAIO && saio->cb != NULL)
+    nano_ReleaseObject((SEXP) saio->cb);
+  free(saio);
+
+}
+
+// wait sets - one condition shared by all aios ------------------------------
+
+// completion callbacks record their result before signalling, and the condition
+// is only touched when a waiter is registered, so idle completions stay lock-free
+
+static nng_mtx *nano_wait_mtx = NULL;
+static nng_cv *nano_wait_cv = NULL;
+static atomic_int nano_waiters = 0;
+
+void nano_wait_signal(void) {
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&nano_waiters, memory_order_relaxed) == 0)
+    return;
+
+  nng_mtx_lock(nano_wait_mtx);
+  nng_cv_wake(nano_wait_cv);
+  nng_mtx_unlock(nano_wait_mtx);
+
+}
+
+static inline nano_aio *nano_wait_aio(SEXP x) {
+
+  if (TYPEOF(x) != ENVSXP)
+    return NULL;
+
+  const SEXP coreaio = Rf_findVarInFrame(x, nano_AioSymbol);
+  if (NANO_PTR_CHECK(coreaio, nano_AioSymbol))
+    return NULL;
+
+  return (nano_aio *) NANO_PTR(coreaio);
+
+}
+
+// waits for all, or else any, of an Aio or list of Aios to complete - returns
+// the index of the first element found complete, or -1 if there are none
+
+static R_xlen_t nano_wait_set(SEXP x, const int all) {
+
+  const int list = TYPEOF(x) == VECSXP;
+  if (!list && TYPEOF(x) != ENVSXP)
+    return -1;
+
+  const R_xlen_t xlen = list ? Rf_xlength(x) : 1;
+  nano_aio **aios = (nano_aio **) R_alloc(xlen, sizeof(nano_aio *));
+  R_xlen_t *idx = (R_xlen_t *) R_alloc(xlen, sizeof(R_xlen_t));
+  R_xlen_t pending = 0, first = -1;
+
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    nano_aio *aiop = nano_wait_aio(list ? NANO_VECTOR(x)[i] : x);
+    if (aiop == NULL || aiop->result) {
+      if (!all) return i;
+      if (first < 0) first = i;
+      continue;
+    }
+    aios[pending] = aiop;
+    idx[pending++] = i;
+  }
+
+  if (pending == 0)
+    return first;
+
+  if (nano_wait_mtx == NULL) {
+    int xc;
+    if ((xc = nng_mtx_alloc(&nano_wait_mtx)))
+      ERROR_OUT(xc);
+    if ((xc = nng_cv_alloc(&nano_wait_cv, nano_wait_mtx))) {
+      nng_mtx_free(nano_wait_mtx);
+      nano_wait_mtx = NULL;
+      ERROR_OUT(xc);
+    }
+  }
+
+  atomic_fetch_add(&nano_waiters, 1);
+  atomic_thread_fence(memory_order_seq_cst);
+  nng_time time = nng_clock() + 400;
+  nng_mtx_lock(nano_wait_mtx);
+
+  while (1) {
+    for (R_xlen_t j = 0; j < pending;) {
+      if (aios[j]->result) {
+        if (first < 0 || idx[j] < first) first = idx[j];
+        aios[j] = aios[--pending];
+        idx[j] = idx[pending];
+      } else {
+        j++;
+      }
+    }
+    if (pending == 0 || (!all && first >= 0))
+      break;
+    if (nng_cv_until(nano_wait_cv, time) == NNG_ETIMEDOUT) {
+      nng_mtx_unlock(nano_wait_mtx);
+      atomic_fetch_sub(&nano_waiters, 1);
+      R_CheckUserInterrupt();
+      atomic_fetch_add(&nano_waiters, 1);
+      atomic_thread_fence(memory_order_seq_cst);
+      time = nng_clock() + 400;
+      nng_mtx_lock(nano_wait_mtx);
+    }
+  }
+
+  nng_mtx_unlock(nano_wait_mtx);
+  atomic_fetch_sub(&nano_waiters, 1);
+
+  return first;
+
+}
+
 // aio completion callbacks ----------------------------------------------------
 
+// completion and finalization each exchange the state flag - whichever arrives
+// second frees the aio; completions on nng threads push onto a lock-free
+// intrusive stack, which is only ever drained by the R thread
+
 void nano_list_do(nano_list_op listop, nano_aio *saio) {
 
-  static nano_node *free_list = NULL;
-  static nng_mtx *free_mtx = NULL;
+  static _Atomic(nano_aio *) free_list = NULL;
 
   switch (listop) {
   case INIT:
-    if (free_mtx == NULL && nng_mtx_alloc(&free_mtx))
-      Rf_error("NNG library init failure");
+    atomic_store_explicit(&free_list, NULL, memory_order_relaxed);
     break;
   case FINALIZE:
-    nng_mtx_lock(free_mtx);
     nano_list_do(FREE, NULL);
-    if (saio->mode == 0x1) {
-      nng_mtx_unlock(free_mtx);
-      nng_aio_free(saio->aio);
-      if (saio->data != NULL)
-        free(saio->data);
-      free(saio);
-    } else {
-      saio->mode = 0x1;
-      nng_mtx_unlock(free_mtx);
-    }
+    if (atomic_exchange_explicit(&saio->state, 1, memory_order_acq_rel))
+      saio_free(saio);
     break;
   case COMPLETE:
-    nng_mtx_lock(free_mtx);
-    if (saio->mode == 0x1) {
-      nano_node *new_node = malloc(sizeof(nano_node));
-      if (new_node == NULL) break;
-      new_node->data = saio;
-      new_node->next = free_list;
-      free_list = new_node;
-    } else {
-      saio->mode = 0x1;
+    if (atomic_exchange_explicit(&saio->state, 1, memory_order_acq_rel)) {
+      nano_aio *head = atomic_load_explicit(&free_list, memory_order_relaxed);
+      do {
+        saio->link = head;
+      } while (!atomic_compare_exchange_weak_explicit(&free_list, &head, saio, memory_order_release, memory_order_relaxed));
     }
-    nng_mtx_unlock(free_mtx);
     break;
   case SHUTDOWN:
-    if (free_mtx == NULL) break;
-    nng_mtx_lock(free_mtx);
     nano_list_do(FREE, NULL);
-    nng_mtx_unlock(free_mtx);
-    nng_mtx_free(free_mtx);
-    free_mtx = NULL;
+    nano_aio_pool_trim(0);
+    nano_http_pool_free();
+    nano_tls_cache_free();
+    nano_rng_free();
+    nano_stats_free();
+    nano_hist_free();
+    nano_route_free();
+    nano_conflate_free();
+    nano_pipe_hook_free();
+    nano_shm_free();
+    nano_cv_any_free();
+    if (nano_wait_mtx != NULL) {
+      nng_cv_free(nano_wait_cv);
+      nng_mtx_free(nano_wait_mtx);
+      nano_wait_mtx = NULL;
+    }
     break;
-  case FREE: // must be entered under lock
-    while (free_list != NULL) {
-      nano_node *current = free_list;
-      free_list = free_list->next;
-      nano_aio *data = (nano_aio *) current->data;
-      nng_aio_free(data->aio);
-      if (data->data != NULL)
-        free(data->data);
-      free(data);
-      free(current);
+  case FREE: ;
+    nano_aio *current = atomic_exchange_explicit(&free_list, NULL, memory_order_acquire);
+    while (current != NULL) {
+      nano_aio *link = current->link;
+      saio_free(current);
+      current = link;
     }
     break;
   }
@@ -84,9 +304,15 @@ static void saio_complete(void *arg) {
 
   nano_aio *saio = (nano_aio *) arg;
   const int res = nng_aio_result(saio->aio);
-  if (res)
-    nng_msg_free(nng_aio_get_msg(saio->aio));
+  if (res) {
+    if (saio->routed)
+      nano_route_undo(nng_aio_get_msg(saio->aio));
+    nano_msg_free(nng_aio_get_msg(saio->aio));
+  }
+  if (!res)
+    nano_hist_record(saio->hist, 0, saio->start);
   saio->result = res - !res;
+  nano_wait_signal();
 
   nano_list_do(COMPLETE, saio);
 
@@ -97,6 +323,7 @@ static void isaio_complete(void *arg) {
   nano_aio *iaio = (nano_aio *) arg;
   const int res = nng_aio_result(iaio->aio);
   iaio->result = res - !res;
+  nano_wait_signal();
 
   nano_list_do(COMPLETE, iaio);
 
@@ -108,27 +335,33 @@ static void raio_complete(void *arg) {
   int res = nng_aio_result(raio->aio);
   if (res == 0) {
     nng_msg *msg = nng_aio_get_msg(raio->aio);
+    nano_shm_mark(msg);
     raio->data = msg;
     nng_pipe p = nng_msg_get_pipe(msg);
     res = - (int) p.id;
+    nano_route_ack(msg);
   }
+  if (res <= 0)
+    nano_hist_record(raio->hist, 1, raio->start);
 
   if (raio->next != NULL) {
     nano_cv *ncv = (nano_cv *) raio->next;
-    nng_cv *cv = ncv->cv;
     nng_mtx *mtx = ncv->mtx;
 
     nng_mtx_lock(mtx);
     raio->result = res;
     ncv->condition++;
-    nng_cv_wake(cv);
+    nano_cv_wake(ncv);
     nng_mtx_unlock(mtx);
   } else {
     raio->result = res;
   }
+  nano_wait_signal();
+  if (raio->queue != NULL)
+    nano_queue_push((nano_queue_node *) raio->queue);
 
   if (raio->cb != NULL)
-    later2(raio_invoke_cb, raio->cb);
+    nano_later(raio, raio_invoke_cb, raio->cb);
 
 }
 
@@ -138,15 +371,22 @@ static void raio_complete_interrupt(void *arg) {
   int res = nng_aio_result(raio->aio);
   if (res == 0) {
     nng_msg *msg = nng_aio_get_msg(raio->aio);
+    nano_shm_mark(msg);
     raio->data = msg;
     nng_pipe p = nng_msg_get_pipe(msg);
     res = - (int) p.id;
+    nano_route_ack(msg);
   }
+  if (res <= 0)
+    nano_hist_record(raio->hist, 1, raio->start);
 
   raio->result = res;
+  nano_wait_signal();
+  if (raio->queue != NULL)
+    nano_queue_push((nano_queue_node *) raio->queue);
 
   if (raio->cb != NULL)
-    later2(raio_invoke_cb, raio->cb);
+    nano_later(raio, raio_invoke_cb, raio->cb);
 
   if (nano_interrupt) {
 #ifdef _WIN32
@@ -166,20 +406,156 @@ static void iraio_complete(void *arg) {
 
   if (iaio->next != NULL) {
     nano_cv *ncv = (nano_cv *) iaio->next;
-    nng_cv *cv = ncv->cv;
     nng_mtx *mtx = ncv->mtx;
 
     nng_mtx_lock(mtx);
     iaio->result = res - !res;
     ncv->condition++;
-    nng_cv_wake(cv);
+    nano_cv_wake(ncv);
     nng_mtx_unlock(mtx);
   } else {
     iaio->result = res - !res;
   }
+  nano_wait_signal();
+  if (iaio->queue != NULL)
+    nano_queue_push((nano_queue_node *) iaio->queue);
 
   if (iaio->cb != NULL)
-    later2(raio_invoke_cb, iaio->cb);
+    nano_later(iaio, raio_invoke_cb, iaio->cb);
+
+}
+
+static void batch_complete(void *arg) {
+
+  nano_aio *xaio = (nano_aio *) arg;
+  nano_aio *agg = (nano_aio *) xaio->next;
+  nano_batch *batch = (nano_batch *) agg->data;
+  int res = nng_aio_result(xaio->aio);
+
+  if (xaio->type == SENDAIO) {
+    if (res) {
+      if (xaio->routed)
+        nano_route_undo(nng_aio_get_msg(xaio->aio));
+      nano_msg_free(nng_aio_get_msg(xaio->aio));
+    } else {
+      nano_hist_record(xaio->hist, 0, xaio->start);
+    }
+    xaio->result = res - !res;
+  } else {
+    if (res == 0) {
+      nng_msg *msg = nng_aio_get_msg(xaio->aio);
+      nano_shm_mark(msg);
+      xaio->data = msg;
+      nng_pipe p = nng_msg_get_pipe(msg);
+      res = - (int) p.id;
+      nano_route_ack(msg);
+      nano_hist_record(xaio->hist, 1, xaio->start);
+    }
+    xaio->result = res;
+  }
+
+  nng_mtx_lock(batch->mtx);
+  const int last = --batch->pending == 0;
+  nng_mtx_unlock(batch->mtx);
+
+  if (last)
+    nng_aio_finish(agg->aio, 0);
+
+}
+
+static void batch_cancel(nng_aio *aio, void *arg, int rv) {
+
+  nano_batch *batch = (nano_batch *) arg;
+  for (int i = 0; i < batch->n; i++)
+    nng_aio_cancel(batch->aios[i].aio);
+
+}
+
+static void bsaio_complete(void *arg) {
+
+  nano_aio *saio = (nano_aio *) arg;
+  saio->result = -1;
+  nano_wait_signal();
+
+  nano_list_do(COMPLETE, saio);
+
+}
+
+static void braio_complete(void *arg) {
+
+  nano_aio *raio = (nano_aio *) arg;
+  raio->result = -1;
+  nano_wait_signal();
+
+  if (raio->cb != NULL)
+    nano_later(raio, raio_invoke_cb, raio->cb);
+
+}
+
+static nano_batch *nano_batch_alloc(nano_aio *agg, const int n, const nano_aio_typ type) {
+
+  nano_batch *batch = calloc(1, sizeof(nano_batch));
+  if (batch == NULL)
+    return NULL;
+
+  if ((batch->aios = calloc(n, sizeof(nano_aio))) == NULL ||
+      nng_mtx_alloc(&batch->mtx)) {
+    free(batch->aios);
+    free(batch);
+    return NULL;
+  }
+
+  for (int i = 0; i < n; i++) {
+    nano_aio *xaio = &batch->aios[i];
+    xaio->type = type;
+    xaio->next = agg;
+    if (nng_aio_alloc(&xaio->aio, batch_complete, xaio)) {
+      batch->n = i;
+      nano_batch_free(batch);
+      return NULL;
+    }
+  }
+  batch->n = n;
+  batch->pending = n;
+
+  return batch;
+
+}
+
+// batch send messages are all encoded before any aio is begun, so an R error
+// while encoding cannot strand an aggregate that nothing owns
+
+typedef struct nano_batch_enc_s {
+  nng_msg **msgs;
+  int *xc;
+  const SEXP *dp;
+  SEXP con;
+  int n;
+  int enc;
+  int done;
+} nano_batch_enc;
+
+static SEXP nano_batch_encode(void *arg) {
+
+  nano_batch_enc *be = (nano_batch_enc *) arg;
+  nano_sock *ns = (nano_sock *) NANO_PTR(be->con);
+  for (int i = 0; i < be->n; i++)
+    be->xc[i] = nano_encode_data(&be->msgs[i], be->dp[i], be->enc, NANO_PROT(be->con), 0, &ns->hint, ns->shm, nng_socket_id(ns->sock));
+  be->done = 1;
+  return R_NilValue;
+
+}
+
+static void nano_batch_encode_cleanup(void *arg) {
+
+  nano_batch_enc *be = (nano_batch_enc *) arg;
+  if (be->done) return;
+  for (int i = 0; i < be->n; i++) {
+    if (be->msgs[i] != NULL)
+      nano_msg_free(be->msgs[i]);
+  }
+  free(be->msgs);
+  free(be->xc);
 
 }
 
@@ -204,19 +580,52 @@ static void iaio_finalizer(SEXP xptr) {
 
 }
 
-static void raio_finalizer(SEXP xptr) {
+static void braio_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
   nng_aio_free(xp->aio);
+  nano_batch_free((nano_batch *) xp->data);
+  free(xp);
+
+}
+
+static void raio_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
   if (xp->data != NULL)
-    nng_msg_free((nng_msg *) xp->data);
+    nano_msg_drop((nng_msg *) xp->data);
+  if (xp->pool && !nng_aio_busy(xp->aio)) {
+    nano_aio_give(xp);
+    return;
+  }
+  nng_aio_free(xp->aio);
   free(xp);
 
 }
 
 // core aio --------------------------------------------------------------------
 
+static SEXP raio_batch_msg(SEXP env, SEXP aio, nano_aio *raio) {
+
+  nano_batch *batch = (nano_batch *) raio->data;
+  SEXP out;
+
+  PROTECT(out = Rf_allocVector(VECSXP, batch->n));
+  for (int i = 0; i < batch->n; i++) {
+    nano_aio *xaio = &batch->aios[i];
+    SET_VECTOR_ELT(out, i, xaio->result > 0 ? mk_error(xaio->result) :
+                   nano_decode_msg((nng_msg **) &xaio->data, raio->mode, NANO_PROT(aio)));
+  }
+  Rf_defineVar(nano_ValueSymbol, out, env);
+  Rf_defineVar(nano_AioSymbol, nano_success, env);
+
+  UNPROTECT(1);
+  return out;
+
+}
+
 SEXP rnng_aio_result(SEXP env) {
 
   const SEXP exist = Rf_findVarInFrame(env, nano_ValueSymbol);
@@ -232,6 +641,18 @@ SEXP rnng_aio_result(SEXP env) {
   if (nng_aio_busy(saio->aio))
     return nano_unresolved;
 
+  if (saio->type == BATCH_SENDAIO) {
+    nano_batch *batch = (nano_batch *) saio->data;
+    SEXP out = PROTECT(Rf_allocVector(INTSXP, batch->n));
+    int *res = INTEGER(out);
+    for (int i = 0; i < batch->n; i++)
+      res[i] = batch->aios[i].result > 0 ? batch->aios[i].result : 0;
+    Rf_defineVar(nano_ValueSymbol, out, env);
+    Rf_defineVar(nano_AioSymbol, R_NilValue, env);
+    UNPROTECT(1);
+    return out;
+  }
+
   if (saio->result > 0)
     return mk_error_aio(saio->result, env);
 
@@ -281,25 +702,23 @@ SEXP rnng_aio_get_msg(SEXP env) {
       return mk_error_aio(res, env);
 
     break;
+  case BATCH_RECVAIO:
+    if (nng_aio_busy(raio->aio))
+      return nano_unresolved;
+
+    return raio_batch_msg(env, aio, raio);
   default:
     res = 0;
     return mk_error_aio(res, env);
   }
 
   SEXP out, pipe;
-  unsigned char *buf;
-  size_t sz;
 
   if (raio->type == IOV_RECVAIO || raio->type == IOV_RECVAIOS) {
-    buf = raio->data;
-    sz = nng_aio_count(raio->aio);
+    PROTECT(out = nano_decode(raio->data, nng_aio_count(raio->aio), raio->mode, NANO_PROT(aio)));
   } else {
-    nng_msg *msg = (nng_msg *) raio->data;
-    buf = nng_msg_body(msg);
-    sz = nng_msg_len(msg);
+    PROTECT(out = nano_decode_msg((nng_msg **) &raio->data, raio->mode, NANO_PROT(aio)));
   }
-
-  PROTECT(out = nano_decode(buf, sz, raio->mode, NANO_PROT(aio)));
   PROTECT(pipe = Rf_ScalarInteger(-res));
   Rf_defineVar(nano_ValueSymbol, out, env);
   Rf_defineVar(nano_AioSymbol, pipe, env);
@@ -326,10 +745,12 @@ SEXP rnng_aio_call(SEXP x) {
     case RECVAIOS:
     case REQAIOS:
     case IOV_RECVAIOS:
+    case BATCH_RECVAIO:
       rnng_aio_get_msg(x);
       break;
     case SENDAIO:
     case IOV_SENDAIO:
+    case BATCH_SENDAIO:
       rnng_aio_result(x);
       break;
     case HTTP_AIO:
@@ -393,7 +814,31 @@ SEXP rnng_aio_collect(SEXP x) {
 
 SEXP rnng_aio_collect_safe(SEXP x) {
 
-  return rnng_aio_collect_impl(x, rnng_wait_thread_create);
+  nano_wait_set(x, 1);
+  return rnng_aio_collect_impl(x, rnng_aio_call);
+
+}
+
+SEXP rnng_aio_call_safe(SEXP x) {
+
+  nano_wait_set(x, 1);
+  return rnng_aio_call(x);
+
+}
+
+SEXP rnng_aio_race(SEXP x) {
+
+  const SEXPTYPE typ = TYPEOF(x);
+  if (typ != VECSXP && typ != ENVSXP)
+    Rf_error("object is not an Aio or list of Aios");
+
+  const R_xlen_t i = nano_wait_set(x, 0);
+  if (i < 0)
+    return Rf_ScalarInteger(0);
+
+  rnng_aio_call(typ == VECSXP ? NANO_VECTOR(x)[i] : x);
+
+  return Rf_ScalarInteger((int) i + 1);
 
 }
 
@@ -404,6 +849,7 @@ SEXP rnng_aio_stop(SEXP x) {
     const SEXP coreaio = Rf_findVarInFrame(x, nano_AioSymbol);
     if (NANO_PTR_CHECK(coreaio, nano_AioSymbol)) break;
     nano_aio *aiop = (nano_aio *) NANO_PTR(coreaio);
+    aiop->pool = 0;
     nng_aio_stop(aiop->aio);
     break;
   case VECSXP: ;
@@ -432,6 +878,7 @@ static int rnng_unresolved_impl(SEXP x) {
     switch (aio->type) {
     case SENDAIO:
     case IOV_SENDAIO:
+    case BATCH_SENDAIO:
       value = rnng_aio_result(x);
       break;
     case HTTP_AIO:
@@ -506,10 +953,10 @@ SEXP rnng_unresolved2(SEXP x) {
 
 // send recv aio functions -----------------------------------------------------
 
-SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP clo) {
+SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP hint, SEXP clo) {
 
   const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
-  const int raw = nano_encode_mode(mode);
+  const int enc = nano_encode_mode(mode);
   SEXP aio, env, fun;
   nano_aio *saio = NULL;
   nano_buf buf;
@@ -518,61 +965,74 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
   if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
 
     const int pipeid = sock ? nano_integer(pipe) : 0;
-    if (raw) {
-      nano_encode(&buf, data);
-    } else {
-      nano_serialize(&buf, data, NANO_PROT(con));
-    }
     nng_msg *msg = NULL;
 
-    saio = calloc(1, sizeof(nano_aio));
-    NANO_ENSURE_ALLOC(saio);
-    saio->type = SENDAIO;
+    if ((xc = nano_encode_data(&msg, data, enc, NANO_PROT(con), nano_size_hint(hint), NANO_HINT(con, sock), NANO_SHM(con, sock), NANO_SOCKID(con, sock))))
+      return mk_error_data(-xc);
 
-    if ((xc = nng_msg_alloc(&msg, 0)) ||
-        (xc = nng_msg_append(msg, buf.buf, buf.cur)) ||
-        (xc = nng_aio_alloc(&saio->aio, saio_complete, saio))) {
-      nng_msg_free(msg);
-      goto fail;
+    if ((saio = nano_aio_take(0)) == NULL) {
+      nano_msg_free(msg);
+      return mk_error_data(-2);
     }
+    saio->type = SENDAIO;
 
     if (pipeid) {
       nng_pipe p;
       p.id = (uint32_t) pipeid;
       nng_msg_set_pipe(msg, p);
+    } else if (sock) {
+      saio->routed = (uint8_t) nano_route_pick(nng_socket_id(*(nng_socket *) NANO_PTR(con)), msg);
     }
 
-    nng_aio_set_msg(saio->aio, msg);
-    nng_aio_set_timeout(saio->aio, dur);
-    sock ? nng_send_aio(*(nng_socket *) NANO_PTR(con), saio->aio) :
-           nng_ctx_send(*(nng_ctx *) NANO_PTR(con), saio->aio);
-    NANO_FREE(buf);
+    nano_hist_arm(saio, NANO_HIST(con, sock));
+    if (sock && !pipeid && nano_conflate_put(nng_socket_id(*(nng_socket *) NANO_PTR(con)), msg)) {
+      // held for the next publish, resolving immediately as accepted
+      nng_aio_set_msg(saio->aio, NULL);
+      nng_sleep_aio(0, saio->aio);
+    } else {
+      nng_aio_set_msg(saio->aio, msg);
+      nng_aio_set_timeout(saio->aio, dur);
+      sock ? nng_send_aio(*(nng_socket *) NANO_PTR(con), saio->aio) :
+             nng_ctx_send(*(nng_ctx *) NANO_PTR(con), saio->aio);
+    }
 
     PROTECT(aio = R_MakeExternalPtr(saio, nano_AioSymbol, R_NilValue));
     R_RegisterCFinalizerEx(aio, saio_finalizer, TRUE);
 
   } else if (!NANO_PTR_CHECK(con, nano_StreamSymbol)) {
 
-    nano_encode(&buf, data);
-
     nano_stream *nst = (nano_stream *) NANO_PTR(con);
     nng_stream *sp = nst->stream;
+    nng_iov iov[NANONEXT_IOV_MAX];
+    unsigned niov = 1;
+
+    if (TYPEOF(data) == VECSXP) {
+      niov = nano_encode_iov(iov, data);
+      NANO_INIT(&buf, NULL, 0);
+    } else {
+      nano_encode(&buf, data);
+    }
 
     saio = calloc(1, sizeof(nano_aio));
     NANO_ENSURE_ALLOC(saio);
     saio->type = IOV_SENDAIO;
-    saio->data = calloc(buf.cur, sizeof(unsigned char));
-    NANO_ENSURE_ALLOC(saio->data);
-    memcpy(saio->data, buf.buf, buf.cur);
-    nng_iov iov = {
-      .iov_buf = saio->data,
-      .iov_len = buf.cur - nst->textframes
-    };
+
+    if (TYPEOF(data) != VECSXP) {
+      saio->data = calloc(buf.cur, sizeof(unsigned char));
+      NANO_ENSURE_ALLOC(saio->data);
+      memcpy(saio->data, buf.buf, buf.cur);
+      iov[0].iov_buf = saio->data;
+      iov[0].iov_len = buf.cur - nst->textframes;
+    }
 
     if ((xc = nng_aio_alloc(&saio->aio, isaio_complete, saio)) ||
-        (xc = nng_aio_set_iov(saio->aio, 1u, &iov)))
+        (xc = nng_aio_set_iov(saio->aio, niov, iov)))
       goto fail;
 
+    // list elements are sent in place, and so kept alive until completion
+    if (TYPEOF(data) == VECSXP)
+      saio->cb = nano_PreserveObject(data);
+
     nng_aio_set_timeout(saio->aio, dur);
     nng_stream_send(sp, saio->aio);
     NANO_FREE(buf);
@@ -604,7 +1064,134 @@ SEXP rnng_send_aio(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP
 
 }
 
-SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEXP clo) {
+SEXP rnng_send_aio_batch(SEXP con, SEXP data, SEXP mode, SEXP timeout, SEXP pipe, SEXP clo) {
+
+  if (NANO_PTR_CHECK(con, nano_SocketSymbol))
+    Rf_error("`con` is not a valid Socket");
+
+  if (TYPEOF(data) != VECSXP || XLENGTH(data) == 0 || XLENGTH(data) > INT_MAX)
+    Rf_error("`data` must be a non-empty list");
+
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  const int enc = nano_encode_mode(mode);
+  const int pipeid = nano_integer(pipe);
+  const int n = (int) XLENGTH(data);
+  const SEXP *dp = NANO_VECTOR(data);
+  nng_socket *sock = (nng_socket *) NANO_PTR(con);
+  nano_aio *saio = NULL;
+  nano_batch *batch;
+  SEXP aio, env, fun;
+  int xc;
+
+  if (enc == 1) {
+    for (int i = 0; i < n; i++) {
+      switch (TYPEOF(dp[i])) {
+      case STRSXP:
+      case REALSXP:
+      case INTSXP:
+      case LGLSXP:
+      case CPLXSXP:
+      case RAWSXP:
+      case NILSXP:
+        break;
+      default:
+        Rf_error("`data` must be a list of atomic vectors or NULL to send in mode 'raw'");
+      }
+    }
+  } else if (enc == 3) {
+    for (int i = 0; i < n; i++) {
+      if (TYPEOF(dp[i]) != STRSXP)
+        Rf_error("`data` must be a list of character vectors to send in mode 'prefixed'");
+    }
+  }
+
+  nano_batch_enc be = {.dp = dp, .con = con, .n = n, .enc = enc};
+  be.msgs = calloc(n, sizeof(nng_msg *));
+  be.xc = calloc(n, sizeof(int));
+  if (be.msgs == NULL || be.xc == NULL) {
+    free(be.msgs);
+    free(be.xc);
+    return mk_error_data(-2);
+  }
+  R_ExecWithCleanup(nano_batch_encode, &be, nano_batch_encode_cleanup, &be);
+
+  saio = calloc(1, sizeof(nano_aio));
+  if (saio == NULL) {
+    xc = 2;
+    goto failmem;
+  }
+  saio->type = BATCH_SENDAIO;
+
+  if ((xc = nng_aio_alloc(&saio->aio, bsaio_complete, saio)))
+    goto fail;
+
+  batch = nano_batch_alloc(saio, n, SENDAIO);
+  if (batch == NULL) {
+    xc = 2;
+    goto fail;
+  }
+  saio->data = batch;
+
+  PROTECT(aio = R_MakeExternalPtr(saio, nano_AioSymbol, R_NilValue));
+  R_RegisterCFinalizerEx(aio, saio_finalizer, TRUE);
+
+  nng_aio_begin(saio->aio);
+  nng_aio_defer(saio->aio, batch_cancel, batch);
+
+  for (int i = 0; i < n; i++) {
+    nano_aio *xaio = &batch->aios[i];
+    nng_msg *msg = be.msgs[i];
+    if (be.xc[i]) {
+      nng_aio_begin(xaio->aio);
+      nng_aio_finish(xaio->aio, be.xc[i]);
+      continue;
+    }
+    if (pipeid) {
+      nng_pipe p;
+      p.id = (uint32_t) pipeid;
+      nng_msg_set_pipe(msg, p);
+    } else {
+      xaio->routed = (uint8_t) nano_route_pick(nng_socket_id(*sock), msg);
+    }
+    nano_hist_arm(xaio, NANO_HIST(con, 1));
+    if (!pipeid && nano_conflate_put(nng_socket_id(*sock), msg)) {
+      // held for the next publish, resolving immediately as accepted
+      nng_aio_set_msg(xaio->aio, NULL);
+      nng_sleep_aio(0, xaio->aio);
+      continue;
+    }
+    nng_aio_set_msg(xaio->aio, msg);
+    nng_aio_set_timeout(xaio->aio, dur);
+    nng_send_aio(*sock, xaio->aio);
+  }
+  free(be.msgs);
+  free(be.xc);
+
+  PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
+  Rf_classgets(env, nano_sendAio);
+  Rf_defineVar(nano_AioSymbol, aio, env);
+
+  PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncRes, clo));
+  R_MakeActiveBinding(nano_ResultSymbol, fun, env);
+
+  UNPROTECT(3);
+  return env;
+
+  fail:
+  nng_aio_free(saio->aio);
+  free(saio);
+  failmem:
+  for (int i = 0; i < n; i++) {
+    if (be.msgs[i] != NULL)
+      nano_msg_free(be.msgs[i]);
+  }
+  free(be.msgs);
+  free(be.xc);
+  return mk_error_data(-xc);
+
+}
+
+SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEXP queue, SEXP clo) {
 
   const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
   int signal, interrupt;
@@ -618,31 +1205,52 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEX
   nano_cv *ncv = signal ? (nano_cv *) NANO_PTR(cvar) : NULL;
   nano_aio *raio = NULL;
   SEXP aio, env, fun;
-  int sock, xc;
+  size_t xlen = 0;
+  uint8_t mod;
+  int sock, stream = 0, xc;
 
+  // arguments are validated before the queue node is allocated, as each may
+  // raise an error
   if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
+    mod = (uint8_t) nano_matcharg(mode);
+  } else if (!NANO_PTR_CHECK(con, nano_StreamSymbol)) {
+    mod = (uint8_t) (nano_matcharg(mode) == 1 ? 2 : nano_matcharg(mode));
+    xlen = (size_t) nano_integer(bytes);
+    stream = 1;
+  } else {
+    Rf_error("`con` is not a valid Socket, Context or Stream");
+  }
 
-    const uint8_t mod = (uint8_t) nano_matcharg(mode);
-    raio = calloc(1, sizeof(nano_aio));
-    NANO_ENSURE_ALLOC(raio);
+  nano_queue_node *qn = nano_queue_node_alloc(queue);
+  if (queue != R_NilValue && qn == NULL)
+    ERROR_OUT(NNG_ENOMEM);
+
+  if (!stream) {
+
+    if (interrupt) {
+      raio = calloc(1, sizeof(nano_aio));
+      NANO_ENSURE_ALLOC(raio);
+      if ((xc = nng_aio_alloc(&raio->aio, raio_complete_interrupt, raio)))
+        goto fail;
+    } else {
+      raio = nano_aio_take(1);
+      NANO_ENSURE_ALLOC(raio);
+    }
     raio->next = ncv;
     raio->type = signal ? RECVAIOS : RECVAIO;
     raio->mode = mod;
-
-    if ((xc = nng_aio_alloc(&raio->aio, interrupt ? raio_complete_interrupt : raio_complete, raio)))
-      goto fail;
+    raio->queue = qn;
 
     nng_aio_set_timeout(raio->aio, dur);
+    nano_hist_arm(raio, NANO_HIST(con, sock));
     sock ? nng_recv_aio(*(nng_socket *) NANO_PTR(con), raio->aio) :
       nng_ctx_recv(*(nng_ctx *) NANO_PTR(con), raio->aio);
 
     PROTECT(aio = R_MakeExternalPtr(raio, nano_AioSymbol, NANO_PROT(con)));
     R_RegisterCFinalizerEx(aio, raio_finalizer, TRUE);
 
-  } else if (!NANO_PTR_CHECK(con, nano_StreamSymbol)) {
+  } else {
 
-    const uint8_t mod = (uint8_t) (nano_matcharg(mode) == 1 ? 2 : nano_matcharg(mode));
-    const size_t xlen = (size_t) nano_integer(bytes);
     nng_stream **sp = (nng_stream **) NANO_PTR(con);
 
     raio = calloc(1, sizeof(nano_aio));
@@ -650,6 +1258,7 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEX
     raio->next = ncv;
     raio->type = signal ? IOV_RECVAIOS : IOV_RECVAIO;
     raio->mode = mod;
+    raio->queue = qn;
     raio->data = calloc(xlen, sizeof(unsigned char));
     NANO_ENSURE_ALLOC(raio->data);
     nng_iov iov = {
@@ -667,8 +1276,6 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEX
     PROTECT(aio = R_MakeExternalPtr(raio, nano_AioSymbol, R_NilValue));
     R_RegisterCFinalizerEx(aio, iaio_finalizer, TRUE);
 
-  } else {
-    Rf_error("`con` is not a valid Socket, Context or Stream");
   }
 
   PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
@@ -678,6 +1285,9 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEX
   PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncMsg, clo));
   R_MakeActiveBinding(nano_DataSymbol, fun, env);
 
+  if (qn != NULL)
+    nano_queue_bind(qn, env, queue);
+
   UNPROTECT(3);
   return env;
 
@@ -686,10 +1296,101 @@ SEXP rnng_recv_aio(SEXP con, SEXP mode, SEXP timeout, SEXP cvar, SEXP bytes, SEX
   free(raio->data);
   failmem:
   free(raio);
+  free(qn);
   return mk_error_data(xc);
 
 }
 
+SEXP rnng_recv_aio_batch(SEXP con, SEXP n, SEXP mode, SEXP timeout, SEXP clo) {
+
+  if (NANO_PTR_CHECK(con, nano_SocketSymbol))
+    Rf_error("`con` is not a valid Socket");
+
+  const int num = nano_integer(n);
+  if (num < 1)
+    Rf_error("`n` must be a positive integer");
+
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  const uint8_t mod = (uint8_t) nano_matcharg(mode);
+  nng_socket *sock = (nng_socket *) NANO_PTR(con);
+  nano_aio *raio = NULL;
+  nano_batch *batch;
+  SEXP aio, env, fun;
+  int xc;
+
+  raio = calloc(1, sizeof(nano_aio));
+  NANO_ENSURE_ALLOC(raio);
+  raio->type = BATCH_RECVAIO;
+  raio->mode = mod;
+
+  if ((xc = nng_aio_alloc(&raio->aio, braio_complete, raio)))
+    goto fail;
+
+  batch = nano_batch_alloc(raio, num, RECVAIO);
+  if (batch == NULL) {
+    xc = 2;
+    goto fail;
+  }
+  raio->data = batch;
+
+  PROTECT(aio = R_MakeExternalPtr(raio, nano_AioSymbol, NANO_PROT(con)));
+  R_RegisterCFinalizerEx(aio, braio_finalizer, TRUE);
+
+  nng_aio_begin(raio->aio);
+  nng_aio_defer(raio->aio, batch_cancel, batch);
+
+  for (int i = 0; i < num; i++) {
+    nng_aio_set_timeout(batch->aios[i].aio, dur);
+    nano_hist_arm(&batch->aios[i], NANO_HIST(con, 1));
+    nng_recv_aio(*sock, batch->aios[i].aio);
+  }
+
+  PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
+  Rf_classgets(env, nano_recvAio);
+  Rf_defineVar(nano_AioSymbol, aio, env);
+
+  PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncMsg, clo));
+  R_MakeActiveBinding(nano_DataSymbol, fun, env);
+
+  UNPROTECT(3);
+  return env;
+
+  fail:
+  nng_aio_free(raio->aio);
+  failmem:
+  free(raio);
+  return mk_error_data(xc);
+
+}
+
+SEXP rnng_aio_pool(SEXP size) {
+
+  if (size != R_NilValue) {
+    const int max = nano_integer(size);
+    if (max < 0)
+      Rf_error("`size` must be a non-negative integer");
+    nano_pool_max = max;
+    nano_aio_pool_trim(max);
+  }
+
+  const char *names[] = {"size", "send", "recv", ""};
+  const char *snames[] = {"cached", "hits", "misses", ""};
+  SEXP out, vec;
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(out, 0, Rf_ScalarInteger(nano_pool_max));
+  for (int i = 0; i < 2; i++) {
+    vec = Rf_mkNamed(REALSXP, snames);
+    SET_VECTOR_ELT(out, i + 1, vec);
+    REAL(vec)[0] = (double) nano_pool[i].count;
+    REAL(vec)[1] = nano_pool[i].hits;
+    REAL(vec)[2] = nano_pool[i].misses;
+  }
+
+  UNPROTECT(1);
+  return out;
+
+}
+
 SEXP rnng_interrupt_switch(SEXP x) {
 
   nano_interrupt = NANO_INTEGER(x);
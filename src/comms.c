@@ -33,6 +33,7 @@ static void context_finalizer(SEXP xptr) {
   if (NANO_PTR(xptr) == NULL) return;
   nng_ctx *xp = (nng_ctx *) NANO_PTR(xptr);
   nng_ctx_close(*xp);
+  nano_shm_accept(&((nano_ctx *) xp)->shmrx, 0);
   free(xp);
 
 }
@@ -47,11 +48,12 @@ SEXP rnng_ctx_open(SEXP socket) {
   nng_socket *sock = (nng_socket *) NANO_PTR(socket);
   SEXP context;
   int xc;
-  nng_ctx *ctx = malloc(sizeof(nng_ctx));
+  nng_ctx *ctx = calloc(1, sizeof(nano_ctx));
   NANO_ENSURE_ALLOC(ctx);
 
   if ((xc = nng_ctx_open(ctx, *sock)))
     goto fail;
+  ((nano_ctx *) ctx)->sock = nng_socket_id(*sock);
 
   PROTECT(context = R_MakeExternalPtr(ctx, nano_ContextSymbol, NANO_PROT(socket)));
   R_RegisterCFinalizerEx(context, context_finalizer, TRUE);
@@ -80,11 +82,12 @@ SEXP rnng_ctx_create(SEXP socket) {
   nng_socket *sock = (nng_socket *) NANO_PTR(socket);
   SEXP context;
   int xc;
-  nng_ctx *ctx = malloc(sizeof(nng_ctx));
+  nng_ctx *ctx = calloc(1, sizeof(nano_ctx));
   NANO_ENSURE_ALLOC(ctx);
 
   if ((xc = nng_ctx_open(ctx, *sock)))
     goto fail;
+  ((nano_ctx *) ctx)->sock = nng_socket_id(*sock);
 
   PROTECT(context = R_MakeExternalPtr(ctx, nano_ContextSymbol, NANO_PROT(socket)));
   R_RegisterCFinalizerEx(context, context_finalizer, TRUE);
@@ -107,6 +110,7 @@ SEXP rnng_ctx_close(SEXP context) {
   const int xc = nng_ctx_close(*ctx);
   if (xc)
     ERROR_RET(xc);
+  nano_shm_accept(&((nano_ctx *) ctx)->shmrx, 0);
 
   Rf_setAttrib(context, nano_StateSymbol, Rf_mkString("closed"));
   return nano_success;
@@ -140,16 +144,15 @@ SEXP rnng_dial(SEXP socket, SEXP url, SEXP tls, SEXP autostart, SEXP fail) {
   NANO_ENSURE_ALLOC(dp);
 
   if (sec) {
-    cfg = (nng_tls_config *) NANO_PTR(tls);
     if ((xc = nng_dialer_create(dp, *sock, ur)) ||
         (xc = nng_url_parse(&up, ur)) ||
-        (xc = nng_tls_config_server_name(cfg, up->u_hostname)) ||
+        (xc = nano_tls_host(&cfg, tls, up->u_hostname)) ||
         (xc = nng_dialer_set_ptr(*dp, NNG_OPT_TLS_CONFIG, cfg)))
       goto fail;
     nng_url_free(up);
+    up = NULL;
     if (start && (xc = nng_dialer_start(*dp, start == 1 ? NNG_FLAG_NONBLOCK : 0)))
         goto fail;
-    nng_tls_config_hold(cfg);
 
     PROTECT_INDEX pxi;
     PROTECT_WITH_INDEX(xp = R_MakeExternalPtr(cfg, nano_TlsSymbol, R_NilValue), &pxi);
@@ -185,6 +188,8 @@ SEXP rnng_dial(SEXP socket, SEXP url, SEXP tls, SEXP autostart, SEXP fail) {
   return nano_success;
 
   fail:
+  if (cfg != NULL)
+    nng_tls_config_free(cfg);
   nng_url_free(up);
   free(dp);
   failmem:
@@ -331,90 +336,87 @@ SEXP rnng_listener_close(SEXP listener) {
 
 // send and recv ---------------------------------------------------------------
 
-SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe) {
+SEXP rnng_send(SEXP con, SEXP data, SEXP mode, SEXP block, SEXP pipe, SEXP hint) {
 
   const int flags = block == R_NilValue ? NNG_DURATION_DEFAULT : TYPEOF(block) == LGLSXP ? 0 : nano_integer(block);
-  const int raw = nano_encode_mode(mode);
+  const int enc = nano_encode_mode(mode);
   nano_buf buf;
   int sock, xc;
 
   if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
 
     const int pipeid = sock ? nano_integer(pipe) : 0;
-    if (raw) {
-      nano_encode(&buf, data);
-    } else {
-      nano_serialize(&buf, data, NANO_PROT(con));
-    }
     nng_msg *msgp = NULL;
 
-    if (flags <= 0) {
+    if ((xc = nano_encode_data(&msgp, data, enc, NANO_PROT(con), nano_size_hint(hint), NANO_HINT(con, sock), NANO_SHM(con, sock), NANO_SOCKID(con, sock))))
+      return mk_error(xc);
 
-      if ((xc = nng_msg_alloc(&msgp, 0)))
-        goto fail;
+    int routed = 0;
+    if (pipeid) {
+      nng_pipe p;
+      p.id = (uint32_t) pipeid;
+      nng_msg_set_pipe(msgp, p);
+    } else if (sock) {
+      routed = nano_route_pick(nng_socket_id(*(nng_socket *) NANO_PTR(con)), msgp);
+    }
 
-      if (pipeid) {
-        nng_pipe p;
-        p.id = (uint32_t) pipeid;
-        nng_msg_set_pipe(msgp, p);
-      }
+    if (sock && !pipeid && nano_conflate_put(nng_socket_id(*(nng_socket *) NANO_PTR(con)), msgp)) {
+
+      xc = 0;
 
-      if ((xc = nng_msg_append(msgp, buf.buf, buf.cur)) ||
-          (xc = sock ? nng_sendmsg(*(nng_socket *) NANO_PTR(con), msgp, flags ? NNG_FLAG_NONBLOCK : (NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK) :
+    } else if (flags <= 0) {
+
+      if ((xc = sock ? nng_sendmsg(*(nng_socket *) NANO_PTR(con), msgp, flags ? NNG_FLAG_NONBLOCK : (NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK) :
                        nng_ctx_sendmsg(*(nng_ctx *) NANO_PTR(con), msgp, flags ? NNG_FLAG_NONBLOCK : (NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK))) {
-        nng_msg_free(msgp);
-        goto fail;
+        if (routed)
+          nano_route_undo(msgp);
+        nano_msg_free(msgp);
       }
 
-      NANO_FREE(buf);
-
     } else {
 
       nng_aio *aiop = NULL;
 
-      if ((xc = nng_msg_alloc(&msgp, 0)))
-        goto fail;
-
-      if (pipeid) {
-        nng_pipe p;
-        p.id = (uint32_t) pipeid;
-        nng_msg_set_pipe(msgp, p);
-      }
-
-      if ((xc = nng_msg_append(msgp, buf.buf, buf.cur)) ||
-          (xc = nng_aio_alloc(&aiop, NULL, NULL))) {
-        nng_msg_free(msgp);
-        goto fail;
+      if ((xc = nng_aio_alloc(&aiop, NULL, NULL))) {
+        nano_msg_free(msgp);
+        return mk_error(xc);
       }
 
       nng_aio_set_msg(aiop, msgp);
       nng_aio_set_timeout(aiop, flags);
       sock ? nng_send_aio(*(nng_socket *) NANO_PTR(con), aiop) :
              nng_ctx_send(*(nng_ctx *) NANO_PTR(con), aiop);
-      NANO_FREE(buf);
       nng_aio_wait(aiop);
-      if ((xc = nng_aio_result(aiop)))
-        nng_msg_free(nng_aio_get_msg(aiop));
+      if ((xc = nng_aio_result(aiop))) {
+        if (routed)
+          nano_route_undo(nng_aio_get_msg(aiop));
+        nano_msg_free(nng_aio_get_msg(aiop));
+      }
       nng_aio_free(aiop);
 
     }
 
   } else if (!NANO_PTR_CHECK(con, nano_StreamSymbol)) {
 
-    nano_encode(&buf, data);
-
     nano_stream *nst = (nano_stream *) NANO_PTR(con);
     nng_stream *sp = nst->stream;
     nng_aio *aiop = NULL;
-    nng_iov iov = {
-      .iov_buf = buf.buf,
-      .iov_len = buf.cur - nst->textframes
-    };
+    nng_iov iov[NANONEXT_IOV_MAX];
+    unsigned niov = 1;
+
+    if (TYPEOF(data) == VECSXP) {
+      niov = nano_encode_iov(iov, data);
+      NANO_INIT(&buf, NULL, 0);
+    } else {
+      nano_encode(&buf, data);
+      iov[0].iov_buf = buf.buf;
+      iov[0].iov_len = buf.cur - nst->textframes;
+    }
 
     if ((xc = nng_aio_alloc(&aiop, NULL, NULL)))
       goto fail;
 
-    if ((xc = nng_aio_set_iov(aiop, 1u, &iov))) {
+    if ((xc = nng_aio_set_iov(aiop, niov, iov))) {
       nng_aio_free(aiop);
       goto fail;
     }
@@ -456,11 +458,14 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block, SEXP bytes) {
 
     if (flags <= 0) {
 
-      if ((xc = nng_recv(*sock, &buf, &sz, NNG_FLAG_ALLOC + (flags < 0 || NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK)))
+      nng_msg *msgp = NULL;
+      if ((xc = nng_recvmsg(*sock, &msgp, (flags < 0 || NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK)))
         goto fail;
 
-      res = nano_decode(buf, sz, mod, NANO_PROT(con));
-      nng_free(buf, sz);
+      nano_route_ack(msgp);
+      nano_shm_mark(msgp);
+      res = nano_decode_msg(&msgp, mod, NANO_PROT(con));
+      nng_msg_free(msgp);
 
     } else {
 
@@ -476,9 +481,9 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block, SEXP bytes) {
       }
       nng_msg *msgp = nng_aio_get_msg(aiop);
       nng_aio_free(aiop);
-      buf = nng_msg_body(msgp);
-      sz = nng_msg_len(msgp);
-      res = nano_decode(buf, sz, mod, NANO_PROT(con));
+      nano_route_ack(msgp);
+      nano_shm_mark(msgp);
+      res = nano_decode_msg(&msgp, mod, NANO_PROT(con));
       nng_msg_free(msgp);
     }
 
@@ -493,9 +498,8 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block, SEXP bytes) {
       if ((xc = nng_ctx_recvmsg(*ctxp, &msgp, (flags < 0 || NANO_INTEGER(block) != 1) * NNG_FLAG_NONBLOCK)))
         goto fail;
 
-      buf = nng_msg_body(msgp);
-      sz = nng_msg_len(msgp);
-      res = nano_decode(buf, sz, mod, NANO_PROT(con));
+      nano_shm_mark(msgp);
+      res = nano_decode_msg(&msgp, mod, NANO_PROT(con));
       nng_msg_free(msgp);
 
     } else {
@@ -515,9 +519,8 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block, SEXP bytes) {
 
       msgp = nng_aio_get_msg(aiop);
       nng_aio_free(aiop);
-      buf = nng_msg_body(msgp);
-      sz = nng_msg_len(msgp);
-      res = nano_decode(buf, sz, mod, NANO_PROT(con));
+      nano_shm_mark(msgp);
+      res = nano_decode_msg(&msgp, mod, NANO_PROT(con));
       nng_msg_free(msgp);
 
     }
@@ -526,9 +529,19 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block, SEXP bytes) {
 
     const int mod = nano_matcharg(mode) == 1 ? 2 : nano_matcharg(mode);
     const size_t xlen = (size_t) nano_integer(bytes);
-    nng_stream **sp = (nng_stream **) NANO_PTR(con);
+    nano_stream *nst = (nano_stream *) NANO_PTR(con);
+    nng_stream **sp = &nst->stream;
     nng_aio *aiop = NULL;
 
+    // bytes left buffered by recv_frame() are returned first
+    if (nst->rlen) {
+      sz = nst->rlen < xlen ? nst->rlen : xlen;
+      res = nano_decode(nst->rbuf + nst->rpos, sz, mod, NANO_PROT(con));
+      nst->rpos += sz;
+      nst->rlen -= sz;
+      return res;
+    }
+
     buf = calloc(xlen, sizeof(unsigned char));
     NANO_ENSURE_ALLOC(buf);
     nng_iov iov = {
@@ -568,3 +581,613 @@ SEXP rnng_recv(SEXP con, SEXP mode, SEXP block, SEXP bytes) {
   return mk_error(xc);
 
 }
+
+// chunked send and recv -------------------------------------------------------
+
+// waits for any chunk in flight, then sends the current chunk asynchronously
+int nano_chunk_send(nano_chunk *ch) {
+
+  int xc;
+
+  nng_aio_wait(ch->aio);
+  if ((xc = nng_aio_result(ch->aio))) {
+    nng_msg_free(nng_aio_get_msg(ch->aio));
+    nng_aio_set_msg(ch->aio, NULL);
+    return xc;
+  }
+
+  if (ch->msg != NULL) {
+    nng_aio_set_msg(ch->aio, ch->msg);
+    ch->msg = NULL;
+    nng_send_aio(*ch->sock, ch->aio);
+  }
+
+  return 0;
+
+}
+
+// replaces the current chunk with the next one received
+int nano_chunk_recv(nano_chunk *ch) {
+
+  int xc;
+
+  nng_msg_free(ch->msg);
+  ch->msg = NULL;
+  ch->cur = 0;
+
+  nng_recv_aio(*ch->sock, ch->aio);
+  nng_aio_wait(ch->aio);
+  if ((xc = nng_aio_result(ch->aio)))
+    return xc;
+
+  ch->msg = nng_aio_get_msg(ch->aio);
+  nng_aio_set_msg(ch->aio, NULL);
+
+  return 0;
+
+}
+
+// checks the frame of the current chunk against the expected sequence number,
+// returning 1 if in sequence, 0 if out of sequence and -1 if not a chunk
+int nano_chunk_frame(nano_chunk *ch) {
+
+  const unsigned char *buf = (unsigned char *) nng_msg_body(ch->msg);
+  uint32_t seq;
+
+  if (nng_msg_len(ch->msg) < NANONEXT_CHUNK_HDR || memcmp(buf, NANONEXT_CHUNK_MAGIC, 8))
+    return -1;
+
+  memcpy(&seq, buf + 12, sizeof(uint32_t));
+  if (seq != ch->seq)
+    return 0;
+
+  ch->seq++;
+  ch->last = buf[8];
+  ch->cur = NANONEXT_CHUNK_HDR;
+  return 1;
+
+}
+
+static void nano_chunk_cleanup(void *arg) {
+
+  nano_chunk *ch = (nano_chunk *) arg;
+  nng_aio_wait(ch->aio);
+  if (nng_aio_result(ch->aio))
+    nng_msg_free(nng_aio_get_msg(ch->aio));
+  nng_aio_free(ch->aio);
+  nng_msg_free(ch->msg);
+
+}
+
+SEXP rnng_send_chunked(SEXP con, SEXP data, SEXP chunk, SEXP timeout) {
+
+  if (NANO_PTR_CHECK(con, nano_SocketSymbol))
+    Rf_error("`con` is not a valid Socket");
+
+  const int size = nano_integer(chunk);
+  if (size < NANONEXT_CHUNK_MIN)
+    Rf_error("`chunk` must be an integer of at least %d", NANONEXT_CHUNK_MIN);
+
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  nano_chunk ch = {
+    .sock = (nng_socket *) NANO_PTR(con),
+    .data = data,
+    .hook = NANO_PROT(con),
+    .size = (size_t) size
+  };
+  int xc;
+
+  if ((xc = nng_aio_alloc(&ch.aio, NULL, NULL)))
+    return mk_error(xc);
+
+  nng_aio_set_timeout(ch.aio, dur);
+  R_ExecWithCleanup(nano_serialize_chunked, &ch, nano_chunk_cleanup, &ch);
+
+  if (ch.xc)
+    return mk_error(ch.xc);
+
+  return nano_success;
+
+}
+
+SEXP rnng_recv_chunked(SEXP con, SEXP timeout) {
+
+  if (NANO_PTR_CHECK(con, nano_SocketSymbol))
+    Rf_error("`con` is not a valid Socket");
+
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  nano_sock *ns = (nano_sock *) NANO_PTR(con);
+  nano_chunk ch = {
+    .sock = &ns->sock,
+    .held = &ns->chunk,
+    .hook = NANO_PROT(con)
+  };
+  int xc;
+
+  if ((xc = nng_aio_alloc(&ch.aio, NULL, NULL)))
+    return mk_error(xc);
+
+  nng_aio_set_timeout(ch.aio, dur);
+
+  // starts from any message held over from an interrupted object, then chunks
+  // left over from an abandoned object are discarded until the first chunk of
+  // the next, and a message that is not a chunk is taken whole
+  for (;;) {
+    if (ns->chunk != NULL) {
+      nng_msg_free(ch.msg);
+      ch.msg = ns->chunk;
+      ch.cur = 0;
+      ns->chunk = NULL;
+    } else if ((xc = nano_chunk_recv(&ch))) {
+      nng_aio_free(ch.aio);
+      return mk_error(xc);
+    }
+    const int frame = nano_chunk_frame(&ch);
+    if (frame == 1)
+      break;
+    if (frame < 0) {
+      ch.last = 1;
+      break;
+    }
+  }
+
+  return R_ExecWithCleanup(nano_unserialize_chunked, &ch, nano_chunk_cleanup, &ch);
+
+}
+
+// framed stream recv ----------------------------------------------------------
+
+static int nano_frame_type(const SEXP frame) {
+
+  if (TYPEOF(frame) == INTSXP)
+    return NANO_INTEGER(frame);
+
+  const char *typ = CHAR(STRING_ELT(frame, 0));
+  if (!strcmp(typ, "delim")) return 1;
+  if (!strcmp(typ, "u32")) return 2;
+  if (!strcmp(typ, "u64")) return 3;
+
+  Rf_error("`frame` should be one of: delim, u32, u64");
+
+}
+
+// reads into the stream buffer, retaining unconsumed bytes, until at least
+// need bytes are buffered or one read completes
+static int nano_frame_read(nano_stream *nst, nng_aio *aiop, const size_t need) {
+
+  int xc;
+
+  size_t want = nst->rlen + NANONEXT_FRAME_READ;
+  if (need > want) want = need;
+
+  if (nst->rpos && nst->rpos + want > nst->rcap) {
+    memmove(nst->rbuf, nst->rbuf + nst->rpos, nst->rlen);
+    nst->rpos = 0;
+  }
+
+  // capacity doubles, so a large frame costs amortized linear copying
+  if (want > nst->rcap) {
+    size_t cap = nst->rcap ? nst->rcap : NANONEXT_FRAME_READ;
+    while (cap < want) cap <<= 1;
+    unsigned char *rbuf = realloc(nst->rbuf, cap);
+    if (rbuf == NULL)
+      return NNG_ENOMEM;
+    nst->rbuf = rbuf;
+    nst->rcap = cap;
+  }
+
+  nng_iov iov = {
+    .iov_buf = nst->rbuf + nst->rpos + nst->rlen,
+    .iov_len = nst->rcap - nst->rpos - nst->rlen
+  };
+
+  if ((xc = nng_aio_set_iov(aiop, 1u, &iov)))
+    return xc;
+
+  nng_stream_recv(nst->stream, aiop);
+  nng_aio_wait(aiop);
+  if ((xc = nng_aio_result(aiop)))
+    return xc;
+
+  nst->rlen += nng_aio_count(aiop);
+  return 0;
+
+}
+
+SEXP rnng_recv_frame(SEXP con, SEXP frame, SEXP delim, SEXP mode, SEXP block) {
+
+  if (NANO_PTR_CHECK(con, nano_StreamSymbol))
+    Rf_error("`con` is not a valid Stream");
+
+  const int flags = block == R_NilValue ? NNG_DURATION_DEFAULT : TYPEOF(block) == LGLSXP ? 0 : nano_integer(block);
+  const int mod = nano_matcharg(mode) == 1 ? 2 : nano_matcharg(mode);
+  const int typ = nano_frame_type(frame);
+  nano_stream *nst = (nano_stream *) NANO_PTR(con);
+  const unsigned char *dp = NULL;
+  size_t dlen = 0;
+
+  if (typ == 1) {
+    switch (TYPEOF(delim)) {
+    case STRSXP:
+      dp = (const unsigned char *) NANO_STRING(delim);
+      dlen = strlen((const char *) dp);
+      break;
+    case RAWSXP:
+      dp = (const unsigned char *) DATAPTR_RO(delim);
+      dlen = XLENGTH(delim);
+      break;
+    }
+    if (!dlen)
+      Rf_error("`delim` must be a non-empty character string or raw vector");
+  } else if (typ != 2 && typ != 3) {
+    Rf_error("`frame` should be one of: delim, u32, u64");
+  }
+
+  const size_t hdr = typ == 2 ? 4 : typ == 3 ? 8 : 0;
+  size_t scan = 0, len = 0, need = 0, i;
+  nng_aio *aiop = NULL;
+  unsigned char *p;
+  SEXP res;
+  int xc;
+
+  for (;;) {
+
+    p = nst->rbuf + nst->rpos;
+
+    if (typ == 1) {
+      const unsigned char *q = NULL;
+      if (nst->rlen >= dlen && scan <= nst->rlen - dlen) {
+        const unsigned char *end = p + nst->rlen - dlen + 1;
+        for (q = p + scan; (q = memchr(q, dp[0], end - q)) != NULL; q++) {
+          if (!memcmp(q, dp, dlen))
+            break;
+        }
+        scan = nst->rlen - dlen + 1;
+      }
+      if (q != NULL) {
+        len = q - p;
+        need = len + dlen;
+        break;
+      }
+      need = 0;
+    } else if (nst->rlen >= hdr) {
+      uint64_t flen = 0;
+      for (i = 0; i < hdr; i++)
+        flen = (flen << 8) | p[i];
+      if (flen > R_XLEN_T_MAX - hdr) {
+        xc = NNG_EMSGSIZE;
+        goto fail;
+      }
+      len = (size_t) flen;
+      need = hdr + len;
+      if (nst->rlen >= need)
+        break;
+    }
+
+    if (aiop == NULL) {
+      if ((xc = nng_aio_alloc(&aiop, NULL, NULL)))
+        goto fail;
+      nng_aio_set_timeout(aiop, flags ? flags : (NANO_INTEGER(block) != 0) * NNG_DURATION_DEFAULT);
+    }
+
+    if ((xc = nano_frame_read(nst, aiop, need)))
+      goto fail;
+
+  }
+
+  nng_aio_free(aiop);
+  res = nano_decode(nst->rbuf + nst->rpos + hdr, len, mod, NANO_PROT(con));
+  nst->rpos += need;
+  nst->rlen -= need;
+  if (!nst->rlen)
+    nst->rpos = 0;
+
+  return res;
+
+  fail:
+  nng_aio_free(aiop);
+  return mk_error(xc);
+
+}
+
+// dispatcher ------------------------------------------------------------------
+
+// each worker keeps one context permanently armed - a received request joins
+// the ready queue, and completion of the reply re-arms the receive, both on
+// nng threads, so the R thread only executes requests
+
+static void worker_complete(void *arg) {
+
+  nano_worker *w = (nano_worker *) arg;
+  nano_dispatcher *d = w->d;
+  const int res = nng_aio_result(w->aio);
+
+  if (w->state) {
+    if (res)
+      nano_msg_free(nng_aio_get_msg(w->aio));
+    if (res == NNG_ECLOSED || res == NNG_ECANCELED)
+      return;
+    w->state = 0;
+    nng_ctx_recv(w->ctx, w->aio);
+    return;
+  }
+
+  if (res) {
+    if (res != NNG_ECLOSED && res != NNG_ECANCELED)
+      nng_ctx_recv(w->ctx, w->aio);
+    return;
+  }
+
+  w->msg = nng_aio_get_msg(w->aio);
+  nano_shm_mark(w->msg);
+  w->next = NULL;
+
+  nng_mtx_lock(d->mtx);
+  if (d->tail != NULL) {
+    d->tail->next = w;
+  } else {
+    d->head = w;
+  }
+  d->tail = w;
+  d->ready++;
+  nng_cv_wake(d->cv);
+  nng_mtx_unlock(d->mtx);
+
+}
+
+static void dispatcher_free(nano_dispatcher *d) {
+
+  for (int i = 0; i < d->n; i++)
+    nng_aio_stop(d->workers[i].aio);
+  for (int i = 0; i < d->n; i++) {
+    nng_ctx_close(d->workers[i].ctx);
+    nng_aio_free(d->workers[i].aio);
+    if (d->workers[i].msg != NULL)
+      nng_msg_free(d->workers[i].msg);
+  }
+  nng_cv_free(d->cv);
+  nng_mtx_free(d->mtx);
+  free(d->workers);
+  free(d);
+
+}
+
+static void dispatcher_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  dispatcher_free((nano_dispatcher *) NANO_PTR(xptr));
+
+}
+
+typedef struct nano_dispatch_call_s {
+  nano_worker *w;
+  nano_dispatch_fn native;
+  SEXP fun;
+  SEXP args;
+  SEXP hook;
+  SEXP out;
+  size_t *hint;
+  size_t shm;
+  int sid;
+  nng_msg *msg;
+  int enc;
+  int xc;
+  uint8_t mod;
+} nano_dispatch_call;
+
+static void nano_dispatch_eval(void *arg) {
+
+  nano_dispatch_call *dc = (nano_dispatch_call *) arg;
+  SEXP data, call, res;
+
+  PROTECT(data = nano_decode_msg(&dc->w->msg, dc->mod, dc->hook));
+  PROTECT(call = Rf_lcons(dc->fun, Rf_cons(data, dc->args)));
+  res = Rf_eval(call, R_GlobalEnv);
+  SET_VECTOR_ELT(dc->out, 0, res);
+  dc->xc = nano_encode_data(&dc->msg, res, dc->enc, dc->hook, 0, dc->hint, dc->shm, dc->sid);
+  UNPROTECT(2);
+
+}
+
+// a native handler is passed the request body as received and writes the
+// reply through nano_dispatch_write(), without any R evaluation
+
+static void nano_dispatch_write(void *arg, const void *buf, R_xlen_t len) {
+
+  nano_dispatch_call *dc = (nano_dispatch_call *) arg;
+  if (!dc->xc && len > 0)
+    dc->xc = nng_msg_append(dc->msg, buf, (size_t) len);
+
+}
+
+static void nano_dispatch_native(void *arg) {
+
+  nano_dispatch_call *dc = (nano_dispatch_call *) arg;
+  nng_msg *req = dc->w->msg;
+
+  if ((dc->xc = nng_msg_alloc(&dc->msg, 0)))
+    return;
+  if (dc->native(nng_msg_body(req), (R_xlen_t) nng_msg_len(req), nano_dispatch_write, dc) && !dc->xc)
+    dc->xc = NNG_EINTERNAL;
+
+}
+
+SEXP rnng_dispatcher_create(SEXP socket, SEXP n) {
+
+  if (NANO_PTR_CHECK(socket, nano_SocketSymbol))
+    Rf_error("`socket` is not a valid Socket");
+
+  const char *proto = NANO_STRING(Rf_getAttrib(socket, nano_ProtocolSymbol));
+  if (strcmp(proto, "rep") && strcmp(proto, "respondent"))
+    Rf_error("`socket` must be a 'rep' or 'respondent' Socket");
+
+  const int nw = nano_integer(n);
+  if (nw < 1)
+    Rf_error("`n` must be a positive integer");
+
+  nng_socket *sock = (nng_socket *) NANO_PTR(socket);
+  nano_dispatcher *d = NULL;
+  SEXP xp;
+  int xc, i = 0;
+
+  d = calloc(1, sizeof(nano_dispatcher));
+  NANO_ENSURE_ALLOC(d);
+  d->workers = calloc(nw, sizeof(nano_worker));
+  NANO_ENSURE_ALLOC(d->workers);
+
+  if ((xc = nng_mtx_alloc(&d->mtx)))
+    goto fail;
+  if ((xc = nng_cv_alloc(&d->cv, d->mtx)))
+    goto fail;
+
+  for (; i < nw; i++) {
+    nano_worker *w = &d->workers[i];
+    w->d = d;
+    if ((xc = nng_ctx_open(&w->ctx, *sock)))
+      goto fail;
+    if ((xc = nng_aio_alloc(&w->aio, worker_complete, w))) {
+      nng_ctx_close(w->ctx);
+      goto fail;
+    }
+  }
+  d->n = nw;
+
+  for (i = 0; i < nw; i++)
+    nng_ctx_recv(d->workers[i].ctx, d->workers[i].aio);
+
+  PROTECT(xp = R_MakeExternalPtr(d, nano_DispatcherSymbol, socket));
+  R_RegisterCFinalizerEx(xp, dispatcher_finalizer, TRUE);
+  NANO_CLASS2(xp, "nanoDispatcher", "nano");
+  Rf_setAttrib(xp, nano_SocketSymbol, Rf_ScalarInteger(nng_socket_id(*sock)));
+  Rf_setAttrib(xp, nano_StateSymbol, Rf_mkString("opened"));
+
+  UNPROTECT(1);
+  return xp;
+
+  fail:
+  while (i-- > 0) {
+    nng_aio_free(d->workers[i].aio);
+    nng_ctx_close(d->workers[i].ctx);
+  }
+  nng_cv_free(d->cv);
+  nng_mtx_free(d->mtx);
+  failmem:
+  if (d != NULL)
+    free(d->workers);
+  free(d);
+  ERROR_OUT(xc);
+
+}
+
+SEXP rnng_dispatch(SEXP dispatcher, SEXP execute, SEXP recvmode, SEXP sendmode, SEXP max, SEXP timeout, SEXP args) {
+
+  if (NANO_PTR_CHECK(dispatcher, nano_DispatcherSymbol))
+    Rf_error("`dispatcher` is not a valid Dispatcher");
+
+  nano_dispatch_fn native = NULL;
+  if (TYPEOF(execute) == STRSXP &&
+      (native = (nano_dispatch_fn) nano_callable(execute)) == NULL)
+    Rf_error("`execute` must be a function or a 'package::name' C-callable");
+
+  nano_dispatcher *d = (nano_dispatcher *) NANO_PTR(dispatcher);
+  const SEXP socket = NANO_PROT(dispatcher);
+  const int limit = max == R_NilValue ? d->n : nano_integer(max);
+  nng_time period = timeout == R_NilValue ? 0 : (nng_time) nano_integer(timeout);
+  const int forever = timeout == R_NilValue;
+
+  nano_dispatch_call dc = {
+    .native = native,
+    .fun = execute,
+    .hook = NANO_PROT(socket),
+    .hint = &((nano_sock *) NANO_PTR(socket))->hint,
+    .shm = ((nano_sock *) NANO_PTR(socket))->shm,
+    .sid = nng_socket_id(*(nng_socket *) NANO_PTR(socket)),
+    .enc = native != NULL ? 1 : nano_encode_mode(sendmode),
+    .mod = (uint8_t) nano_matcharg(recvmode)
+  };
+
+  nng_time time, now = nng_clock();
+  int ready;
+  while (1) {
+    time = forever || period > 400 ? now + 400 : now + period;
+    nng_mtx_lock(d->mtx);
+    while (d->ready == 0) {
+      if (nng_cv_until(d->cv, time) == NNG_ETIMEDOUT)
+        break;
+    }
+    ready = d->ready;
+    nng_mtx_unlock(d->mtx);
+    if (ready || !(forever || period > 400)) break;
+    if (!forever) period -= 400;
+    R_CheckUserInterrupt();
+    now += 400;
+  }
+
+  if (ready == 0 || limit < 1)
+    return Rf_ScalarInteger(0);
+
+  SEXP out;
+  PROTECT(dc.args = Rf_VectorToPairList(args));
+  PROTECT(dc.out = Rf_allocVector(VECSXP, 1));
+
+  int served = 0;
+  nano_worker *w;
+  while (served < limit) {
+    nng_mtx_lock(d->mtx);
+    w = d->head;
+    if (w != NULL) {
+      d->head = w->next;
+      if (d->head == NULL)
+        d->tail = NULL;
+      d->ready--;
+    }
+    nng_mtx_unlock(d->mtx);
+    if (w == NULL) break;
+
+    dc.w = w;
+    dc.msg = NULL;
+    dc.xc = 0;
+    if (!R_ToplevelExec(native != NULL ? nano_dispatch_native : nano_dispatch_eval, &dc) || dc.xc) {
+      if (dc.msg != NULL)
+        nano_msg_free(dc.msg);
+      dc.msg = NULL;
+      PROTECT(out = Rf_allocVector(RAWSXP, 1));
+      RAW(out)[0] = 0;
+      dc.xc = dc.enc == 1 || dc.enc == 3 ? nano_encode_msg(&dc.msg, out) :
+        nano_serialize_msg(&dc.msg, out, R_NilValue, 0, dc.hint, 0);
+      UNPROTECT(1);
+    }
+    SET_VECTOR_ELT(dc.out, 0, R_NilValue);
+    if (w->msg != NULL) {
+      nano_msg_drop(w->msg);
+      w->msg = NULL;
+    }
+
+    if (dc.xc) {
+      w->state = 0;
+      nng_ctx_recv(w->ctx, w->aio);
+    } else {
+      w->state = 1;
+      nng_aio_set_msg(w->aio, dc.msg);
+      nng_ctx_send(w->ctx, w->aio);
+    }
+    served++;
+  }
+
+  UNPROTECT(2);
+  return Rf_ScalarInteger(served);
+
+}
+
+SEXP rnng_dispatcher_close(SEXP dispatcher) {
+
+  if (NANO_PTR_CHECK(dispatcher, nano_DispatcherSymbol))
+    Rf_error("`dispatcher` is not a valid Dispatcher");
+
+  dispatcher_free((nano_dispatcher *) NANO_PTR(dispatcher));
+  R_ClearExternalPtr(dispatcher);
+  Rf_setAttrib(dispatcher, nano_StateSymbol, Rf_mkString("closed"));
+
+  return nano_success;
+
+}
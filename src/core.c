@@ -1,11 +1,17 @@
 // nanonext - C level - Core Functions -----------------------------------------
 
+#define NANONEXT_ALTREP
+#define NANONEXT_COMPRESS
+#define NANONEXT_SHM
 #include "nanonext.h"
 
 // internals -------------------------------------------------------------------
 
 static int special_marker = 0;
 static int special_header = 0;
+static int nano_zerocopy = 0;
+static int nano_compress_level = Z_DEFAULT_COMPRESSION;
+static int nano_compress_thr = NANONEXT_COMPRESS_THR;
 static nano_serial_bundle nano_bundle;
 static SEXP nano_eval_res;
 
@@ -13,29 +19,32 @@ static void nano_eval_safe (void *call) {
   nano_eval_res = Rf_eval((SEXP) call, R_GlobalEnv);
 }
 
-static void nano_write_bytes(R_outpstream_t stream, void *src, int len) {
+static int nano_msg_grow(nng_msg *msg, const size_t req) {
 
-  nano_buf *buf = (nano_buf *) stream->data;
+  size_t cap = nng_msg_capacity(msg);
+  if (req <= cap)
+    return 0;
 
-  size_t req = buf->cur + (size_t) len;
-  if (req > buf->len) {
-    if (req > R_XLEN_T_MAX) {
-      if (buf->len) free(buf->buf);
-      Rf_error("serialization exceeds max length of raw vector");
-    }
-    do {
-      buf->len += buf->len > NANONEXT_SERIAL_THR ? NANONEXT_SERIAL_THR : buf->len;
-    } while (buf->len < req);
-    unsigned char *nbuf = realloc(buf->buf, buf->len);
-    if (nbuf == NULL) {
-      free(buf->buf);
-      Rf_error("memory allocation failed");
-    }
-    buf->buf = nbuf;
-  }
+  do {
+    cap += cap > NANONEXT_SERIAL_THR ? NANONEXT_SERIAL_THR : cap;
+  } while (cap < req);
 
-  memcpy(buf->buf + buf->cur, src, len);
-  buf->cur += len;
+  return nng_msg_reserve(msg, cap);
+
+}
+
+static void nano_write_msg(R_outpstream_t stream, void *src, int len) {
+
+  nng_msg *msg = (nng_msg *) stream->data;
+
+  // on error the message is freed by nano_serialize_cleanup()
+  const size_t req = nng_msg_len(msg) + (size_t) len;
+  if (req > R_XLEN_T_MAX)
+    Rf_error("serialization exceeds max length of raw vector");
+  if (nano_msg_grow(msg, req))
+    Rf_error("memory allocation failed");
+
+  nng_msg_append(msg, src, len);
 
 }
 
@@ -56,6 +65,373 @@ static int nano_read_char(R_inpstream_t stream) {
 
 }
 
+// each chunk opens with a 16 byte frame {magic[8], last, 0, 0, 0, uint32 sequence}
+static void nano_write_chunk(R_outpstream_t stream, void *src, int len) {
+
+  nano_chunk *ch = (nano_chunk *) stream->data;
+  unsigned char *p = (unsigned char *) src;
+  size_t n;
+
+  while (len > 0) {
+    if (ch->msg == NULL) {
+      unsigned char frame[NANONEXT_CHUNK_HDR] = {0};
+      memcpy(frame, NANONEXT_CHUNK_MAGIC, 8);
+      memcpy(frame + 12, &ch->seq, sizeof(uint32_t));
+      if ((ch->xc = nng_msg_alloc(&ch->msg, 0)) ||
+          (ch->xc = nng_msg_reserve(ch->msg, ch->size)) ||
+          (ch->xc = nng_msg_append(ch->msg, frame, sizeof(frame))))
+        ERROR_OUT(ch->xc);
+      ch->seq++;
+    }
+    n = ch->size - nng_msg_len(ch->msg);
+    if (!n) {
+      // abandon serialization at the first failure, the receiver resynchronises
+      if ((ch->xc = nano_chunk_send(ch)))
+        ERROR_OUT(ch->xc);
+      continue;
+    }
+    if (n > (size_t) len) n = (size_t) len;
+    nng_msg_append(ch->msg, p, n);
+    p += n;
+    len -= (int) n;
+  }
+
+}
+
+static void nano_read_chunk(R_inpstream_t stream, void *dst, int len) {
+
+  nano_chunk *ch = (nano_chunk *) stream->data;
+  unsigned char *p = (unsigned char *) dst;
+  size_t n;
+  int xc;
+
+  while (len > 0) {
+    n = nng_msg_len(ch->msg) - ch->cur;
+    if (!n) {
+      if (ch->last)
+        Rf_error("chunked object is truncated");
+      if ((xc = nano_chunk_recv(ch)))
+        ERROR_OUT(xc);
+      if (nano_chunk_frame(ch) != 1) {
+        // kept for the next call, as it may open the next object
+        *ch->held = ch->msg;
+        ch->msg = NULL;
+        Rf_error("chunked object was interrupted");
+      }
+      continue;
+    }
+    if (n > (size_t) len) n = (size_t) len;
+    memcpy(p, (unsigned char *) nng_msg_body(ch->msg) + ch->cur, n);
+    ch->cur += n;
+    p += n;
+    len -= (int) n;
+  }
+
+}
+
+static int nano_read_chunk_char(R_inpstream_t stream) {
+
+  unsigned char c;
+  nano_read_chunk(stream, &c, 1);
+  return c;
+
+}
+
+// compression - zlib deflate inline in the serialization stream --------------
+
+typedef struct nano_deflate_s {
+  z_stream zs;
+  nng_msg *msg;
+  nng_msg *prev;
+  R_outpstream_t stream;
+  SEXP object;
+  int active;
+  int done;
+} nano_deflate;
+
+typedef struct nano_inflate_s {
+  z_stream zs;
+  R_inpstream_t stream;
+  size_t left;
+} nano_inflate;
+
+static void nano_deflate_run(nano_deflate *z, const int flush) {
+
+  size_t len, avail;
+  int ret;
+
+  do {
+    len = nng_msg_len(z->msg);
+    if (nng_msg_capacity(z->msg) - len < NANONEXT_INIT_BUFSIZE &&
+        nano_msg_grow(z->msg, len + NANONEXT_INIT_BUFSIZE))
+      Rf_error("memory allocation failed");
+    avail = nng_msg_capacity(z->msg) - len;
+    if (avail > UINT_MAX) avail = UINT_MAX;
+    z->zs.next_out = (unsigned char *) nng_msg_body(z->msg) + len;
+    z->zs.avail_out = (uInt) avail;
+    if ((ret = deflate(&z->zs, flush)) == Z_STREAM_ERROR)
+      Rf_error("compression error");
+    nng_msg_realloc(z->msg, len + avail - z->zs.avail_out);
+  } while (flush == Z_FINISH ? ret != Z_STREAM_END : z->zs.avail_out == 0);
+
+}
+
+// moves to a new message once the threshold is reached, compressing the
+// bytes accumulated so far
+static void nano_deflate_start(nano_deflate *z) {
+
+  nng_msg *msg;
+  const size_t sz = nng_msg_len(z->msg);
+
+  if (nng_msg_alloc(&msg, 0))
+    Rf_error("memory allocation failed");
+  if (nng_msg_reserve(msg, nng_msg_capacity(z->msg)) || nng_msg_append(msg, nng_msg_body(z->msg), 8) ||
+      deflateInit(&z->zs, nano_compress_level) != Z_OK) {
+    nng_msg_free(msg);
+    Rf_error("memory allocation failed");
+  }
+  z->active = 1;
+  ((unsigned char *) nng_msg_body(msg))[1] = 0x1;
+
+  z->prev = z->msg;
+  z->msg = msg;
+  z->zs.next_in = (unsigned char *) nng_msg_body(z->prev) + 8;
+  z->zs.avail_in = (uInt) (sz - 8);
+  nano_deflate_run(z, Z_NO_FLUSH);
+
+  nng_msg_free(z->prev);
+  z->prev = NULL;
+
+}
+
+static void nano_write_deflate(R_outpstream_t stream, void *src, int len) {
+
+  nano_deflate *z = (nano_deflate *) stream->data;
+
+  if (z->active) {
+    z->zs.next_in = (unsigned char *) src;
+    z->zs.avail_in = (uInt) len;
+    nano_deflate_run(z, Z_NO_FLUSH);
+    return;
+  }
+
+  const size_t req = nng_msg_len(z->msg) + (size_t) len;
+  if (nano_msg_grow(z->msg, req))
+    Rf_error("memory allocation failed");
+  nng_msg_append(z->msg, src, len);
+
+  if (req - 8 >= (size_t) nano_compress_thr)
+    nano_deflate_start(z);
+
+}
+
+typedef struct nano_serial_s {
+  nng_msg *msg;
+  R_outpstream_t stream;
+  SEXP object;
+  int done;
+} nano_serial;
+
+static SEXP nano_serialize_exec(void *arg) {
+
+  nano_serial *sr = (nano_serial *) arg;
+  R_Serialize(sr->object, sr->stream);
+  sr->done = 1;
+  return R_NilValue;
+
+}
+
+// frees the message if serialization errors, e.g. from a native sfunc
+static void nano_serialize_cleanup(void *arg) {
+
+  nano_serial *sr = (nano_serial *) arg;
+  if (!sr->done)
+    nng_msg_free(sr->msg);
+
+}
+
+static SEXP nano_deflate_exec(void *arg) {
+
+  nano_deflate *z = (nano_deflate *) arg;
+  R_Serialize(z->object, z->stream);
+  if (z->active)
+    nano_deflate_run(z, Z_FINISH);
+  z->done = 1;
+  return R_NilValue;
+
+}
+
+static void nano_deflate_cleanup(void *arg) {
+
+  nano_deflate *z = (nano_deflate *) arg;
+  if (z->active)
+    deflateEnd(&z->zs);
+  nng_msg_free(z->prev);
+  if (!z->done)
+    nng_msg_free(z->msg);
+
+}
+
+static void nano_read_inflate(R_inpstream_t stream, void *dst, int len) {
+
+  nano_inflate *z = (nano_inflate *) stream->data;
+
+  z->zs.next_out = (unsigned char *) dst;
+  z->zs.avail_out = (uInt) len;
+  while (z->zs.avail_out) {
+    if (!z->zs.avail_in && z->left) {
+      z->zs.avail_in = z->left > UINT_MAX ? UINT_MAX : (uInt) z->left;
+      z->left -= z->zs.avail_in;
+    }
+    if (inflate(&z->zs, Z_NO_FLUSH) != Z_OK && z->zs.avail_out)
+      Rf_error("unserialization error");
+  }
+
+}
+
+static int nano_read_inflate_char(R_inpstream_t stream) {
+
+  unsigned char c;
+  nano_read_inflate(stream, &c, 1);
+  return c;
+
+}
+
+static SEXP nano_inflate_exec(void *arg) {
+
+  return R_Unserialize(((nano_inflate *) arg)->stream);
+
+}
+
+static void nano_inflate_cleanup(void *arg) {
+
+  inflateEnd(&((nano_inflate *) arg)->zs);
+
+}
+
+// zero-copy receive - ALTREP vectors backed by an nng_msg or mapping ----------
+
+typedef struct nano_zc_s {
+  nng_msg *msg;
+  unsigned char *buf;
+  size_t len;
+} nano_zc;
+
+static R_altrep_class_t nano_altraw;
+static R_altrep_class_t nano_altreal;
+static R_altrep_class_t nano_altinteger;
+static R_altrep_class_t nano_altlogical;
+static R_altrep_class_t nano_altcomplex;
+
+static void nano_zc_free(nano_zc *zc) {
+
+  if (zc->msg != NULL) {
+    nng_msg_free(zc->msg);
+  } else {
+#ifndef _WIN32
+    munmap(zc->buf, zc->len);
+#endif
+  }
+  free(zc);
+
+}
+
+static void nano_zc_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_zc_free((nano_zc *) NANO_PTR(xptr));
+
+}
+
+static size_t nano_altrep_eltsize(SEXP x) {
+
+  switch (TYPEOF(x)) {
+  case REALSXP: return sizeof(double);
+  case INTSXP:
+  case LGLSXP: return sizeof(int);
+  case CPLXSXP: return sizeof(Rcomplex);
+  default: return sizeof(Rbyte);
+  }
+
+}
+
+static void *nano_altrep_vecptr(SEXP x) {
+
+  switch (TYPEOF(x)) {
+  case REALSXP: return REAL(x);
+  case INTSXP: return INTEGER(x);
+  case LGLSXP: return LOGICAL(x);
+  case CPLXSXP: return COMPLEX(x);
+  default: return RAW(x);
+  }
+
+}
+
+static R_xlen_t nano_altrep_length(SEXP x) {
+
+  const SEXP data2 = R_altrep_data2(x);
+  if (data2 != R_NilValue)
+    return XLENGTH(data2);
+
+  nano_zc *zc = (nano_zc *) NANO_PTR(R_altrep_data1(x));
+  return (R_xlen_t) (zc->len / nano_altrep_eltsize(x));
+
+}
+
+// materialises a standard vector on first write, releasing the message
+static void *nano_altrep_dataptr(SEXP x, Rboolean writeable) {
+
+  SEXP data2 = R_altrep_data2(x);
+  if (data2 == R_NilValue) {
+    const SEXP xptr = R_altrep_data1(x);
+    nano_zc *zc = (nano_zc *) NANO_PTR(xptr);
+    if (!writeable)
+      return zc->buf;
+    PROTECT(data2 = Rf_allocVector(TYPEOF(x), (R_xlen_t) (zc->len / nano_altrep_eltsize(x))));
+    memcpy(nano_altrep_vecptr(data2), zc->buf, zc->len);
+    R_set_altrep_data2(x, data2);
+    R_ClearExternalPtr(xptr);
+    nano_zc_free(zc);
+    UNPROTECT(1);
+  }
+
+  return nano_altrep_vecptr(data2);
+
+}
+
+static const void *nano_altrep_dataptr_or_null(SEXP x) {
+
+  const SEXP data2 = R_altrep_data2(x);
+  if (data2 != R_NilValue)
+    return DATAPTR_RO(data2);
+
+  return ((nano_zc *) NANO_PTR(R_altrep_data1(x)))->buf;
+
+}
+
+static void nano_altrep_methods(R_altrep_class_t cls) {
+
+  R_set_altrep_Length_method(cls, nano_altrep_length);
+  R_set_altvec_Dataptr_method(cls, nano_altrep_dataptr);
+  R_set_altvec_Dataptr_or_null_method(cls, nano_altrep_dataptr_or_null);
+
+}
+
+void nano_altrep_init(DllInfo *dll) {
+
+  nano_altraw = R_make_altraw_class("nano_raw", "nanonext", dll);
+  nano_altreal = R_make_altreal_class("nano_real", "nanonext", dll);
+  nano_altinteger = R_make_altinteger_class("nano_integer", "nanonext", dll);
+  nano_altlogical = R_make_altlogical_class("nano_logical", "nanonext", dll);
+  nano_altcomplex = R_make_altcomplex_class("nano_complex", "nanonext", dll);
+  nano_altrep_methods(nano_altraw);
+  nano_altrep_methods(nano_altreal);
+  nano_altrep_methods(nano_altinteger);
+  nano_altrep_methods(nano_altlogical);
+  nano_altrep_methods(nano_altcomplex);
+
+}
+
 // Serialization Hooks - this section only subject to copyright notice: --------
 
 /*
@@ -83,33 +459,94 @@ static int nano_read_char(R_inpstream_t stream) {
  *
  */
 
+// native C-callables read and write the stream through these, bounded by the
+// size declared in the header so that the stream cannot be corrupted
+
+typedef struct nano_hook_io_s {
+  R_outpstream_t stream;
+  const unsigned char *src;
+  R_xlen_t left;
+} nano_hook_io;
+
+static void nano_hook_write(void *arg, const void *buf, R_xlen_t len) {
+
+  nano_hook_io *io = (nano_hook_io *) arg;
+  if (len < 0 || len > io->left)
+    Rf_error("serialization function wrote more than its declared size");
+  io->left -= len;
+
+  void (*OutBytes)(R_outpstream_t, void *, int) = io->stream->OutBytes;
+  unsigned char *src = (unsigned char *) buf;
+  while (len > NANONEXT_CHUNK_SIZE) {
+    OutBytes(io->stream, src, NANONEXT_CHUNK_SIZE);
+    src += NANONEXT_CHUNK_SIZE;
+    len -= NANONEXT_CHUNK_SIZE;
+  }
+  OutBytes(io->stream, src, (int) len);
+
+}
+
+static void nano_hook_read(void *arg, void *buf, R_xlen_t len) {
+
+  nano_hook_io *io = (nano_hook_io *) arg;
+  if (len < 0 || len > io->left)
+    Rf_error("unserialization function read more than the serialized size");
+  memcpy(buf, io->src, len);
+  io->src += len;
+  io->left -= len;
+
+}
+
+static nano_serial_tab *nano_hook_tab(SEXP hook) {
+
+  if (XLENGTH(hook) < 4) return NULL;
+  SEXP xptr = NANO_VECTOR(hook)[3];
+  return TYPEOF(xptr) == EXTPTRSXP ? (nano_serial_tab *) NANO_PTR(xptr) : NULL;
+
+}
+
 static SEXP nano_serialize_hook(SEXP x, SEXP bundle_xptr) {
 
   R_outpstream_t stream = nano_bundle.outpstream;
   SEXP klass = nano_bundle.klass;
   SEXP hook_func = nano_bundle.hook_func;
-  int len = (int) XLENGTH(klass), match = 0, i;
+  nano_serial_tab *tab = nano_bundle.tab;
+  int len = (int) XLENGTH(klass), i = -1;
   void (*OutBytes)(R_outpstream_t, void *, int) = stream->OutBytes;
 
-  for (i = 0; i < len; i++) {
-    if (Rf_inherits(x, NANO_STR_N(klass, i))) {
-      match = 1;
-      break;
+  if (tab != NULL && !Rf_isS4(x)) {
+    i = nano_serial_match(tab, klass, x);
+  } else {
+    for (int j = 0; j < len; j++) {
+      if (Rf_inherits(x, NANO_STR_N(klass, j))) {
+        i = j;
+        break;
+      }
     }
   }
 
-  if (!match)
+  if (i < 0)
     return R_NilValue;
 
-  SEXP call;
-  PROTECT(call = Rf_lcons(NANO_VECTOR(hook_func)[i], Rf_cons(x, R_NilValue)));
-  if (!R_ToplevelExec(nano_eval_safe, call) || TYPEOF(nano_eval_res) != RAWSXP) {
+  nano_serial_fn sfn = tab != NULL ? tab->sfn[i] : NULL;
+  uint64_t size;
+
+  if (sfn != NULL) {
+    const R_xlen_t sz = sfn(x, NULL, NULL);
+    if (sz < 0)
+      return R_NilValue;
+    size = (uint64_t) sz;
+  } else {
+    SEXP call;
+    PROTECT(call = Rf_lcons(NANO_VECTOR(hook_func)[i], Rf_cons(x, R_NilValue)));
+    if (!R_ToplevelExec(nano_eval_safe, call) || TYPEOF(nano_eval_res) != RAWSXP) {
+      UNPROTECT(1);
+      return R_NilValue;
+    }
     UNPROTECT(1);
-    return R_NilValue;
+    size = XLENGTH(nano_eval_res);
   }
-  UNPROTECT(1);
 
-  uint64_t size = XLENGTH(nano_eval_res);
   char size_string[21];
   snprintf(size_string, sizeof(size_string), "%020" PRIu64, size);
 
@@ -126,28 +563,89 @@ static SEXP nano_serialize_hook(SEXP x, SEXP bundle_xptr) {
   OutBytes(stream, &int_20, sizeof(int));         // 20
   OutBytes(stream, &size_string[0], 20);          // 40
 
-  unsigned char *src = (unsigned char *) DATAPTR_RO(nano_eval_res);
-  while (size > NANONEXT_CHUNK_SIZE) {
-    OutBytes(stream, src, NANONEXT_CHUNK_SIZE);
-    src += NANONEXT_CHUNK_SIZE;
-    size -= NANONEXT_CHUNK_SIZE;
+  if (sfn != NULL) {
+    // written directly into the stream, without an intermediate raw vector
+    nano_hook_io io = {.stream = stream, .left = (R_xlen_t) size};
+    if (sfn(x, nano_hook_write, &io) != (R_xlen_t) size || io.left)
+      Rf_error("serialization function wrote less than its declared size");
+  } else {
+    unsigned char *src = (unsigned char *) DATAPTR_RO(nano_eval_res);
+    while (size > NANONEXT_CHUNK_SIZE) {
+      OutBytes(stream, src, NANONEXT_CHUNK_SIZE);
+      src += NANONEXT_CHUNK_SIZE;
+      size -= NANONEXT_CHUNK_SIZE;
+    }
+    OutBytes(stream, src, (int) size);
   }
-  OutBytes(stream, src, (int) size);
   OutBytes(stream, &i, sizeof(int));              // 4
 
   return R_BlankScalarString;
 
 }
 
+// the index follows the data, so with native unserializers configured the data
+// is located first - in place where the stream is an in-memory buffer
+static SEXP nano_unserialize_native(R_inpstream_t stream, nano_serial_tab *tab, SEXP hook_func, uint64_t size) {
+
+  void (*InBytes)(R_inpstream_t, void *, int) = stream->InBytes;
+  const unsigned char *src;
+
+  if (InBytes == nano_read_bytes) {
+    nano_buf *nbuf = (nano_buf *) stream->data;
+    if (size > nbuf->len - nbuf->cur)
+      Rf_error("unserialization error");
+    src = nbuf->buf + nbuf->cur;
+    nbuf->cur += size;
+  } else {
+    unsigned char *dest = (unsigned char *) R_alloc(size ? size : 1, 1);
+    src = dest;
+    uint64_t left = size;
+    while (left > NANONEXT_CHUNK_SIZE) {
+      InBytes(stream, dest, NANONEXT_CHUNK_SIZE);
+      dest += NANONEXT_CHUNK_SIZE;
+      left -= NANONEXT_CHUNK_SIZE;
+    }
+    InBytes(stream, dest, (int) left);
+  }
+
+  int i;
+  InBytes(stream, &i, 4);
+
+  char buf[20];
+  InBytes(stream, buf, 20);
+
+  if (i < 0 || i >= tab->n)
+    Rf_error("unserialization error");
+
+  if (tab->ufn[i] != NULL) {
+    nano_hook_io io = {.src = src, .left = (R_xlen_t) size};
+    return tab->ufn[i]((R_xlen_t) size, nano_hook_read, &io);
+  }
+
+  SEXP raw, call, out;
+  PROTECT(raw = Rf_allocVector(RAWSXP, size));
+  if (size) memcpy(RAW(raw), src, size);
+  PROTECT(call = Rf_lcons(NANO_VECTOR(hook_func)[i], Rf_cons(raw, R_NilValue)));
+  out = Rf_eval(call, R_GlobalEnv);
+
+  UNPROTECT(2);
+  return out;
+
+}
+
 static SEXP nano_unserialize_hook(SEXP x, SEXP bundle_xptr) {
 
   R_inpstream_t stream = nano_bundle.inpstream;
   SEXP hook_func = nano_bundle.hook_func;
+  nano_serial_tab *tab = nano_bundle.tab;
   void (*InBytes)(R_inpstream_t, void *, int) = stream->InBytes;
 
   const char *size_string = NANO_STRING(x);
   uint64_t size = strtoul(size_string, NULL, 10);
 
+  if (tab != NULL && tab->native)
+    return nano_unserialize_native(stream, tab, hook_func, size);
+
   SEXP raw, call, out;
   PROTECT(raw = Rf_allocVector(RAWSXP, size));
   unsigned char *dest = (unsigned char *) DATAPTR_RO(raw);
@@ -197,6 +695,10 @@ void socket_finalizer(SEXP xptr) {
   if (NANO_PTR(xptr) == NULL) return;
   nng_socket *xp = (nng_socket *) NANO_PTR(xptr);
   nng_close(*xp);
+  nano_socket_release(nng_socket_id(*xp));
+  nano_shm_accept(&((nano_sock *) xp)->shmrx, 0);
+  if (((nano_sock *) xp)->chunk != NULL)
+    nng_msg_free(((nano_sock *) xp)->chunk);
   free(xp);
 
 }
@@ -270,10 +772,134 @@ void raio_invoke_cb(void *arg) {
 
 }
 
+void haio_invoke_cb(void *arg) {
+
+  SEXP call, status, node = (SEXP) arg, x = TAG(node);
+  status = rnng_aio_http_status(x);
+  PROTECT(call = Rf_lcons(nano_ResolveSymbol, Rf_cons(status, R_NilValue)));
+  Rf_eval(call, NANO_ENCLOS(x));
+  UNPROTECT(1);
+  nano_ReleaseObject(node);
+
+}
+
+// coalesced later callbacks - completions push their aio onto a lock-free
+// stack, and only the push finding no batch scheduled posts a later callback,
+// which resolves up to nano_later_max promises in completion order
+
+static atomic_int nano_later_max = 0;
+static atomic_int nano_later_scheduled = 0;
+static _Atomic(nano_aio *) nano_later_head = NULL;
+static nano_aio *nano_later_ready = NULL;
+static nano_aio *nano_later_tail = NULL;
+static int nano_later_count = 0;
+
+static void nano_later_run(void *);
+
+static inline void nano_later_schedule(void) {
+
+  if (!atomic_exchange(&nano_later_scheduled, 1))
+    later2(nano_later_run, NULL);
+
+}
+
+static SEXP nano_later_invoke(void *arg) {
+
+  const int n = *(int *) arg;
+  nano_aio *aio;
+
+  for (int i = 0; i < n; i++) {
+    aio = nano_later_ready;
+    nano_later_ready = aio->link;
+    if (nano_later_ready == NULL)
+      nano_later_tail = NULL;
+    nano_later_count--;
+    aio->link = NULL;
+    switch (aio->type) {
+    case HTTP_AIO:
+      haio_invoke_cb(aio->cb);
+      break;
+    case REQAIO:
+    case REQAIOS:
+      raio_invoke_cb(((nano_saio *) aio->cb)->cb);
+      break;
+    default:
+      raio_invoke_cb(aio->cb);
+    }
+  }
+
+  return R_NilValue;
+
+}
+
+// also runs if a callback raises an error, so items left behind are not
+// stranded until an unrelated completion schedules a batch
+static void nano_later_cleanup(void *arg) {
+
+  if (nano_later_count)
+    nano_later_schedule();
+
+}
+
+static void nano_later_run(void *arg) {
+
+  atomic_store(&nano_later_scheduled, 0);
+
+  nano_aio *aio = atomic_exchange(&nano_later_head, NULL);
+  if (aio != NULL) {
+    nano_aio *last = aio, *rev = NULL, *next;
+    while (aio != NULL) {
+      next = aio->link;
+      aio->link = rev;
+      rev = aio;
+      aio = next;
+      nano_later_count++;
+    }
+    if (nano_later_tail != NULL) {
+      nano_later_tail->link = rev;
+    } else {
+      nano_later_ready = rev;
+    }
+    nano_later_tail = last;
+  }
+
+  const int max = atomic_load(&nano_later_max);
+  int n = max > 0 && max < nano_later_count ? max : nano_later_count;
+
+  R_ExecWithCleanup(nano_later_invoke, &n, nano_later_cleanup, NULL);
+
+}
+
+void nano_later(nano_aio *aio, void (*fun)(void *), void *data) {
+
+  if (atomic_load_explicit(&nano_later_max, memory_order_relaxed) == 0) {
+    later2(fun, data);
+    return;
+  }
+
+  nano_aio *head = atomic_load_explicit(&nano_later_head, memory_order_relaxed);
+  do {
+    aio->link = head;
+  } while (!atomic_compare_exchange_weak_explicit(&nano_later_head, &head, aio, memory_order_release, memory_order_relaxed));
+
+  nano_later_schedule();
+
+}
+
 inline int nano_integer(const SEXP x) {
   return (TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) ? NANO_INTEGER(x) : Rf_asInteger(x);
 }
 
+size_t nano_size_hint(const SEXP x) {
+
+  if (x == R_NilValue)
+    return 0;
+
+  const double hint = Rf_asReal(x);
+  return hint > 0 ? (size_t) hint : 0;
+
+}
+
 SEXP mk_error(const int xc) {
 
   SEXP err = Rf_ScalarInteger(xc);
@@ -316,46 +942,120 @@ SEXP nano_raw_char(const unsigned char *buf, const size_t sz) {
 
 }
 
-void nano_serialize(nano_buf *buf, SEXP object, SEXP hook) {
+// the header opening serialized data, if compressed or if a special marker or
+// header is set, returns whether required
+static int nano_serial_header(unsigned char *header, const int compress) {
 
-  NANO_ALLOC(buf, NANONEXT_INIT_BUFSIZE);
-  struct R_outpstream_st output_stream;
+  if (!compress && !special_header && !special_marker)
+    return 0;
 
-  if (special_header || special_marker) {
-    buf->buf[0] = 0x7;
-    buf->buf[3] = (uint8_t) special_marker;
-    if (special_header)
-      memcpy(buf->buf + 4, &special_header, sizeof(int));
-    buf->cur += 8;
-  }
+  memset(header, 0, 8);
+  header[0] = 0x7;
+  header[3] = (uint8_t) special_marker;
+  if (special_header)
+    memcpy(header + 4, &special_header, sizeof(int));
+  return 1;
+
+}
+
+static void nano_serial_bind(SEXP hook, R_outpstream_t stream) {
 
   if (hook != R_NilValue) {
     nano_bundle.klass = NANO_VECTOR(hook)[0];
     nano_bundle.hook_func = NANO_VECTOR(hook)[1];
-    nano_bundle.outpstream = &output_stream;
+    nano_bundle.tab = nano_hook_tab(hook);
+    nano_bundle.outpstream = stream;
   }
 
-  R_InitOutPStream(
-    &output_stream,
-    (R_pstream_data_t) buf,
-    R_pstream_binary_format,
-    NANONEXT_SERIAL_VER,
-    NULL,
-    nano_write_bytes,
-    hook != R_NilValue ? nano_serialize_hook : NULL,
-    R_NilValue
-  );
+}
 
-  R_Serialize(object, &output_stream);
+// rises at once, halves towards smaller sizes, resets on a sharp drop
+static void nano_serial_estimate(size_t *est, const size_t sz) {
+
+  if (est != NULL)
+    *est = sz >= *est || sz < *est / 4 ? sz : (*est + sz) / 2;
 
 }
 
-SEXP nano_unserialize(unsigned char *buf, size_t sz, SEXP hook) {
+// hint: if non-zero, bytes to reserve, otherwise uses and updates estimate est
+int nano_serialize_msg(nng_msg **msgp, SEXP object, SEXP hook, size_t hint, size_t *est, const int compress) {
 
-  int match = 0;
-  size_t cur;
+  nng_msg *msg;
+  struct R_outpstream_st output_stream;
+  int xc;
 
-  if (sz > 12) {
+  if (!hint && est != NULL)
+    hint = *est;
+
+  if ((xc = nng_msg_alloc(&msg, 0)))
+    return xc;
+
+  if ((xc = nng_msg_reserve(msg, hint > NANONEXT_INIT_BUFSIZE ? hint : NANONEXT_INIT_BUFSIZE)))
+    goto fail;
+
+  unsigned char header[8];
+  if (nano_serial_header(header, compress) && (xc = nng_msg_append(msg, header, sizeof(header))))
+    goto fail;
+
+  nano_serial_bind(hook, &output_stream);
+
+  if (compress) {
+
+    nano_deflate z = {.msg = msg, .stream = &output_stream, .object = object};
+
+    R_InitOutPStream(
+      &output_stream,
+      (R_pstream_data_t) &z,
+      R_pstream_binary_format,
+      NANONEXT_SERIAL_VER,
+      NULL,
+      nano_write_deflate,
+      hook != R_NilValue ? nano_serialize_hook : NULL,
+      R_NilValue
+    );
+
+    R_ExecWithCleanup(nano_deflate_exec, &z, nano_deflate_cleanup, &z);
+
+    // below threshold: header only retained if otherwise required
+    msg = z.msg;
+    if (!z.active && !special_header && !special_marker)
+      nng_msg_trim(msg, 8);
+
+  } else {
+
+    R_InitOutPStream(
+      &output_stream,
+      (R_pstream_data_t) msg,
+      R_pstream_binary_format,
+      NANONEXT_SERIAL_VER,
+      NULL,
+      nano_write_msg,
+      hook != R_NilValue ? nano_serialize_hook : NULL,
+      R_NilValue
+    );
+
+    nano_serial sr = {.msg = msg, .stream = &output_stream, .object = object};
+    R_ExecWithCleanup(nano_serialize_exec, &sr, nano_serialize_cleanup, &sr);
+
+  }
+
+  nano_serial_estimate(est, nng_msg_len(msg));
+
+  *msgp = msg;
+  return 0;
+
+  fail:
+  nng_msg_free(msg);
+  return xc;
+
+}
+
+SEXP nano_unserialize(unsigned char *buf, size_t sz, SEXP hook) {
+
+  int match = 0;
+  size_t cur;
+
+  if (sz > 12) {
     switch (buf[0]) {
     case 0x41:
     case 0x42:
@@ -375,15 +1075,37 @@ SEXP nano_unserialize(unsigned char *buf, size_t sz, SEXP hook) {
     return nano_decode(buf, sz, 8, R_NilValue);
   }
 
-  nano_buf nbuf = {.buf = buf, .len = sz, .cur = cur};
-
   struct R_inpstream_st input_stream;
 
   if (hook != R_NilValue) {
     nano_bundle.hook_func = NANO_VECTOR(hook)[2];
+    nano_bundle.tab = nano_hook_tab(hook);
     nano_bundle.inpstream = &input_stream;
   }
 
+  if (cur && buf[1] & 0x1) {
+
+    nano_inflate z = {.stream = &input_stream, .left = sz - cur};
+    z.zs.next_in = buf + cur;
+    if (inflateInit(&z.zs) != Z_OK)
+      Rf_error("memory allocation failed");
+
+    R_InitInPStream(
+      &input_stream,
+      (R_pstream_data_t) &z,
+      R_pstream_any_format,
+      nano_read_inflate_char,
+      nano_read_inflate,
+      hook != R_NilValue ? nano_unserialize_hook : NULL,
+      R_NilValue
+    );
+
+    return R_ExecWithCleanup(nano_inflate_exec, &z, nano_inflate_cleanup, &z);
+
+  }
+
+  nano_buf nbuf = {.buf = buf, .len = sz, .cur = cur};
+
   R_InitInPStream(
     &input_stream,
     (R_pstream_data_t) &nbuf,
@@ -398,6 +1120,170 @@ SEXP nano_unserialize(unsigned char *buf, size_t sz, SEXP hook) {
 
 }
 
+// chunked serialization - called through R_ExecWithCleanup with a nano_chunk
+
+SEXP nano_serialize_chunked(void *arg) {
+
+  nano_chunk *ch = (nano_chunk *) arg;
+  struct R_outpstream_st output_stream;
+
+  if (ch->hook != R_NilValue) {
+    nano_bundle.klass = NANO_VECTOR(ch->hook)[0];
+    nano_bundle.hook_func = NANO_VECTOR(ch->hook)[1];
+    nano_bundle.tab = nano_hook_tab(ch->hook);
+    nano_bundle.outpstream = &output_stream;
+  }
+
+  R_InitOutPStream(
+    &output_stream,
+    (R_pstream_data_t) ch,
+    R_pstream_binary_format,
+    NANONEXT_SERIAL_VER,
+    NULL,
+    nano_write_chunk,
+    ch->hook != R_NilValue ? nano_serialize_hook : NULL,
+    R_NilValue
+  );
+
+  if (special_header || special_marker) {
+    unsigned char header[8] = {0x7, 0, 0, (uint8_t) special_marker, 0, 0, 0, 0};
+    if (special_header)
+      memcpy(header + 4, &special_header, sizeof(int));
+    nano_write_chunk(&output_stream, header, sizeof(header));
+  }
+
+  R_Serialize(ch->data, &output_stream);
+
+  // mark and send the final partial chunk, then wait for it to complete
+  ((unsigned char *) nng_msg_body(ch->msg))[8] = 1;
+  if (!(ch->xc = nano_chunk_send(ch)))
+    ch->xc = nano_chunk_send(ch);
+
+  return R_NilValue;
+
+}
+
+SEXP nano_unserialize_chunked(void *arg) {
+
+  nano_chunk *ch = (nano_chunk *) arg;
+  const size_t off = ch->cur;
+  unsigned char *buf = (unsigned char *) nng_msg_body(ch->msg) + off;
+  const size_t sz = nng_msg_len(ch->msg) - off;
+  int match = 0;
+
+  if (sz > 12) {
+    switch (buf[0]) {
+    case 0x41:
+    case 0x42:
+    case 0x58:
+      match = 1;
+      break;
+    case 0x7:
+      ch->cur += 8;
+      match = 1;
+      break;
+    }
+  }
+
+  if (!match) {
+    Rf_warningcall_immediate(R_NilValue, "received data could not be unserialized");
+    return nano_decode(buf, sz, 8, R_NilValue);
+  }
+
+  struct R_inpstream_st input_stream;
+
+  if (ch->hook != R_NilValue) {
+    nano_bundle.hook_func = NANO_VECTOR(ch->hook)[2];
+    nano_bundle.tab = nano_hook_tab(ch->hook);
+    nano_bundle.inpstream = &input_stream;
+  }
+
+  R_InitInPStream(
+    &input_stream,
+    (R_pstream_data_t) ch,
+    R_pstream_any_format,
+    nano_read_chunk_char,
+    nano_read_chunk,
+    ch->hook != R_NilValue ? nano_unserialize_hook : NULL,
+    R_NilValue
+  );
+
+  return R_Unserialize(&input_stream);
+
+}
+
+// strings are delimited by NUL, trailing empty strings being dropped - counted
+// first so that the vector is allocated exactly, with memchr() for each scan
+static SEXP nano_decode_strings(unsigned char *buf, size_t sz) {
+
+  while (sz && buf[sz - 1] == '\0') sz--;
+
+  R_xlen_t n = 1;
+  const unsigned char *p = buf, *end = buf + sz, *q;
+  while (p < end && (q = memchr(p, '\0', end - p)) != NULL) {
+    n++;
+    p = q + 1;
+  }
+
+  SEXP data;
+  PROTECT(data = Rf_allocVector(STRSXP, n));
+  p = buf;
+  for (R_xlen_t i = 0; i < n; i++) {
+    q = i < n - 1 ? memchr(p, '\0', end - p) : end;
+    SET_STRING_ELT(data, i, Rf_mkCharLenCE((const char *) p, (int) (q - p), CE_NATIVE));
+    p = q + 1;
+  }
+
+  UNPROTECT(1);
+  return data;
+
+}
+
+// each string is preceded by its length as a uint32, UINT32_MAX for NA
+static SEXP nano_decode_prefixed(unsigned char *buf, const size_t sz) {
+
+  R_xlen_t n = 0;
+  size_t cur = 0;
+  uint32_t len;
+  while (sz - cur >= sizeof(uint32_t)) {
+    memcpy(&len, buf + cur, sizeof(uint32_t));
+    cur += sizeof(uint32_t);
+    if (len == UINT32_MAX) {
+      n++;
+      continue;
+    }
+    if (len > sz - cur || len > INT_MAX)
+      break;
+    cur += len;
+    n++;
+  }
+
+  if (cur != sz) {
+    Rf_warningcall_immediate(R_NilValue, "received data could not be converted to character");
+    SEXP data = Rf_allocVector(RAWSXP, sz);
+    if (sz) memcpy(RAW(data), buf, sz);
+    return data;
+  }
+
+  SEXP data;
+  PROTECT(data = Rf_allocVector(STRSXP, n));
+  cur = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    memcpy(&len, buf + cur, sizeof(uint32_t));
+    cur += sizeof(uint32_t);
+    if (len == UINT32_MAX) {
+      SET_STRING_ELT(data, i, NA_STRING);
+      continue;
+    }
+    SET_STRING_ELT(data, i, Rf_mkCharLenCE((const char *) (buf + cur), (int) len, CE_NATIVE));
+    cur += len;
+  }
+
+  UNPROTECT(1);
+  return data;
+
+}
+
 SEXP nano_decode(unsigned char *buf, const size_t sz, const uint8_t mod, SEXP hook) {
 
   SEXP data;
@@ -405,27 +1291,7 @@ SEXP nano_decode(unsigned char *buf, const size_t sz, const uint8_t mod, SEXP ho
 
   switch (mod) {
   case 2:
-    size = sz / 2 + 1;
-    PROTECT(data = Rf_allocVector(STRSXP, size));
-    R_xlen_t i, m, nbytes = sz, np = 0;
-    for (i = 0, m = 0; i < size; i++) {
-      unsigned char *p;
-      R_xlen_t j;
-      SEXP res;
-
-      for (j = np, p = buf + np; j < nbytes; p++, j++)
-        if (*p == '\0') break;
-
-      res = Rf_mkCharLenCE((const char *) (buf + np), (int) (j - np), CE_NATIVE);
-      if (res == R_NilValue) break;
-      SET_STRING_ELT(data, i, res);
-      if (XLENGTH(res) > 0) m = i;
-      np = j < nbytes ? j + 1 : nbytes;
-    }
-    if (i)
-      data = Rf_xlengthgets(data, m + 1);
-    UNPROTECT(1);
-    return data;
+    return nano_decode_strings(buf, sz);
   case 3:
     size = 2 * sizeof(double);
     if (sz % size) {
@@ -476,6 +1342,8 @@ SEXP nano_decode(unsigned char *buf, const size_t sz, const uint8_t mod, SEXP ho
     break;
   case 9:
     return nano_raw_char(buf, sz);
+  case 10:
+    return nano_decode_prefixed(buf, sz);
   default:
     return nano_unserialize(buf, sz, hook);
   }
@@ -487,28 +1355,618 @@ SEXP nano_decode(unsigned char *buf, const size_t sz, const uint8_t mod, SEXP ho
 
 }
 
+static int nano_zc_class(const uint8_t mod, R_altrep_class_t *cls, size_t *size) {
+
+  switch (mod) {
+  case 3:
+    *cls = nano_altcomplex;
+    *size = 2 * sizeof(double);
+    return 1;
+  case 4:
+  case 7:
+    *cls = nano_altreal;
+    *size = sizeof(double);
+    return 1;
+  case 5:
+    *cls = nano_altinteger;
+    *size = sizeof(int);
+    return 1;
+  case 6:
+    *cls = nano_altlogical;
+    *size = sizeof(int);
+    return 1;
+  case 8:
+    *cls = nano_altraw;
+    *size = 1;
+    return 1;
+  default:
+    return 0;
+  }
+
+}
+
+static SEXP nano_zc_vector(nano_zc *zc, R_altrep_class_t cls) {
+
+  SEXP xptr, out;
+  PROTECT(xptr = R_MakeExternalPtr(zc, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(xptr, nano_zc_finalizer, TRUE);
+  out = R_new_altrep(cls, xptr, R_NilValue);
+  UNPROTECT(1);
+  return out;
+
+}
+
+// shared memory - large message bodies passed by descriptor -------------------
+
+// bodies at or above a Socket or Context threshold are written to a POSIX
+// shared memory object and only a descriptor is sent, flagged in the nanonext
+// header. A receiver maps the object in place and unlinks it as soon as it is
+// opened, but only if the message arrived over inproc, or over ipc from a peer
+// running as the same user, and the object is named for the pid of that peer.
+// This is recorded in the descriptor as each receive completes, as the pipe may
+// since have closed by the time the message is decoded or dropped.
+//
+// A process announces that it accepts descriptors by holding an empty object
+// named for its pid while any Socket or Context in it has opted in. A sender
+// uses shared memory only while each pipe of its socket leads to such a peer.
+// Any Socket or Context receiving a valid descriptor decodes it, whether or not
+// it has itself opted in, so that the message is never lost
+
+#define NANONEXT_SHM_FLAG 0x2
+
+#ifdef _WIN32
+
+static int nano_shm_ok(const int sid, const size_t len, const size_t shm) {
+
+  (void) sid;
+  (void) len;
+  (void) shm;
+  return 0;
+
+}
+
+static int nano_shm_put(nng_msg **msgp, const size_t len, void (*fill)(unsigned char *, const void *), const void *arg) {
+
+  (void) msgp;
+  (void) len;
+  (void) fill;
+  (void) arg;
+  return 1;
+
+}
+
+static int nano_shm_serialize(nng_msg **msgp, SEXP object, SEXP hook, size_t cap, size_t *est) {
+
+  (void) msgp;
+  (void) object;
+  (void) hook;
+  (void) cap;
+  (void) est;
+  return 1;
+
+}
+
+void nano_shm_accept(int *shmrx, const int on) {
+
+  *shmrx = on;
+
+}
+
+void nano_shm_free(void) {}
+
+void nano_msg_free(nng_msg *msg) {
+
+  nng_msg_free(msg);
+
+}
+
+void nano_msg_drop(nng_msg *msg) {
+
+  nng_msg_free(msg);
+
+}
+
+void nano_shm_mark(nng_msg *msg) {
+
+  (void) msg;
+
+}
+
+#else
+
+typedef struct nano_shm_desc_s {
+  unsigned char header[8];
+  uint64_t size;
+  char name[32];
+} nano_shm_desc;
+
+typedef struct nano_shm_map_s {
+  unsigned char *buf;
+  size_t len;
+  SEXP hook;
+  uint8_t mod;
+} nano_shm_map;
+
+typedef struct nano_shm_out_s {
+  nano_shm_desc desc;
+  unsigned char *buf;
+  size_t len;
+  size_t cap;
+  int fd;
+  int fail;
+  int done;
+  R_outpstream_t stream;
+  SEXP object;
+} nano_shm_out;
+
+static const unsigned char nano_shm_magic[4] = {'n', 's', 'h', 'm'};
+static atomic_uint nano_shm_seq;
+static atomic_int nano_shm_rx;
+
+void nano_shm_accept(int *shmrx, const int on) {
+
+  if (*shmrx == on)
+    return;
+  *shmrx = on;
+
+  char name[32];
+  snprintf(name, sizeof(name), "/nano-rx-%d", (int) getpid());
+  if (on) {
+    if (atomic_fetch_add(&nano_shm_rx, 1) == 0) {
+      const int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+      if (fd >= 0)
+        close(fd);
+    }
+  } else if (atomic_fetch_sub(&nano_shm_rx, 1) == 1) {
+    shm_unlink(name);
+  }
+
+}
+
+void nano_shm_free(void) {
+
+  char name[32];
+  if (atomic_exchange(&nano_shm_rx, 0) > 0) {
+    snprintf(name, sizeof(name), "/nano-rx-%d", (int) getpid());
+    shm_unlink(name);
+  }
+
+}
+
+// a peer accepts descriptors if it is in this process, or over ipc is a process
+// of the same user holding the object announcing it
+static int nano_shm_peer(nng_pipe p) {
+
+  nng_sockaddr sa;
+  uint64_t uid, pid;
+  char name[32];
+  int fd;
+
+  if (nng_pipe_get_addr(p, NNG_OPT_REMADDR, &sa))
+    return 0;
+
+  switch (sa.s_family) {
+  case NNG_AF_INPROC:
+    return atomic_load(&nano_shm_rx) > 0;
+  case NNG_AF_IPC:
+  case NNG_AF_ABSTRACT:
+    if (nng_pipe_get_uint64(p, NNG_OPT_IPC_PEER_UID, &uid) || uid != (uint64_t) geteuid() ||
+        nng_pipe_get_uint64(p, NNG_OPT_IPC_PEER_PID, &pid))
+      return 0;
+    if (pid == (uint64_t) getpid())
+      return atomic_load(&nano_shm_rx) > 0;
+    snprintf(name, sizeof(name), "/nano-rx-%d", (int) pid);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+      return 0;
+    close(fd);
+    return 1;
+  default:
+    return 0;
+  }
+
+}
+
+static int nano_shm_ok(const int sid, const size_t len, const size_t shm) {
+
+  return shm && len >= shm && nano_route_all(sid, nano_shm_peer);
+
+}
+
+// space is allocated up front where possible, so that a full device fails here
+// rather than raising SIGBUS on writing to the mapping. The mapping is shared,
+// so a larger one replaces it without copying
+static int nano_shm_reserve(nano_shm_out *o, const size_t cap) {
+
+  void *map;
+
+#ifdef __linux__
+  if (posix_fallocate(o->fd, 0, (off_t) cap))
+    return 1;
+#else
+  if (ftruncate(o->fd, (off_t) cap))
+    return 1;
+#endif
+
+  map = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, o->fd, 0);
+  if (map == MAP_FAILED)
+    return 1;
+  if (o->buf != NULL)
+    munmap(o->buf, o->cap);
+  o->buf = (unsigned char *) map;
+  o->cap = cap;
+  return 0;
+
+}
+
+static void nano_shm_discard(nano_shm_out *o) {
+
+  if (o->buf != NULL)
+    munmap(o->buf, o->cap);
+  close(o->fd);
+  shm_unlink(o->desc.name);
+
+}
+
+static int nano_shm_create(nano_shm_out *o, const size_t cap) {
+
+  memset(o, 0, sizeof(nano_shm_out));
+  o->desc.header[0] = 0x7;
+  o->desc.header[1] = NANONEXT_SHM_FLAG;
+  memcpy(o->desc.header + 4, nano_shm_magic, sizeof(nano_shm_magic));
+  o->fd = -1;
+
+  for (int i = 0; i < 8 && o->fd < 0; i++) {
+    snprintf(o->desc.name, sizeof(o->desc.name), "/nano-%d-%u", (int) getpid(), atomic_fetch_add(&nano_shm_seq, 1));
+    if ((o->fd = shm_open(o->desc.name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0 && errno != EEXIST)
+      return 1;
+  }
+  if (o->fd < 0)
+    return 1;
+
+  if (nano_shm_reserve(o, cap)) {
+    nano_shm_discard(o);
+    return 1;
+  }
+  return 0;
+
+}
+
+// trims the object to the bytes written and sets *msgp to its descriptor
+static int nano_shm_finish(nano_shm_out *o, nng_msg **msgp) {
+
+  nng_msg *msg;
+
+  if ((o->len < o->cap && ftruncate(o->fd, (off_t) o->len)) ||
+      nng_msg_alloc(&msg, sizeof(nano_shm_desc))) {
+    nano_shm_discard(o);
+    return 1;
+  }
+  munmap(o->buf, o->cap);
+  close(o->fd);
+
+  o->desc.size = (uint64_t) o->len;
+  memcpy(nng_msg_body(msg), &o->desc, sizeof(nano_shm_desc));
+  *msgp = msg;
+  return 0;
+
+}
+
+// on failure returns non-zero and leaves *msgp untouched, for the body to be
+// sent in-band instead
+static int nano_shm_put(nng_msg **msgp, const size_t len, void (*fill)(unsigned char *, const void *), const void *arg) {
+
+  nano_shm_out o;
+  if (nano_shm_create(&o, len))
+    return 1;
+
+  fill(o.buf, arg);
+  o.len = len;
+  return nano_shm_finish(&o, msgp);
+
+}
+
+// on failing to grow, further bytes are discarded for the object to be
+// abandoned once serialization completes
+static void nano_write_shm(R_outpstream_t stream, void *src, int len) {
+
+  nano_shm_out *o = (nano_shm_out *) stream->data;
+
+  const size_t req = o->len + (size_t) len;
+  if (req > R_XLEN_T_MAX)
+    Rf_error("serialization exceeds max length of raw vector");
+  if (o->fail)
+    return;
+
+  if (req > o->cap) {
+    size_t cap = o->cap;
+    do {
+      cap += cap > NANONEXT_SERIAL_THR ? NANONEXT_SERIAL_THR : cap;
+    } while (cap < req);
+    if (nano_shm_reserve(o, cap)) {
+      o->fail = 1;
+      return;
+    }
+  }
+
+  memcpy(o->buf + o->len, src, len);
+  o->len = req;
+
+}
+
+static SEXP nano_shm_serialize_exec(void *arg) {
+
+  nano_shm_out *o = (nano_shm_out *) arg;
+  R_Serialize(o->object, o->stream);
+  o->done = 1;
+  return R_NilValue;
+
+}
+
+static void nano_shm_serialize_cleanup(void *arg) {
+
+  nano_shm_out *o = (nano_shm_out *) arg;
+  if (!o->done)
+    nano_shm_discard(o);
+
+}
+
+// serializes straight into an object of cap bytes to start, or on failure
+// returns non-zero for the object to be serialized in-band instead
+static int nano_shm_serialize(nng_msg **msgp, SEXP object, SEXP hook, size_t cap, size_t *est) {
+
+  struct R_outpstream_st output_stream;
+  nano_shm_out o;
+
+  if (nano_shm_create(&o, cap > NANONEXT_INIT_BUFSIZE ? cap : NANONEXT_INIT_BUFSIZE))
+    return 1;
+
+  if (nano_serial_header(o.buf, 0))
+    o.len = 8;
+
+  nano_serial_bind(hook, &output_stream);
+  R_InitOutPStream(
+    &output_stream,
+    (R_pstream_data_t) &o,
+    R_pstream_binary_format,
+    NANONEXT_SERIAL_VER,
+    NULL,
+    nano_write_shm,
+    hook != R_NilValue ? nano_serialize_hook : NULL,
+    R_NilValue
+  );
+  o.stream = &output_stream;
+  o.object = object;
+
+  R_ExecWithCleanup(nano_shm_serialize_exec, &o, nano_shm_serialize_cleanup, &o);
+
+  if (o.fail) {
+    nano_shm_discard(&o);
+    return 1;
+  }
+  nano_serial_estimate(est, o.len);
+
+  return nano_shm_finish(&o, msgp);
+
+}
+
+// copies out the descriptor if the message is one, with a terminated name
+static int nano_shm_desc_get(nng_msg *msg, nano_shm_desc *desc) {
+
+  const unsigned char *buf = nng_msg_body(msg);
+  if (nng_msg_len(msg) != sizeof(nano_shm_desc) || buf[0] != 0x7 || buf[1] != NANONEXT_SHM_FLAG ||
+      memcmp(buf + 4, nano_shm_magic, sizeof(nano_shm_magic)))
+    return 0;
+
+  memcpy(desc, buf, sizeof(nano_shm_desc));
+  desc->name[sizeof(desc->name) - 1] = '\0';
+  return !strncmp(desc->name, "/nano-", 6);
+
+}
+
+// a descriptor is honoured only if it names an object created by the process at
+// the other end of the pipe: this process over inproc, or over ipc a process of
+// the same user, the name being '/nano-<pid>-<seq>' as set by nano_shm_create()
+static int nano_shm_local(nng_msg *msg, const nano_shm_desc *desc) {
+
+  const nng_pipe p = nng_msg_get_pipe(msg);
+  nng_sockaddr sa;
+  uint64_t uid, pid;
+  char prefix[24];
+  const char *s;
+  int n;
+
+  if (nng_pipe_get_addr(p, NNG_OPT_REMADDR, &sa))
+    return 0;
+
+  switch (sa.s_family) {
+  case NNG_AF_INPROC:
+    pid = (uint64_t) getpid();
+    break;
+  case NNG_AF_IPC:
+  case NNG_AF_ABSTRACT:
+    if (nng_pipe_get_uint64(p, NNG_OPT_IPC_PEER_UID, &uid) || uid != (uint64_t) geteuid() ||
+        nng_pipe_get_uint64(p, NNG_OPT_IPC_PEER_PID, &pid))
+      return 0;
+    break;
+  default:
+    return 0;
+  }
+
+  n = snprintf(prefix, sizeof(prefix), "/nano-%d-", (int) pid);
+  if (strncmp(desc->name, prefix, n) || !desc->name[n])
+    return 0;
+  for (s = desc->name + n; *s; s++) {
+    if (*s < '0' || *s > '9')
+      return 0;
+  }
+  return 1;
+
+}
+
+// called on each receive completion, overwriting the flag set by the sender -
+// messages that are not valid descriptors are left untouched
+void nano_shm_mark(nng_msg *msg) {
+
+  nano_shm_desc desc;
+  if (nano_shm_desc_get(msg, &desc))
+    ((unsigned char *) nng_msg_body(msg))[2] = (unsigned char) nano_shm_local(msg, &desc);
+
+}
+
+// for messages that could not be sent - removes an object created by this
+// process for the message before freeing it
+void nano_msg_free(nng_msg *msg) {
+
+  nano_shm_desc desc;
+  char prefix[24];
+
+  if (msg != NULL && nano_shm_desc_get(msg, &desc)) {
+    snprintf(prefix, sizeof(prefix), "/nano-%d-", (int) getpid());
+    if (!strncmp(desc.name, prefix, strlen(prefix)))
+      shm_unlink(desc.name);
+  }
+  nng_msg_free(msg);
+
+}
+
+// for received messages discarded without being decoded - removes the object
+// a descriptor from a local peer refers to, as no other receiver exists
+void nano_msg_drop(nng_msg *msg) {
+
+  nano_shm_desc desc;
+
+  if (msg != NULL && nano_shm_desc_get(msg, &desc) && desc.header[2])
+    shm_unlink(desc.name);
+  nng_msg_free(msg);
+
+}
+
+static SEXP nano_shm_exec(void *arg) {
+
+  nano_shm_map *m = (nano_shm_map *) arg;
+  return nano_decode(m->buf, m->len, m->mod, m->hook);
+
+}
+
+static void nano_shm_cleanup(void *arg) {
+
+  nano_shm_map *m = (nano_shm_map *) arg;
+  munmap(m->buf, m->len);
+
+}
+
+// only objects owned by this user are opened
+static SEXP nano_shm_decode(nano_shm_desc *desc, const uint8_t mod, SEXP hook) {
+
+  if (!desc->size || desc->size > (uint64_t) R_XLEN_T_MAX)
+    ERROR_RET(NNG_EINVAL);
+
+  struct stat st;
+  const int fd = shm_open(desc->name, O_RDONLY, 0);
+  if (fd < 0)
+    ERROR_RET(NNG_ENOENT);
+  if (fstat(fd, &st) || st.st_uid != geteuid() || (uint64_t) st.st_size < desc->size) {
+    close(fd);
+    ERROR_RET(NNG_EPERM);
+  }
+  shm_unlink(desc->name);
+
+  // private writable mapping: any write through the pointer stays local
+  nano_shm_map m = {.len = (size_t) desc->size, .hook = hook, .mod = mod};
+  m.buf = mmap(NULL, m.len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m.buf == MAP_FAILED)
+    ERROR_RET(NNG_ENOMEM);
+
+  R_altrep_class_t cls;
+  size_t size;
+  nano_zc *zc;
+  if (nano_zerocopy && nano_zc_class(mod, &cls, &size) && !(m.len % size) &&
+      (zc = malloc(sizeof(nano_zc))) != NULL) {
+    zc->msg = NULL;
+    zc->buf = m.buf;
+    zc->len = m.len;
+    return nano_zc_vector(zc, cls);
+  }
+
+  return R_ExecWithCleanup(nano_shm_exec, &m, nano_shm_cleanup, &m);
+
+}
+
+#endif
+
+// takes ownership of the message (setting *msgp to NULL) if zero-copy applies
+// or it is a shared memory descriptor from a local peer
+SEXP nano_decode_msg(nng_msg **msgp, const uint8_t mod, SEXP hook) {
+
+  nng_msg *msg = *msgp;
+  unsigned char *buf = nng_msg_body(msg);
+  const size_t sz = nng_msg_len(msg);
+
+#ifndef _WIN32
+  nano_shm_desc desc;
+  if (nano_shm_desc_get(msg, &desc) && desc.header[2]) {
+    nng_msg_free(msg);
+    *msgp = NULL;
+    return nano_shm_decode(&desc, mod, hook);
+  }
+#endif
+
+  R_altrep_class_t cls;
+  size_t size;
+  nano_zc *zc;
+  if (nano_zerocopy && sz && nano_zc_class(mod, &cls, &size) && !(sz % size) &&
+      !((uintptr_t) buf % (size > sizeof(double) ? sizeof(double) : size)) &&
+      (zc = malloc(sizeof(nano_zc))) != NULL) {
+    zc->msg = msg;
+    zc->buf = buf;
+    zc->len = sz;
+    *msgp = NULL;
+    return nano_zc_vector(zc, cls);
+  }
+
+  return nano_decode(buf, sz, mod, hook);
+
+}
+
+// string lengths are taken from each CHARSXP rather than by scanning for NUL
+
+static size_t nano_strings_size(const SEXP object) {
+
+  const SEXP *sp = (const SEXP *) DATAPTR_RO(object);
+  const R_xlen_t xlen = XLENGTH(object);
+  size_t outlen = xlen;
+  for (R_xlen_t i = 0; i < xlen; i++)
+    outlen += LENGTH(sp[i]);
+  return outlen;
+
+}
+
+static void nano_strings_copy(unsigned char *dest, const SEXP object) {
+
+  const SEXP *sp = (const SEXP *) DATAPTR_RO(object);
+  const R_xlen_t xlen = XLENGTH(object);
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    const size_t slen = LENGTH(sp[i]) + 1;
+    memcpy(dest, CHAR(sp[i]), slen);
+    dest += slen;
+  }
+
+}
+
 void nano_encode(nano_buf *enc, const SEXP object) {
 
   switch (TYPEOF(object)) {
   case STRSXP: ;
-    const char *s;
-    R_xlen_t xlen = XLENGTH(object);
-    if (xlen == 1) {
-      s = NANO_STRING(object);
-      NANO_INIT(enc, (unsigned char *) s, strlen(s) + 1);
+    if (XLENGTH(object) == 1) {
+      const SEXP s = STRING_ELT(object, 0);
+      NANO_INIT(enc, (unsigned char *) CHAR(s), LENGTH(s) + 1);
       break;
     }
-    R_xlen_t i;
-    size_t slen, outlen = 0;
-    for (i = 0; i < xlen; i++)
-      outlen += strlen(NANO_STR_N(object, i)) + 1;
+    const size_t outlen = nano_strings_size(object);
     NANO_ALLOC(enc, outlen);
-    for (i = 0; i < xlen; i++) {
-      s = NANO_STR_N(object, i);
-      slen = strlen(s) + 1;
-      memcpy(enc->buf + enc->cur, s, slen);
-      enc->cur += slen;
-    }
+    nano_strings_copy(enc->buf, object);
+    enc->cur = outlen;
     break;
   case REALSXP:
     NANO_INIT(enc, (unsigned char *) DATAPTR_RO(object), XLENGTH(object) * sizeof(double));
@@ -532,10 +1990,174 @@ void nano_encode(nano_buf *enc, const SEXP object) {
 
 }
 
+// references the data of each list element in place as a scatter-gather buffer
+unsigned nano_encode_iov(nng_iov *iov, const SEXP data) {
+
+  const R_xlen_t n = XLENGTH(data);
+  if (n == 0 || n > NANONEXT_IOV_MAX)
+    Rf_error("`data` must be a list of between 1 and %d elements", NANONEXT_IOV_MAX);
+
+  // strings are sent without their terminator so elements abut on the wire
+  nano_buf enc;
+  SEXP x;
+  for (R_xlen_t i = 0; i < n; i++) {
+    x = NANO_VECTOR(data)[i];
+    if (TYPEOF(x) == STRSXP) {
+      if (XLENGTH(x) != 1)
+        Rf_error("`data` elements must be atomic vectors, or character vectors of length 1");
+      iov[i].iov_buf = (void *) CHAR(STRING_ELT(x, 0));
+      iov[i].iov_len = LENGTH(STRING_ELT(x, 0));
+      continue;
+    }
+    nano_encode(&enc, x);
+    iov[i].iov_buf = enc.buf;
+    iov[i].iov_len = enc.cur;
+  }
+
+  return (unsigned) n;
+
+}
+
+int nano_encode_msg(nng_msg **msgp, const SEXP object) {
+
+  nano_buf enc;
+  int xc;
+
+  if (TYPEOF(object) == STRSXP && XLENGTH(object) > 1) {
+    if ((xc = nng_msg_alloc(msgp, nano_strings_size(object))))
+      return xc;
+    nano_strings_copy((unsigned char *) nng_msg_body(*msgp), object);
+    return 0;
+  }
+
+  nano_encode(&enc, object);
+  if ((xc = nng_msg_alloc(msgp, enc.cur)))
+    return xc;
+  if (enc.cur)
+    memcpy(nng_msg_body(*msgp), enc.buf, enc.cur);
+
+  return 0;
+
+}
+
+static size_t nano_prefixed_len(const SEXP object) {
+
+  if (TYPEOF(object) != STRSXP)
+    Rf_error("`data` must be a character vector to send in mode 'prefixed'");
+
+  const SEXP *sp = (const SEXP *) DATAPTR_RO(object);
+  const R_xlen_t xlen = XLENGTH(object);
+  size_t outlen = xlen * sizeof(uint32_t);
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    if (sp[i] != NA_STRING)
+      outlen += LENGTH(sp[i]);
+  }
+
+  return outlen;
+
+}
+
+static void nano_prefixed_fill(unsigned char *body, const void *arg) {
+
+  const SEXP object = (const SEXP) arg;
+  const SEXP *sp = (const SEXP *) DATAPTR_RO(object);
+  const R_xlen_t xlen = XLENGTH(object);
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    const uint32_t len = sp[i] == NA_STRING ? UINT32_MAX : (uint32_t) LENGTH(sp[i]);
+    memcpy(body, &len, sizeof(uint32_t));
+    body += sizeof(uint32_t);
+    if (len != UINT32_MAX) {
+      memcpy(body, CHAR(sp[i]), len);
+      body += len;
+    }
+  }
+
+}
+
+int nano_encode_prefixed(nng_msg **msgp, const SEXP object) {
+
+  const size_t outlen = nano_prefixed_len(object);
+
+  int xc;
+  if ((xc = nng_msg_alloc(msgp, outlen)))
+    return xc;
+
+  nano_prefixed_fill((unsigned char *) nng_msg_body(*msgp), object);
+  return 0;
+
+}
+
+static void nano_buf_fill(unsigned char *body, const void *arg) {
+
+  const nano_buf *buf = (const nano_buf *) arg;
+  memcpy(body, buf->buf, buf->cur);
+
+}
+
+static void nano_msg_fill(unsigned char *body, const void *arg) {
+
+  nng_msg *msg = (nng_msg *) arg;
+  memcpy(body, nng_msg_body(msg), nng_msg_len(msg));
+
+}
+
+// encodes data by send mode: 0 serial, 1 raw, 2 compress, 3 prefixed, placing
+// bodies of at least shm bytes (if non-zero) in shared memory, if every pipe of
+// socket sid leads to a peer accepting them
+int nano_encode_data(nng_msg **msgp, const SEXP data, const int enc, SEXP hook, size_t hint, size_t *est, const size_t shm, const int sid) {
+
+  int xc;
+  size_t len;
+
+  switch (enc) {
+  case 1:
+    if (!shm)
+      return nano_encode_msg(msgp, data);
+    // raw vectors are copied straight from R memory into the shared object
+    nano_buf buf;
+    nano_encode(&buf, data);
+    if (!nano_shm_ok(sid, buf.cur, shm) || nano_shm_put(msgp, buf.cur, nano_buf_fill, &buf)) {
+      if (!(xc = nng_msg_alloc(msgp, buf.cur)) && buf.cur)
+        memcpy(nng_msg_body(*msgp), buf.buf, buf.cur);
+    } else {
+      xc = 0;
+    }
+    NANO_FREE(buf);
+    return xc;
+  case 3:
+    if (shm && nano_shm_ok(sid, len = nano_prefixed_len(data), shm) &&
+        !nano_shm_put(msgp, len, nano_prefixed_fill, data))
+      return 0;
+    return nano_encode_prefixed(msgp, data);
+  case 0:
+    // serialized straight into the object if the expected size is enough,
+    // otherwise copied across below if it turns out to be
+    len = hint ? hint : est != NULL ? *est : 0;
+    if (shm && nano_shm_ok(sid, len, shm) && !nano_shm_serialize(msgp, data, hook, len, est))
+      return 0;
+    xc = nano_serialize_msg(msgp, data, hook, hint, est, 0);
+    break;
+  default:
+    // compressed size is known only once complete
+    xc = nano_serialize_msg(msgp, data, hook, hint, est, 1);
+  }
+
+  if (!xc && nano_shm_ok(sid, nng_msg_len(*msgp), shm)) {
+    nng_msg *msg = *msgp;
+    if (!nano_shm_put(msgp, nng_msg_len(msg), nano_msg_fill, msg))
+      nng_msg_free(msg);
+  }
+
+  return xc;
+
+}
+
 int nano_encode_mode(const SEXP mode) {
 
-  if (TYPEOF(mode) == INTSXP)
-    return NANO_INTEGER(mode) == 2;
+  if (TYPEOF(mode) == INTSXP) {
+    const int i = NANO_INTEGER(mode);
+    return i >= 2 && i <= 4 ? i - 1 : 0;
+  }
 
   const char *mod = CHAR(STRING_ELT(mode, 0));
   const size_t slen = strlen(mod);
@@ -547,9 +2169,13 @@ int nano_encode_mode(const SEXP mode) {
   case 6:
     if (!memcmp(mod, "serial", slen)) return 0;
     break;
+  case 8:
+    if (!memcmp(mod, "compress", slen)) return 2;
+    if (!memcmp(mod, "prefixed", slen)) return 3;
+    break;
   }
 
-  Rf_error("`mode` should be one of: serial, raw");
+  Rf_error("`mode` should be one of: serial, raw, compress, prefixed");
 
 }
 
@@ -576,6 +2202,9 @@ int nano_matcharg(const SEXP mode) {
     if (!memcmp(mod, "logical", slen)) { i = 6; break; }
     if (!memcmp(mod, "complex", slen)) { i = 3; break; }
     goto fail;
+  case 8:
+    if (!memcmp(mod, "prefixed", slen)) { i = 10; break; }
+    goto fail;
   case 9:
     if (!memcmp(mod, "character", slen)) { i = 2; break; }
     goto fail;
@@ -586,7 +2215,7 @@ int nano_matcharg(const SEXP mode) {
   return i;
 
   fail:
-  Rf_error("`mode` should be one of: serial, character, complex, double, integer, logical, numeric, raw, string");
+  Rf_error("`mode` should be one of: serial, character, complex, double, integer, logical, numeric, raw, string, prefixed");
 
 }
 
@@ -616,6 +2245,102 @@ SEXP rnng_marker_read(SEXP x) {
 
 }
 
+SEXP rnng_zerocopy_switch(SEXP x) {
+
+  nano_zerocopy = NANO_INTEGER(x);
+  return x;
+
+}
+
+SEXP rnng_size_hint(SEXP con) {
+
+  int sock;
+  if (!(sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) && NANO_PTR_CHECK(con, nano_ContextSymbol))
+    Rf_error("`con` is not a valid Socket or Context");
+
+  return Rf_ScalarReal((double) *NANO_HINT(con, sock));
+
+}
+
+SEXP rnng_compress_config(SEXP level, SEXP threshold) {
+
+  if (level != R_NilValue) {
+    const int lvl = nano_integer(level);
+    if (lvl < 0 || lvl > 9)
+      Rf_error("`level` must be an integer between 0 and 9");
+    nano_compress_level = lvl;
+  }
+  if (threshold != R_NilValue) {
+    const int thr = nano_integer(threshold);
+    if (thr < 0)
+      Rf_error("`threshold` must be a non-negative integer");
+    nano_compress_thr = thr;
+  }
+
+  SEXP out;
+  const char *names[] = {"level", "threshold", ""};
+  PROTECT(out = Rf_mkNamed(INTSXP, names));
+  INTEGER(out)[0] = nano_compress_level == Z_DEFAULT_COMPRESSION ? 6 : nano_compress_level;
+  INTEGER(out)[1] = nano_compress_thr;
+  UNPROTECT(1);
+  return out;
+
+}
+
+SEXP rnng_shm_config(SEXP con, SEXP threshold, SEXP accept) {
+
+  int sock;
+  if (!(sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) && NANO_PTR_CHECK(con, nano_ContextSymbol))
+    Rf_error("`con` is not a valid Socket or Context");
+
+  size_t *shm = sock ? &((nano_sock *) NANO_PTR(con))->shm : &((nano_ctx *) NANO_PTR(con))->shm;
+  int *shmrx = sock ? &((nano_sock *) NANO_PTR(con))->shmrx : &((nano_ctx *) NANO_PTR(con))->shmrx;
+
+  if (threshold != R_NilValue) {
+    const int thr = nano_integer(threshold);
+    if (thr < 0)
+      Rf_error("`threshold` must be a non-negative integer");
+    // the first receiver unlinks the object, so only one receiver may exist,
+    // and a request resent by 'req' would arrive after it is gone
+    const SEXP proto = Rf_getAttrib(con, nano_ProtocolSymbol);
+    if (thr && TYPEOF(proto) == STRSXP &&
+        (!strcmp(NANO_STRING(proto), "pub") || !strcmp(NANO_STRING(proto), "bus") ||
+         !strcmp(NANO_STRING(proto), "surveyor") || !strcmp(NANO_STRING(proto), "req")))
+      Rf_error("`con` must not use the 'pub', 'bus', 'surveyor' or 'req' protocols for shared memory");
+    // pipes are tracked for each to be checked as leading to an accepting peer
+    nng_socket s;
+    s.id = (uint32_t) NANO_SOCKID(con, sock);
+    int xc;
+    if (thr && (xc = nano_route_track(s)))
+      ERROR_OUT(xc);
+    *shm = (size_t) thr;
+  }
+  if (accept != R_NilValue)
+    nano_shm_accept(shmrx, nano_integer(accept) == 1);
+
+  SEXP out;
+  const char *names[] = {"threshold", "accept", ""};
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(out, 0, Rf_ScalarInteger((int) *shm));
+  SET_VECTOR_ELT(out, 1, Rf_ScalarLogical(*shmrx));
+  UNPROTECT(1);
+  return out;
+
+}
+
+SEXP rnng_later_batch(SEXP max) {
+
+  if (max != R_NilValue) {
+    const int n = nano_integer(max);
+    if (n < 0)
+      Rf_error("`max` must be a non-negative integer");
+    atomic_store(&nano_later_max, n);
+  }
+
+  return Rf_ScalarInteger(atomic_load(&nano_later_max));
+
+}
+
 SEXP rnng_header_set(SEXP x) {
 
   special_header = NANO_INTEGER(x);
@@ -1,22 +1,5 @@
 // nanonext - package level registrations --------------------------------------
 
-//praveen🍉
-
-#include <Rinternals.h>
-
-extern SEXP rnng_http_echo_server(SEXP);
-
-static const R_CallMethodDef CallEntries[] = {
-    {"rnng_http_echo_server", (DL_FUNC) &rnng_http_echo_server, 1},
-    {NULL, NULL, 0}
-};
-
-void R_init_nanonext(DllInfo *dll) {
-    R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
-    R_useDynamicSymbols(dll, FALSE);
-}
-
-
 #include "nanonext.h"
 
 void (*eln2)(void (*)(void *), void *, double, int) = NULL;
@@ -26,6 +9,7 @@ SEXP nano_ContextSymbol;
 SEXP nano_CvSymbol;
 SEXP nano_DataSymbol;
 SEXP nano_DialerSymbol;
+SEXP nano_DispatcherSymbol;
 SEXP nano_DotcallSymbol;
 SEXP nano_HeadersSymbol;
 SEXP nano_IdSymbol;
@@ -33,9 +17,11 @@ SEXP nano_ListenerSymbol;
 SEXP nano_MonitorSymbol;
 SEXP nano_MsgidSymbol;
 SEXP nano_ProtocolSymbol;
+SEXP nano_QueueSymbol;
 SEXP nano_ResolveSymbol;
 SEXP nano_ResponseSymbol;
 SEXP nano_ResultSymbol;
+SEXP nano_ServerSymbol;
 SEXP nano_SocketSymbol;
 SEXP nano_StateSymbol;
 SEXP nano_StatusSymbol;
@@ -61,6 +47,7 @@ static void RegisterSymbols(void) {
   nano_CvSymbol = Rf_install("cv");
   nano_DataSymbol = Rf_install("data");
   nano_DialerSymbol = Rf_install("dialer");
+  nano_DispatcherSymbol = Rf_install("dispatcher");
   nano_DotcallSymbol = Rf_install(".Call");
   nano_HeadersSymbol = Rf_install("headers");
   nano_IdSymbol = Rf_install("id");
@@ -68,9 +55,11 @@ static void RegisterSymbols(void) {
   nano_MonitorSymbol = Rf_install("monitor");
   nano_MsgidSymbol = Rf_install("msgid");
   nano_ProtocolSymbol = Rf_install("protocol");
+  nano_QueueSymbol = Rf_install("queue");
   nano_ResolveSymbol = Rf_install("resolve");
   nano_ResponseSymbol = Rf_install("response");
   nano_ResultSymbol = Rf_install("result");
+  nano_ServerSymbol = Rf_install("server");
   nano_SocketSymbol = Rf_install("socket");
   nano_StateSymbol = Rf_install("state");
   nano_StatusSymbol = Rf_install("status");
@@ -119,16 +108,22 @@ static void ReleaseObjects(void) {
 static const R_CallMethodDef callMethods[] = {
   {"rnng_advance_rng_state", (DL_FUNC) &rnng_advance_rng_state, 0},
   {"rnng_aio_call", (DL_FUNC) &rnng_aio_call, 1},
+  {"rnng_aio_call_safe", (DL_FUNC) &rnng_aio_call_safe, 1},
   {"rnng_aio_collect", (DL_FUNC) &rnng_aio_collect, 1},
   {"rnng_aio_collect_safe", (DL_FUNC) &rnng_aio_collect_safe, 1},
   {"rnng_aio_get_msg", (DL_FUNC) &rnng_aio_get_msg, 1},
   {"rnng_aio_http_data", (DL_FUNC) &rnng_aio_http_data, 1},
   {"rnng_aio_http_headers", (DL_FUNC) &rnng_aio_http_headers, 1},
   {"rnng_aio_http_status", (DL_FUNC) &rnng_aio_http_status, 1},
+  {"rnng_aio_pool", (DL_FUNC) &rnng_aio_pool, 1},
+  {"rnng_aio_race", (DL_FUNC) &rnng_aio_race, 1},
   {"rnng_aio_result", (DL_FUNC) &rnng_aio_result, 1},
   {"rnng_aio_stop", (DL_FUNC) &rnng_aio_stop, 1},
+  {"rnng_bench", (DL_FUNC) &rnng_bench, 5},
   {"rnng_clock", (DL_FUNC) &rnng_clock, 0},
   {"rnng_close", (DL_FUNC) &rnng_close, 1},
+  {"rnng_compress_config", (DL_FUNC) &rnng_compress_config, 2},
+  {"rnng_conflate", (DL_FUNC) &rnng_conflate, 3},
   {"rnng_ctx_close", (DL_FUNC) &rnng_ctx_close, 1},
   {"rnng_ctx_create", (DL_FUNC) &rnng_ctx_create, 1},
   {"rnng_ctx_open", (DL_FUNC) &rnng_ctx_open, 1},
@@ -139,20 +134,32 @@ static const R_CallMethodDef callMethods[] = {
   {"rnng_cv_until_safe", (DL_FUNC) &rnng_cv_until_safe, 2},
   {"rnng_cv_value", (DL_FUNC) &rnng_cv_value, 1},
   {"rnng_cv_wait", (DL_FUNC) &rnng_cv_wait, 1},
+  {"rnng_cv_wait_any", (DL_FUNC) &rnng_cv_wait_any, 3},
   {"rnng_cv_wait_safe", (DL_FUNC) &rnng_cv_wait_safe, 1},
   {"rnng_dial", (DL_FUNC) &rnng_dial, 5},
   {"rnng_dialer_close", (DL_FUNC) &rnng_dialer_close, 1},
   {"rnng_dialer_start", (DL_FUNC) &rnng_dialer_start, 2},
+  {"rnng_dispatch", (DL_FUNC) &rnng_dispatch, 7},
+  {"rnng_dispatcher_close", (DL_FUNC) &rnng_dispatcher_close, 1},
+  {"rnng_dispatcher_create", (DL_FUNC) &rnng_dispatcher_create, 2},
   {"rnng_eval_safe", (DL_FUNC) &rnng_eval_safe, 1},
   {"rnng_fini", (DL_FUNC) &rnng_fini, 0},
   {"rnng_fini_priors", (DL_FUNC) &rnng_fini_priors, 0},
   {"rnng_get_opt", (DL_FUNC) &rnng_get_opt, 2},
   {"rnng_header_read", (DL_FUNC) &rnng_header_read, 1},
   {"rnng_header_set", (DL_FUNC) &rnng_header_set, 1},
+  {"rnng_http_pool", (DL_FUNC) &rnng_http_pool, 2},
+  {"rnng_http_route", (DL_FUNC) &rnng_http_route, 6},
+  {"rnng_http_serve", (DL_FUNC) &rnng_http_serve, 3},
+  {"rnng_http_server_close", (DL_FUNC) &rnng_http_server_close, 1},
+  {"rnng_http_server_create", (DL_FUNC) &rnng_http_server_create, 2},
+  {"rnng_http_static", (DL_FUNC) &rnng_http_static, 6},
   {"rnng_interrupt_switch", (DL_FUNC) &rnng_interrupt_switch, 1},
   {"rnng_ip_addr", (DL_FUNC) &rnng_ip_addr, 0},
   {"rnng_is_error_value", (DL_FUNC) &rnng_is_error_value, 1},
   {"rnng_is_nul_byte", (DL_FUNC) &rnng_is_nul_byte, 1},
+  {"rnng_latency", (DL_FUNC) &rnng_latency, 3},
+  {"rnng_later_batch", (DL_FUNC) &rnng_later_batch, 1},
   {"rnng_listen", (DL_FUNC) &rnng_listen, 5},
   {"rnng_listener_close", (DL_FUNC) &rnng_listener_close, 1},
   {"rnng_listener_start", (DL_FUNC) &rnng_listener_start, 1},
@@ -161,41 +168,55 @@ static const R_CallMethodDef callMethods[] = {
   {"rnng_messenger", (DL_FUNC) &rnng_messenger, 1},
   {"rnng_monitor_create", (DL_FUNC) &rnng_monitor_create, 2},
   {"rnng_monitor_read", (DL_FUNC) &rnng_monitor_read, 1},
-  {"rnng_ncurl", (DL_FUNC) &rnng_ncurl, 9},
+  {"rnng_ncurl", (DL_FUNC) &rnng_ncurl, 10},
   {"rnng_ncurl_aio", (DL_FUNC) &rnng_ncurl_aio, 9},
+  {"rnng_ncurl_aio_bulk", (DL_FUNC) &rnng_ncurl_aio_bulk, 10},
   {"rnng_ncurl_session", (DL_FUNC) &rnng_ncurl_session, 8},
   {"rnng_ncurl_session_close", (DL_FUNC) &rnng_ncurl_session_close, 1},
   {"rnng_ncurl_transact", (DL_FUNC) &rnng_ncurl_transact, 1},
   {"rnng_pipe_notify", (DL_FUNC) &rnng_pipe_notify, 5},
+  {"rnng_pipe_route", (DL_FUNC) &rnng_pipe_route, 2},
   {"rnng_protocol_open", (DL_FUNC) &rnng_protocol_open, 6},
-  {"rnng_random", (DL_FUNC) &rnng_random, 2},
+  {"rnng_queue_alloc", (DL_FUNC) &rnng_queue_alloc, 0},
+  {"rnng_queue_drain", (DL_FUNC) &rnng_queue_drain, 2},
+  {"rnng_random", (DL_FUNC) &rnng_random, 3},
   {"rnng_read_stdin", (DL_FUNC) &rnng_read_stdin, 1},
   {"rnng_reap", (DL_FUNC) &rnng_reap, 1},
   {"rnng_recv", (DL_FUNC) &rnng_recv, 4},
-  {"rnng_recv_aio", (DL_FUNC) &rnng_recv_aio, 6},
-  {"rnng_request", (DL_FUNC) &rnng_request, 8},
-  {"rnng_send", (DL_FUNC) &rnng_send, 5},
-  {"rnng_send_aio", (DL_FUNC) &rnng_send_aio, 6},
+  {"rnng_recv_aio", (DL_FUNC) &rnng_recv_aio, 7},
+  {"rnng_recv_aio_batch", (DL_FUNC) &rnng_recv_aio_batch, 5},
+  {"rnng_recv_chunked", (DL_FUNC) &rnng_recv_chunked, 2},
+  {"rnng_recv_frame", (DL_FUNC) &rnng_recv_frame, 5},
+  {"rnng_request", (DL_FUNC) &rnng_request, 9},
+  {"rnng_send", (DL_FUNC) &rnng_send, 6},
+  {"rnng_send_aio", (DL_FUNC) &rnng_send_aio, 7},
+  {"rnng_send_aio_batch", (DL_FUNC) &rnng_send_aio_batch, 6},
+  {"rnng_send_chunked", (DL_FUNC) &rnng_send_chunked, 4},
   {"rnng_serial_config", (DL_FUNC) &rnng_serial_config, 3},
+  {"rnng_serial_test", (DL_FUNC) &rnng_serial_test, 1},
   {"rnng_set_opt", (DL_FUNC) &rnng_set_opt, 3},
   {"rnng_set_promise_context", (DL_FUNC) &rnng_set_promise_context, 2},
+  {"rnng_shm_config", (DL_FUNC) &rnng_shm_config, 3},
   {"rnng_signal_thread_create", (DL_FUNC) &rnng_signal_thread_create, 2},
+  {"rnng_size_hint", (DL_FUNC) &rnng_size_hint, 1},
   {"rnng_sleep", (DL_FUNC) &rnng_sleep, 1},
   {"rnng_stats_get", (DL_FUNC) &rnng_stats_get, 2},
+  {"rnng_stats_snapshot", (DL_FUNC) &rnng_stats_snapshot, 3},
   {"rnng_status_code", (DL_FUNC) &rnng_status_code, 1},
   {"rnng_stream_close", (DL_FUNC) &rnng_stream_close, 1},
   {"rnng_stream_open", (DL_FUNC) &rnng_stream_open, 4},
   {"rnng_strerror", (DL_FUNC) &rnng_strerror, 1},
   {"rnng_subscribe", (DL_FUNC) &rnng_subscribe, 3},
+  {"rnng_tls_cache", (DL_FUNC) &rnng_tls_cache, 1},
   {"rnng_tls_config", (DL_FUNC) &rnng_tls_config, 4},
   {"rnng_traverse_precious", (DL_FUNC) &rnng_traverse_precious, 0},
   {"rnng_unresolved", (DL_FUNC) &rnng_unresolved, 1},
   {"rnng_unresolved2", (DL_FUNC) &rnng_unresolved2, 1},
   {"rnng_url_parse", (DL_FUNC) &rnng_url_parse, 1},
   {"rnng_version", (DL_FUNC) &rnng_version, 0},
-  {"rnng_wait_thread_create", (DL_FUNC) &rnng_wait_thread_create, 1},
   {"rnng_write_cert", (DL_FUNC) &rnng_write_cert, 2},
   {"rnng_write_stdout", (DL_FUNC) &rnng_write_stdout, 1},
+  {"rnng_zerocopy_switch", (DL_FUNC) &rnng_zerocopy_switch, 1},
   {NULL, NULL, 0}
 };
 
@@ -207,7 +228,9 @@ static const R_ExternalMethodDef externalMethods[] = {
 void attribute_visible R_init_nanonext(DllInfo* dll) {
   RegisterSymbols();
   PreserveObjects();
+  nano_thread_init();
   nano_list_do(INIT, NULL);
+  nano_altrep_init(dll);
   R_registerRoutines(dll, NULL, callMethods, NULL, externalMethods);
   R_useDynamicSymbols(dll, FALSE);
   R_forceSymbols(dll, TRUE);
@@ -215,7 +238,6 @@ void attribute_visible R_init_nanonext(DllInfo* dll) {
 
 // # nocov start
 void attribute_visible R_unload_nanonext(DllInfo *info) {
-  nano_thread_shutdown();
   nano_list_do(SHUTDOWN, NULL);
   ReleaseObjects();
 }
@@ -3,6 +3,10 @@
 #ifndef NANONEXT_H
 #define NANONEXT_H
 
+#if defined(NANONEXT_AFFINITY) && defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <nng/nng.h>
 #include <nng/supplemental/util/platform.h>
 #include <nng/supplemental/tls/tls.h>
@@ -23,6 +27,27 @@
 
 #ifdef NANONEXT_HTTP
 #include <nng/supplemental/http/http.h>
+#include <stdio.h>
+
+typedef struct nano_http_idle_s {
+  nng_http_conn *conn;
+  nng_time since;
+  struct nano_http_idle_s *next;
+} nano_http_idle;
+
+typedef struct nano_http_host_s {
+  char *scheme;
+  char *host;
+  char *port;
+  nng_tls_config *tls;
+  nng_tls_config *cfg;
+  nng_http_client *cli;
+  nano_http_idle *idle;
+  int open;
+  struct nano_http_host_s *next;
+} nano_http_host;
+
+struct nano_http_bulk_s;
 
 typedef struct nano_handle_s {
   nng_url *url;
@@ -30,8 +55,36 @@ typedef struct nano_handle_s {
   nng_http_req *req;
   nng_http_res *res;
   nng_tls_config *cfg;
+  nano_http_host *host;
+  nng_http_conn *conn;
+  nng_time expire;
+  struct nano_http_bulk_s *bulk;
+  uint64_t start;
+  int state;
 } nano_handle;
 
+typedef struct nano_http_bulk_s {
+  struct nano_aio_s *agg;
+  struct nano_aio_s *aios;
+  nano_handle *handles;
+  nng_mtx *mtx;
+  nng_duration dur;
+  int n;
+  int next;
+  int pending;
+  int stopped;
+} nano_http_bulk;
+
+#endif
+
+#if defined(NANONEXT_SERVER) || defined(NANONEXT_SHM)
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #endif
 
 #ifdef NANONEXT_IO
@@ -60,6 +113,13 @@ typedef struct nano_handle_s {
 #endif
 #endif
 
+#ifdef NANONEXT_AFFINITY
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#endif
+
 #ifdef NANONEXT_SIGNALS
 #ifndef _WIN32
 #include <unistd.h>
@@ -82,9 +142,15 @@ typedef struct nano_handle_s {
 #include <mbedtls/md.h>
 #include <mbedtls/error.h>
 #include <errno.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #endif
 
 #include <inttypes.h>
+#include <stdatomic.h>
+#include <time.h>
 #ifndef R_NO_REMAP
 #define R_NO_REMAP
 #endif
@@ -95,6 +161,12 @@ typedef struct nano_handle_s {
 #include <Rinternals.h>
 #include <Rversion.h>
 #include <R_ext/Visibility.h>
+#ifdef NANONEXT_ALTREP
+#include <R_ext/Altrep.h>
+#endif
+#ifdef NANONEXT_COMPRESS
+#include <zlib.h>
+#endif
 #if defined(NANONEXT_SIGNALS)
 #ifdef _WIN32
 #include <Rembedded.h>
@@ -115,14 +187,30 @@ extern int R_interrupts_pending;
 #define NANO_STRING(x) CHAR(*((const SEXP *) DATAPTR_RO(x)))
 #define NANO_STR_N(x, n) CHAR(((const SEXP *) DATAPTR_RO(x))[n])
 #define NANO_INTEGER(x) *(int *) DATAPTR_RO(x)
+#define NANO_HINT(x, sock) (sock ? &((nano_sock *) NANO_PTR(x))->hint : &((nano_ctx *) NANO_PTR(x))->hint)
+#define NANO_SHM(x, sock) (sock ? ((nano_sock *) NANO_PTR(x))->shm : ((nano_ctx *) NANO_PTR(x))->shm)
+#define NANO_SOCKID(x, sock) (sock ? nng_socket_id(*(nng_socket *) NANO_PTR(x)) : ((nano_ctx *) NANO_PTR(x))->sock)
+#define NANO_HIST(x, sock) (sock ? ((nano_sock *) NANO_PTR(x))->hist : ((nano_ctx *) NANO_PTR(x))->hist)
 
 #define ERROR_OUT(xc) Rf_error("%d | %s", xc, nng_strerror(xc))
 #define ERROR_RET(xc) { Rf_warning("%d | %s", xc, nng_strerror(xc)); return mk_error(xc); }
 #define NANONEXT_INIT_BUFSIZE 4096
+#define NANONEXT_CHUNK_MIN 64
+#define NANONEXT_CHUNK_HDR 16
+#define NANONEXT_CHUNK_MAGIC "\x07\x04\xc3\x5e\x9a\x2d\x71\xb8" // opens each chunk
 #define NANONEXT_SERIAL_VER 3
 #define NANONEXT_SERIAL_THR 134217728
 #define NANONEXT_CHUNK_SIZE INT_MAX // must be <= INT_MAX
 #define NANONEXT_STR_SIZE 40
+#define NANONEXT_POOL_SIZE 256
+#define NANONEXT_COMPRESS_THR 65536
+#define NANONEXT_IOV_MAX 8 // nng limit per aio
+#define NANONEXT_FRAME_READ 65536
+#define NANONEXT_RNG_RESEED 10000
+#define NANONEXT_HIST_SUB 16 // sub-buckets per power of 2
+#define NANONEXT_HIST_BUCKETS 480 // covers up to 2^33 microseconds
+#define NANONEXT_HIST_SERIES 3
+#define NANONEXT_ROUTE_RING 32 // send timestamps held per routed pipe
 #define NANO_ALLOC(x, sz)                                      \
   (x)->buf = calloc(sz, sizeof(unsigned char));                \
   if ((x)->buf == NULL) Rf_error("memory allocation failed");  \
@@ -156,6 +244,10 @@ typedef struct nano_stream_s {
     nng_stream_listener *list;
   } endpoint;
   nng_tls_config *tls;
+  unsigned char *rbuf;
+  size_t rcap;
+  size_t rpos;
+  size_t rlen;
   int textframes;
   enum {
     NANO_STREAM_DIALER,
@@ -172,19 +264,131 @@ typedef enum nano_aio_typ {
   HTTP_AIO,
   RECVAIOS,
   REQAIOS,
-  IOV_RECVAIOS
+  IOV_RECVAIOS,
+  BATCH_SENDAIO,
+  BATCH_RECVAIO
 } nano_aio_typ;
 
+typedef struct nano_hist_series_s {
+  atomic_uint_fast64_t n;
+  atomic_uint_fast64_t sum;
+  atomic_uint_fast64_t max;
+  atomic_uint_fast64_t buckets[NANONEXT_HIST_BUCKETS];
+} nano_hist_series;
+
+typedef struct nano_hist_s {
+  atomic_int on;
+  struct nano_hist_s *next;
+  nano_hist_series series[NANONEXT_HIST_SERIES];
+} nano_hist;
+
+typedef struct nano_sock_s {
+  nng_socket sock;
+  nng_msg *chunk;
+  size_t hint;
+  size_t shm;
+  int shmrx;
+  nano_hist *hist;
+} nano_sock;
+
+typedef struct nano_ctx_s {
+  nng_ctx ctx;
+  int sock;
+  size_t hint;
+  size_t shm;
+  int shmrx;
+  nano_hist *hist;
+} nano_ctx;
+
 typedef struct nano_aio_s {
   nng_aio *aio;
   void *data;
   void *cb;
   void *next;
+  struct nano_aio_s *link;
+  void *queue;
   int result;
+  atomic_int state;
   uint8_t mode;
+  uint8_t pool;
+  uint8_t routed;
   nano_aio_typ type;
+  nano_hist *hist;
+  uint64_t start;
 } nano_aio;
 
+typedef struct nano_worker_s {
+  nng_ctx ctx;
+  nng_aio *aio;
+  nng_msg *msg;
+  struct nano_dispatcher_s *d;
+  struct nano_worker_s *next;
+  int state;
+} nano_worker;
+
+typedef struct nano_dispatcher_s {
+  nng_mtx *mtx;
+  nng_cv *cv;
+  nano_worker *workers;
+  nano_worker *head;
+  nano_worker *tail;
+  int n;
+  int ready;
+} nano_dispatcher;
+
+#ifdef NANONEXT_HTTP
+struct nano_server_s;
+
+typedef struct nano_http_route_s {
+  struct nano_server_s *s;
+  SEXP fun;
+  SEXP headers;
+  void *buf;
+  size_t len;
+  char *type;
+  int fd;
+} nano_http_route;
+
+typedef struct nano_http_request_s {
+  nng_aio *aio;
+  nano_http_route *route;
+  struct nano_http_request_s *next;
+  int state;
+} nano_http_request;
+
+typedef struct nano_server_s {
+  nng_http_server *srv;
+  nng_mtx *mtx;
+  nng_cv *cv;
+  nano_http_request *head;
+  nano_http_request *tail;
+  atomic_int refs;
+  int ready;
+  int closed;
+} nano_server;
+#endif
+
+typedef struct nano_queue_node_s {
+  struct nano_queue_node_s *next;
+  struct nano_queue_s *q;
+  SEXP obj;
+} nano_queue_node;
+
+typedef struct nano_queue_s {
+  _Atomic(nano_queue_node *) head;
+  nano_queue_node *ready;
+  nano_queue_node *tail;
+  R_xlen_t count;
+  atomic_int refs;
+} nano_queue;
+
+typedef struct nano_batch_s {
+  struct nano_aio_s *aios;
+  nng_mtx *mtx;
+  int n;
+  int pending;
+} nano_batch;
+
 typedef struct nano_saio_s {
   nng_ctx *ctx;
   nng_aio *aio;
@@ -198,6 +402,7 @@ typedef struct nano_cv_s {
   int flag;
   nng_mtx *mtx;
   nng_cv *cv;
+  struct nano_cv_s *any;
 } nano_cv;
 
 typedef struct nano_monitor_s {
@@ -207,12 +412,6 @@ typedef struct nano_monitor_s {
   int updates;
 } nano_monitor;
 
-typedef struct nano_thread_aio_s {
-  nng_thread *thr;
-  nano_cv *cv;
-  nng_aio *aio;
-} nano_thread_aio;
-
 typedef struct nano_thread_duo_s {
   nng_thread *thr;
   nano_cv *cv;
@@ -225,11 +424,40 @@ typedef struct nano_buf_s {
   size_t cur;
 } nano_buf;
 
+typedef struct nano_chunk_s {
+  nng_socket *sock;
+  nng_aio *aio;
+  nng_msg *msg;
+  nng_msg **held;
+  SEXP data;
+  SEXP hook;
+  size_t size;
+  size_t cur;
+  uint32_t seq;
+  int last;
+  int xc;
+} nano_chunk;
+
+typedef R_xlen_t (*nano_serial_fn)(SEXP, void (*)(void *, const void *, R_xlen_t), void *);
+typedef int (*nano_dispatch_fn)(const unsigned char *, R_xlen_t, void (*)(void *, const void *, R_xlen_t), void *);
+typedef SEXP (*nano_unserial_fn)(R_xlen_t, void (*)(void *, void *, R_xlen_t), void *);
+
+typedef struct nano_serial_tab_s {
+  int n;
+  int mask;
+  int native;
+  int *slots;
+  uint64_t *hashes;
+  nano_serial_fn *sfn;
+  nano_unserial_fn *ufn;
+} nano_serial_tab;
+
 typedef struct nano_serial_bundle_s {
   R_outpstream_t outpstream;
   R_inpstream_t inpstream;
   SEXP klass;
   SEXP hook_func;
+  nano_serial_tab *tab;
 } nano_serial_bundle;
 
 typedef enum nano_list_op {
@@ -240,18 +468,15 @@ typedef enum nano_list_op {
   SHUTDOWN
 } nano_list_op;
 
-typedef struct nano_node_s {
-  void *data;
-  struct nano_node_s *next;
-} nano_node;
-
 extern void (*eln2)(void (*)(void *), void *, double, int);
+extern nano_hist nano_http_hist;
 
 extern SEXP nano_AioSymbol;
 extern SEXP nano_ContextSymbol;
 extern SEXP nano_CvSymbol;
 extern SEXP nano_DataSymbol;
 extern SEXP nano_DialerSymbol;
+extern SEXP nano_DispatcherSymbol;
 extern SEXP nano_DotcallSymbol;
 extern SEXP nano_HeadersSymbol;
 extern SEXP nano_IdSymbol;
@@ -259,9 +484,11 @@ extern SEXP nano_ListenerSymbol;
 extern SEXP nano_MonitorSymbol;
 extern SEXP nano_MsgidSymbol;
 extern SEXP nano_ProtocolSymbol;
+extern SEXP nano_QueueSymbol;
 extern SEXP nano_ResolveSymbol;
 extern SEXP nano_ResponseSymbol;
 extern SEXP nano_ResultSymbol;
+extern SEXP nano_ServerSymbol;
 extern SEXP nano_SocketSymbol;
 extern SEXP nano_StateSymbol;
 extern SEXP nano_StatusSymbol;
@@ -294,35 +521,92 @@ void listener_finalizer(SEXP);
 void socket_finalizer(SEXP);
 void later2(void (*)(void *), void *);
 void raio_invoke_cb(void *);
+void haio_invoke_cb(void *);
+void nano_later(nano_aio *, void (*)(void *), void *);
 int nano_integer(const SEXP);
 SEXP mk_error(const int);
 SEXP mk_error_data(const int);
 SEXP nano_raw_char(const unsigned char *, const size_t);
-void nano_serialize(nano_buf *, const SEXP, SEXP);
+int nano_serialize_msg(nng_msg **, const SEXP, SEXP, size_t, size_t *, const int);
+SEXP nano_serialize_chunked(void *);
+SEXP nano_unserialize_chunked(void *);
+int nano_chunk_send(nano_chunk *);
+int nano_chunk_recv(nano_chunk *);
+int nano_chunk_frame(nano_chunk *);
+size_t nano_size_hint(const SEXP);
 SEXP nano_unserialize(unsigned char *, const size_t, SEXP);
 SEXP nano_decode(unsigned char *, const size_t, const uint8_t, SEXP);
+SEXP nano_decode_msg(nng_msg **, const uint8_t, SEXP);
+void nano_msg_free(nng_msg *);
+void nano_msg_drop(nng_msg *);
+void nano_shm_mark(nng_msg *);
+void nano_shm_accept(int *, const int);
+void nano_shm_free(void);
 void nano_encode(nano_buf *, const SEXP);
+unsigned nano_encode_iov(nng_iov *, const SEXP);
+int nano_encode_msg(nng_msg **, const SEXP);
+int nano_encode_prefixed(nng_msg **, const SEXP);
+int nano_encode_data(nng_msg **, const SEXP, const int, SEXP, size_t, size_t *, const size_t, const int);
 int nano_encode_mode(const SEXP);
 int nano_matcharg(const SEXP);
+DL_FUNC nano_callable(SEXP);
 
 void pipe_cb_signal(nng_pipe, nng_pipe_ev, void *);
+void nano_cv_wake(nano_cv *);
+void nano_cv_any_free(void);
+void nano_route_event(nng_pipe, nng_pipe_ev);
+int nano_route_pick(const int, nng_msg *);
+void nano_route_ack(nng_msg *);
+void nano_route_undo(nng_msg *);
+void nano_route_free(void);
+int nano_route_track(nng_socket);
+int nano_route_all(const int, int (*)(nng_pipe));
+void nano_conflate_event(nng_pipe, nng_pipe_ev);
+int nano_conflate_put(const int, nng_msg *);
+void nano_conflate_free(void);
+void nano_pipe_hook_free(void);
+void nano_socket_release(const int);
 void tls_finalizer(SEXP);
 
+void nano_altrep_init(DllInfo *);
 void nano_list_do(nano_list_op, nano_aio *);
-void nano_thread_shutdown(void);
+void nano_wait_signal(void);
+int nano_thread_create(nng_thread **, void (*)(void *), void *);
+void nano_thread_init(void);
+void nano_http_pool_free(void);
+int nano_tls_host(nng_tls_config **, SEXP, const char *);
+void nano_tls_cache_free(void);
+void nano_rng_free(void);
+void nano_stats_free(void);
+int nano_serial_match(nano_serial_tab *, SEXP, SEXP);
+uint64_t nano_hrtime(void);
+uint64_t nano_hist_start(nano_hist *);
+void nano_hist_arm(nano_aio *, nano_hist *);
+void nano_hist_record(nano_hist *, const int, const uint64_t);
+void nano_hist_summary(nano_hist_series *, double *, const int, const int);
+void nano_hist_free(void);
+nano_queue_node *nano_queue_node_alloc(SEXP);
+void nano_queue_bind(nano_queue_node *, SEXP, SEXP);
+void nano_queue_push(nano_queue_node *);
 
 SEXP rnng_advance_rng_state(void);
 SEXP rnng_aio_call(SEXP);
+SEXP rnng_aio_call_safe(SEXP);
 SEXP rnng_aio_collect(SEXP);
 SEXP rnng_aio_collect_safe(SEXP);
 SEXP rnng_aio_get_msg(SEXP);
 SEXP rnng_aio_http_data(SEXP);
 SEXP rnng_aio_http_headers(SEXP);
 SEXP rnng_aio_http_status(SEXP);
+SEXP rnng_aio_pool(SEXP);
+SEXP rnng_aio_race(SEXP);
 SEXP rnng_aio_result(SEXP);
 SEXP rnng_aio_stop(SEXP);
+SEXP rnng_bench(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_clock(void);
 SEXP rnng_close(SEXP);
+SEXP rnng_compress_config(SEXP, SEXP);
+SEXP rnng_conflate(SEXP, SEXP, SEXP);
 SEXP rnng_ctx_close(SEXP);
 SEXP rnng_ctx_create(SEXP);
 SEXP rnng_ctx_open(SEXP);
@@ -333,20 +617,32 @@ SEXP rnng_cv_until(SEXP, SEXP);
 SEXP rnng_cv_until_safe(SEXP, SEXP);
 SEXP rnng_cv_value(SEXP);
 SEXP rnng_cv_wait(SEXP);
+SEXP rnng_cv_wait_any(SEXP, SEXP, SEXP);
 SEXP rnng_cv_wait_safe(SEXP);
 SEXP rnng_dial(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_dialer_close(SEXP);
 SEXP rnng_dialer_start(SEXP, SEXP);
+SEXP rnng_dispatch(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_dispatcher_close(SEXP);
+SEXP rnng_dispatcher_create(SEXP, SEXP);
 SEXP rnng_eval_safe(SEXP);
 SEXP rnng_fini(void);
 SEXP rnng_fini_priors(void);
 SEXP rnng_get_opt(SEXP, SEXP);
 SEXP rnng_header_read(SEXP);
 SEXP rnng_header_set(SEXP);
+SEXP rnng_http_pool(SEXP, SEXP);
+SEXP rnng_http_route(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_http_serve(SEXP, SEXP, SEXP);
+SEXP rnng_http_server_close(SEXP);
+SEXP rnng_http_server_create(SEXP, SEXP);
+SEXP rnng_http_static(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_interrupt_switch(SEXP);
 SEXP rnng_ip_addr(void);
 SEXP rnng_is_error_value(SEXP);
 SEXP rnng_is_nul_byte(SEXP);
+SEXP rnng_latency(SEXP, SEXP, SEXP);
+SEXP rnng_later_batch(SEXP);
 SEXP rnng_listen(SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_listener_close(SEXP);
 SEXP rnng_listener_start(SEXP);
@@ -356,44 +652,54 @@ SEXP rnng_messenger(SEXP);
 SEXP rnng_messenger_thread_create(SEXP);
 SEXP rnng_monitor_create(SEXP, SEXP);
 SEXP rnng_monitor_read(SEXP);
-SEXP rnng_ncurl(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_ncurl(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_ncurl_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_ncurl_aio_bulk(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_ncurl_session(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_ncurl_session_close(SEXP);
 SEXP rnng_ncurl_transact(SEXP);
 SEXP rnng_pipe_notify(SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_pipe_route(SEXP, SEXP);
 SEXP rnng_protocol_open(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-SEXP rnng_random(SEXP, SEXP);
+SEXP rnng_queue_alloc(void);
+SEXP rnng_queue_drain(SEXP, SEXP);
+SEXP rnng_random(SEXP, SEXP, SEXP);
 SEXP rnng_read_stdin(SEXP);
 SEXP rnng_reap(SEXP);
 SEXP rnng_recv(SEXP, SEXP, SEXP, SEXP);
-SEXP rnng_recv_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-SEXP rnng_request(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
-SEXP rnng_send(SEXP, SEXP, SEXP, SEXP, SEXP);
-SEXP rnng_send_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_recv_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_recv_aio_batch(SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_recv_chunked(SEXP, SEXP);
+SEXP rnng_recv_frame(SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_request(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_send(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_send_aio(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_send_aio_batch(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP rnng_send_chunked(SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_serial_config(SEXP, SEXP, SEXP);
+SEXP rnng_serial_test(SEXP);
 SEXP rnng_set_opt(SEXP, SEXP, SEXP);
 SEXP rnng_set_promise_context(SEXP, SEXP);
+SEXP rnng_shm_config(SEXP, SEXP, SEXP);
 SEXP rnng_signal_thread_create(SEXP, SEXP);
+SEXP rnng_size_hint(SEXP);
 SEXP rnng_sleep(SEXP);
 SEXP rnng_stats_get(SEXP, SEXP);
+SEXP rnng_stats_snapshot(SEXP, SEXP, SEXP);
 SEXP rnng_status_code(SEXP);
 SEXP rnng_stream_close(SEXP);
 SEXP rnng_stream_open(SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_strerror(SEXP);
 SEXP rnng_subscribe(SEXP, SEXP, SEXP);
+SEXP rnng_tls_cache(SEXP);
 SEXP rnng_tls_config(SEXP, SEXP, SEXP, SEXP);
 SEXP rnng_traverse_precious(void);
 SEXP rnng_unresolved(SEXP);
 SEXP rnng_unresolved2(SEXP);
 SEXP rnng_url_parse(SEXP);
 SEXP rnng_version(void);
-SEXP rnng_wait_thread_create(SEXP);
 SEXP rnng_write_cert(SEXP, SEXP);
 SEXP rnng_write_stdout(SEXP);
+SEXP rnng_zerocopy_switch(SEXP);
 
 #endif
-
-#praveen🍉
-
-SEXP rnng_http_echo_server(SEXP);
\ No newline at end of file
@@ -3,6 +3,8 @@
 #define NANONEXT_HTTP
 #include "nanonext.h"
 
+#define NANO_HTTP_BUFSIZE 65536
+
 // internals -------------------------------------------------------------------
 
 static SEXP mk_error_haio(const int xc, SEXP env) {
@@ -60,27 +62,535 @@ static nano_buf nano_char_buf(const SEXP data) {
 
 }
 
-// aio completion callbacks ----------------------------------------------------
+// the body is copied if copy is set, as for requests that may still be sent
+// once the R object holding it is no longer referenced
+static int nano_http_req_init(nng_http_req *req, const char *mthd, SEXP headers, SEXP data, const int copy) {
 
-static void haio_invoke_cb(void *arg) {
+  int xc = 0;
+  if (mthd != NULL && (xc = nng_http_req_set_method(req, mthd)))
+    return xc;
 
-  SEXP call, status, node = (SEXP) arg, x = TAG(node);
-  status = rnng_aio_http_status(x);
-  PROTECT(call = Rf_lcons(nano_ResolveSymbol, Rf_cons(status, R_NilValue)));
-  Rf_eval(call, NANO_ENCLOS(x));
-  UNPROTECT(1);
-  nano_ReleaseObject(node);
+  if (headers != R_NilValue && TYPEOF(headers) == STRSXP) {
+    const R_xlen_t hlen = XLENGTH(headers);
+    SEXP hnames = Rf_getAttrib(headers, R_NamesSymbol);
+    if (TYPEOF(hnames) == STRSXP && XLENGTH(hnames) == hlen) {
+      for (R_xlen_t i = 0; i < hlen; i++) {
+        if ((xc = nng_http_req_set_header(req, NANO_STR_N(hnames, i), NANO_STR_N(headers, i))))
+          return xc;
+      }
+    }
+  }
+  if (data != R_NilValue && TYPEOF(data) == STRSXP) {
+    nano_buf enc = nano_char_buf(data);
+    xc = copy ? nng_http_req_copy_data(req, enc.buf, enc.cur) : nng_http_req_set_data(req, enc.buf, enc.cur);
+  }
+
+  return xc;
+
+}
+
+static SEXP nano_http_headers(nng_http_res *res, SEXP response) {
+
+  int chk_resp = response != R_NilValue && TYPEOF(response) == STRSXP;
+  const uint16_t code = nng_http_res_get_status(res), relo = code >= 300 && code < 400;
+  SEXP rvec;
+
+  if (relo) {
+    if (chk_resp) {
+      const R_xlen_t rlen = XLENGTH(response);
+      PROTECT(response = Rf_xlengthgets(response, rlen + 1));
+      SET_STRING_ELT(response, rlen, Rf_mkChar("Location"));
+    } else {
+      PROTECT(response = Rf_mkString("Location"));
+      chk_resp = 1;
+    }
+  }
+
+  if (chk_resp) {
+    const R_xlen_t rlen = XLENGTH(response);
+    PROTECT(rvec = Rf_allocVector(VECSXP, rlen));
+    Rf_namesgets(rvec, response);
+    for (R_xlen_t i = 0; i < rlen; i++) {
+      const char *r = nng_http_res_get_header(res, NANO_STR_N(response, i));
+      SET_VECTOR_ELT(rvec, i, r == NULL ? R_NilValue : Rf_mkString(r));
+    }
+    UNPROTECT(1);
+  } else {
+    rvec = R_NilValue;
+  }
+  if (relo) UNPROTECT(1);
+
+  return rvec;
+
+}
+
+static SEXP nano_http_body(nng_http_res *res, const int convert) {
+
+  void *dat;
+  size_t sz;
+  SEXP vec;
+  nng_http_res_get_data(res, &dat, &sz);
+
+  if (convert) {
+    vec = nano_raw_char(dat, sz);
+  } else {
+    vec = Rf_allocVector(RAWSXP, sz);
+    if (dat != NULL)
+      memcpy(NANO_DATAPTR(vec), dat, sz);
+  }
+
+  return vec;
+
+}
+
+// connection pool -------------------------------------------------------------
+
+static nng_mtx *nano_http_mtx = NULL;
+static nano_http_host *nano_http_hosts = NULL;
+static int nano_http_max = 8;
+static int nano_http_timeout = 30000;
+static double nano_http_hits = 0;
+static double nano_http_misses = 0;
+
+static int nano_http_token(const char *s, const char *token) {
+
+  const size_t n = strlen(token);
+  for (; *s; s++) {
+    size_t i = 0;
+    while (i < n && (s[i] | 0x20) == token[i]) i++;
+    if (i == n) return 1;
+  }
+  return 0;
+
+}
+
+static int nano_http_reusable(nng_http_req *req, nng_http_res *res) {
+
+  const char *conn = nng_http_req_get_header(req, "Connection");
+  if (conn != NULL && nano_http_token(conn, "close"))
+    return 0;
+  conn = nng_http_res_get_header(res, "Connection");
+  if (conn != NULL && nano_http_token(conn, "close"))
+    return 0;
+  if (!strcmp(nng_http_res_get_version(res), "HTTP/1.0") &&
+      (conn == NULL || !nano_http_token(conn, "keep-alive")))
+    return 0;
+
+  return nng_http_res_get_header(res, "Content-Length") != NULL ||
+    nng_http_res_get_header(res, "Transfer-Encoding") != NULL;
+
+}
+
+// only requests that are safe to repeat are retried on a new connection, as a
+// failed transaction may already have been acted upon by the server
+static int nano_http_idempotent(nng_http_req *req) {
+
+  const char *method = nng_http_req_get_method(req);
+  return !strcmp(method, "GET") || !strcmp(method, "HEAD") || !strcmp(method, "OPTIONS") ||
+    !strcmp(method, "PUT") || !strcmp(method, "DELETE") || !strcmp(method, "TRACE");
+
+}
+
+static void nano_http_idle_free(nano_http_idle *item) {
+
+  while (item != NULL) {
+    nano_http_idle *next = item->next;
+    nng_http_conn_close(item->conn);
+    free(item);
+    item = next;
+  }
+
+}
+
+static void nano_http_host_free(nano_http_host *h) {
+
+  if (h->cfg != NULL)
+    nng_tls_config_free(h->cfg);
+  if (h->cli != NULL)
+    nng_http_client_free(h->cli);
+  free(h->scheme);
+  free(h);
+
+}
+
+// must be called with nano_http_mtx held
+static nano_http_host *nano_http_host_find(const nng_url *url, const nng_tls_config *key) {
+
+  nano_http_host *h;
+  for (h = nano_http_hosts; h != NULL; h = h->next) {
+    if (h->tls == key && !strcmp(h->host, url->u_hostname) &&
+        !strcmp(h->port, url->u_port) && !strcmp(h->scheme, url->u_scheme))
+      break;
+  }
+  return h;
+
+}
+
+static int nano_http_host_get(nano_http_host **host, const nng_url *url, SEXP tls) {
+
+  const int https = !strcmp(url->u_scheme, "https");
+  nng_tls_config *key = https && tls != R_NilValue ? (nng_tls_config *) NANO_PTR(tls) : NULL;
+  nano_http_host *h, *found;
+  int xc;
+
+  if (nano_http_mtx == NULL && (xc = nng_mtx_alloc(&nano_http_mtx)))
+    return xc;
+
+  nng_mtx_lock(nano_http_mtx);
+  h = nano_http_host_find(url, key);
+  nng_mtx_unlock(nano_http_mtx);
+  if (h != NULL) {
+    *host = h;
+    return 0;
+  }
+
+  const size_t slen = strlen(url->u_scheme) + 1, hlen = strlen(url->u_hostname) + 1;
+  if ((h = calloc(1, sizeof(nano_http_host))) == NULL ||
+      (h->scheme = malloc(slen + hlen + strlen(url->u_port) + 1)) == NULL) {
+    free(h);
+    return 2;
+  }
+  h->host = h->scheme + slen;
+  h->port = h->host + hlen;
+  memcpy(h->scheme, url->u_scheme, slen);
+  memcpy(h->host, url->u_hostname, hlen);
+  strcpy(h->port, url->u_port);
+  h->tls = key;
+
+  if ((xc = nng_http_client_alloc(&h->cli, url)))
+    goto fail;
+
+  if (https &&
+      ((xc = nano_tls_host(&h->cfg, tls, url->u_hostname)) ||
+      (xc = nng_http_client_set_tls(h->cli, h->cfg))))
+    goto fail;
+
+  // the host is looked up again and inserted under the same lock, so that
+  // concurrent first requests share a single entry
+  nng_mtx_lock(nano_http_mtx);
+  if ((found = nano_http_host_find(url, key)) == NULL) {
+    h->next = nano_http_hosts;
+    nano_http_hosts = h;
+  }
+  nng_mtx_unlock(nano_http_mtx);
+
+  if (found != NULL) {
+    nano_http_host_free(h);
+    h = found;
+  }
+
+  *host = h;
+  return 0;
+
+  fail:
+  nano_http_host_free(h);
+  return xc;
 
 }
 
+// returns 2 if an idle connection was reused, 1 if a new pooled connection is
+// to be made, or 0 for a one-off connection if the pool is at capacity
+static int nano_http_acquire(nano_http_host *h, nng_http_conn **conn) {
+
+  nano_http_idle *item, *stale = NULL;
+  const nng_time now = nng_clock();
+  int state = 0;
+
+  nng_mtx_lock(nano_http_mtx);
+  while ((item = h->idle) != NULL) {
+    h->idle = item->next;
+    if (now - item->since < (nng_time) nano_http_timeout) {
+      *conn = item->conn;
+      free(item);
+      state = 2;
+      break;
+    }
+    item->next = stale;
+    stale = item;
+    h->open--;
+  }
+  if (state) {
+    nano_http_hits++;
+  } else {
+    nano_http_misses++;
+    if (h->open < nano_http_max) {
+      h->open++;
+      state = 1;
+    }
+  }
+  nng_mtx_unlock(nano_http_mtx);
+
+  nano_http_idle_free(stale);
+  return state;
+
+}
+
+static void nano_http_release(nano_http_host *h, nng_http_conn *conn, const int reuse) {
+
+  nano_http_idle *item = NULL;
+  if (reuse && (item = malloc(sizeof(nano_http_idle))) != NULL) {
+    item->conn = conn;
+    item->since = nng_clock();
+  }
+
+  nng_mtx_lock(nano_http_mtx);
+  if (item != NULL && h->open <= nano_http_max && nano_http_timeout > 0) {
+    item->next = h->idle;
+    h->idle = item;
+    item = NULL;
+    conn = NULL;
+  } else {
+    h->open--;
+  }
+  nng_mtx_unlock(nano_http_mtx);
+
+  free(item);
+  if (conn != NULL)
+    nng_http_conn_close(conn);
+
+}
+
+static void nano_http_deadline(nng_aio *aio, const nng_time expire) {
+
+  if (expire)
+    nng_aio_set_expire(aio, expire);
+
+}
+
+static void nano_http_begin(nano_handle *handle, nng_aio *aio, const nng_duration dur) {
+
+  nano_http_host *h = handle->host;
+  handle->expire = dur > 0 ? nng_clock() + dur : 0;
+  handle->start = nano_hist_start(&nano_http_hist);
+  nng_aio_set_timeout(aio, dur);
+  nano_http_deadline(aio, handle->expire);
+
+  switch ((handle->state = nano_http_acquire(h, &handle->conn))) {
+  case 0:
+    nng_http_client_transact(h->cli, handle->req, handle->res, aio);
+    break;
+  case 1:
+    nng_http_client_connect(h->cli, aio);
+    break;
+  default:
+    nng_http_conn_transact(handle->conn, handle->req, handle->res, aio);
+  }
+
+}
+
+// advances a pooled transaction upon completion of each step, returning 1 if
+// a further step has been started, or 0 once the transaction is complete
+static int nano_http_continue(nano_handle *handle, nng_aio *aio, const int res) {
+
+  nano_http_host *h = handle->host;
+
+  switch (handle->state) {
+  case 0:
+    return 0;
+  case 1:
+    if (res) {
+      nano_http_release(h, NULL, 0);
+      handle->state = 0;
+      return 0;
+    }
+    handle->conn = nng_aio_get_output(aio, 0);
+    handle->state = 3;
+    nano_http_deadline(aio, handle->expire);
+    nng_http_conn_transact(handle->conn, handle->req, handle->res, aio);
+    return 1;
+  default:
+    if (res && handle->state == 2 && res != NNG_ETIMEDOUT && res != NNG_ECANCELED && res != NNG_ECLOSED &&
+        nano_http_idempotent(handle->req)) {
+      // idle connection closed by the server: retry once on a new connection
+      nng_http_conn_close(handle->conn);
+      handle->conn = NULL;
+      handle->state = 1;
+      nano_http_deadline(aio, handle->expire);
+      nng_http_client_connect(h->cli, aio);
+      return 1;
+    }
+    nano_http_release(h, handle->conn, !res && nano_http_reusable(handle->req, handle->res));
+    handle->conn = NULL;
+    handle->state = 0;
+    return 0;
+  }
+
+}
+
+static int nano_http_transact(nano_handle *handle, nng_aio *aio, const nng_duration dur) {
+
+  int xc;
+  nano_http_begin(handle, aio, dur);
+  do {
+    nng_aio_wait(aio);
+    xc = nng_aio_result(aio);
+  } while (nano_http_continue(handle, aio, xc));
+  if (!xc)
+    nano_hist_record(&nano_http_hist, 0, handle->start);
+
+  return xc;
+
+}
+
+static void nano_http_trim(void) {
+
+  nano_http_idle *stale = NULL;
+  const nng_time now = nng_clock();
+
+  nng_mtx_lock(nano_http_mtx);
+  for (nano_http_host *h = nano_http_hosts; h != NULL; h = h->next) {
+    nano_http_idle **prev = &h->idle, *item;
+    while ((item = *prev) != NULL) {
+      if (h->open > nano_http_max || now - item->since >= (nng_time) nano_http_timeout) {
+        *prev = item->next;
+        item->next = stale;
+        stale = item;
+        h->open--;
+      } else {
+        prev = &item->next;
+      }
+    }
+  }
+  nng_mtx_unlock(nano_http_mtx);
+
+  nano_http_idle_free(stale);
+
+}
+
+// called on unload: frees every host, including those with connections still
+// open, as no transaction may complete once the library is unloaded
+
+void nano_http_pool_free(void) {
+
+  if (nano_http_mtx == NULL) return;
+
+  nano_http_host *h;
+  nng_mtx_lock(nano_http_mtx);
+  h = nano_http_hosts;
+  nano_http_hosts = NULL;
+  nng_mtx_unlock(nano_http_mtx);
+
+  while (h != NULL) {
+    nano_http_host *next = h->next;
+    nano_http_idle_free(h->idle);
+    nano_http_host_free(h);
+    h = next;
+  }
+
+  nng_mtx_free(nano_http_mtx);
+  nano_http_mtx = NULL;
+
+}
+
+// bulk transactions - a fixed number of child aios are in flight at any time,
+// each completion starting the next, with the aggregate finishing on the last
+
+static void nano_http_bulk_start(nano_http_bulk *bulk, const int i) {
+
+  nng_aio *aio = bulk->aios[i].aio;
+  nano_http_begin(&bulk->handles[i], aio, bulk->dur);
+
+  nng_mtx_lock(bulk->mtx);
+  const int stopped = bulk->stopped;
+  nng_mtx_unlock(bulk->mtx);
+  if (stopped)
+    nng_aio_cancel(aio);
+
+}
+
+// takes the next transaction to start with the mutex held, skipping those that
+// failed at setup and so have no aio, or returns -1 if none remain
+static int nano_http_bulk_take(nano_http_bulk *bulk) {
+
+  while (!bulk->stopped && bulk->next < bulk->n) {
+    const int i = bulk->next++;
+    if (bulk->aios[i].aio != NULL)
+      return i;
+  }
+  return -1;
+
+}
+
+static void nano_http_bulk_next(nano_http_bulk *bulk) {
+
+  nng_mtx_lock(bulk->mtx);
+  const int i = nano_http_bulk_take(bulk);
+  const int last = --bulk->pending == 0;
+  nng_mtx_unlock(bulk->mtx);
+
+  if (i >= 0)
+    nano_http_bulk_start(bulk, i);
+  if (last)
+    nng_aio_finish(bulk->agg->aio, 0);
+
+}
+
+static void nano_http_bulk_cancel(nng_aio *aio, void *arg, int rv) {
+
+  nano_http_bulk *bulk = (nano_http_bulk *) arg;
+
+  nng_mtx_lock(bulk->mtx);
+  bulk->stopped = 1;
+  const int started = bulk->next;
+  for (int i = started; i < bulk->n; i++) {
+    if (bulk->aios[i].aio == NULL) continue;
+    bulk->aios[i].result = rv;
+    bulk->pending--;
+  }
+  bulk->next = bulk->n;
+  const int last = bulk->pending == 0;
+  nng_mtx_unlock(bulk->mtx);
+
+  for (int i = 0; i < started; i++) {
+    if (bulk->aios[i].aio != NULL)
+      nng_aio_cancel(bulk->aios[i].aio);
+  }
+  if (last)
+    nng_aio_finish(aio, 0);
+
+}
+
+static void nano_http_bulk_free(nano_http_bulk *bulk) {
+
+  for (int i = 0; i < bulk->n; i++) {
+    nano_handle *handle = &bulk->handles[i];
+    nng_aio_free(bulk->aios[i].aio);
+    if (handle->state)
+      nano_http_release(handle->host, handle->conn, 0);
+    if (handle->res != NULL)
+      nng_http_res_free(handle->res);
+    if (handle->req != NULL)
+      nng_http_req_free(handle->req);
+    nng_url_free(handle->url);
+  }
+  nng_mtx_free(bulk->mtx);
+  free(bulk->handles);
+  free(bulk->aios);
+  free(bulk);
+
+}
+
+// aio completion callbacks ----------------------------------------------------
+
 static void haio_complete(void *arg) {
 
   nano_aio *haio = (nano_aio *) arg;
   const int res = nng_aio_result(haio->aio);
+  nano_handle *handle = (nano_handle *) haio->next;
+  if (nano_http_continue(handle, haio->aio, res))
+    return;
+  if (!res)
+    nano_hist_record(&nano_http_hist, 0, handle->start);
   haio->result = res - !res;
 
+  if (handle->bulk != NULL && handle->bulk->agg != haio) {
+    nano_http_bulk_next(handle->bulk);
+    return;
+  }
+  nano_wait_signal();
+
   if (haio->cb != NULL)
-    later2(haio_invoke_cb, haio->cb);
+    nano_later(haio, haio_invoke_cb, haio->cb);
 
 }
 
@@ -100,11 +610,12 @@ static void haio_finalizer(SEXP xptr) {
   nano_aio *xp = (nano_aio *) NANO_PTR(xptr);
   nano_handle *handle = (nano_handle *) xp->next;
   nng_aio_free(xp->aio);
-  if (handle->cfg != NULL)
-    nng_tls_config_free(handle->cfg);
+  if (handle->bulk != NULL)
+    nano_http_bulk_free(handle->bulk);
+  if (handle->state)
+    nano_http_release(handle->host, handle->conn, 0);
   nng_http_res_free(handle->res);
   nng_http_req_free(handle->req);
-  nng_http_client_free(handle->cli);
   nng_url_free(handle->url);
   free(handle);
   free(xp);
@@ -130,103 +641,376 @@ static void session_finalizer(SEXP xptr) {
 
 }
 
+// streaming - request and response bodies are transferred in fixed-size
+// chunks on the R thread, so that memory use is independent of payload size
+
+typedef struct nano_http_stream_s {
+  nano_handle *handle;
+  nng_aio *aio;
+  nng_duration dur;
+  SEXP upload;
+  SEXP output;
+  FILE *fp;
+  unsigned char *buf;
+  unsigned char *acc;
+  size_t pos;
+  size_t len;
+  size_t accsz;
+  double total;
+  int follow;
+  int xc;
+  int done;
+} nano_http_stream;
+
+static int nano_http_wait(nano_http_stream *st) {
+
+  nng_aio_wait(st->aio);
+  return nng_aio_result(st->aio);
+
+}
+
+static void nano_http_stream_close(nano_handle *handle, const int reuse) {
+
+  if (handle->conn == NULL) return;
+  if (handle->state) {
+    nano_http_release(handle->host, handle->conn, reuse);
+  } else {
+    nng_http_conn_close(handle->conn);
+  }
+  handle->conn = NULL;
+  handle->state = 0;
+
+}
+
+static int nano_http_fill(nano_http_stream *st) {
+
+  int xc;
+  nng_iov iov;
+  iov.iov_buf = st->buf;
+  iov.iov_len = NANO_HTTP_BUFSIZE;
+  nng_aio_set_iov(st->aio, 1, &iov);
+  nano_http_deadline(st->aio, st->handle->expire);
+  nng_http_conn_read(st->handle->conn, st->aio);
+  if ((xc = nano_http_wait(st)))
+    return xc;
+  st->pos = 0;
+  st->len = nng_aio_count(st->aio);
+  return 0;
+
+}
+
+static void nano_http_sink(nano_http_stream *st, const unsigned char *p, const size_t n) {
+
+  if (st->output == R_NilValue) {
+    if (st->total + n > st->accsz) {
+      size_t sz = st->accsz ? st->accsz : NANO_HTTP_BUFSIZE;
+      while (sz < st->total + n) sz += sz;
+      unsigned char *acc = realloc(st->acc, sz);
+      if (acc == NULL)
+        Rf_error("memory allocation failed");
+      st->acc = acc;
+      st->accsz = sz;
+    }
+    memcpy(st->acc + (size_t) st->total, p, n);
+  } else if (TYPEOF(st->output) == STRSXP) {
+    if (st->fp == NULL &&
+        (st->fp = fopen(R_ExpandFileName(CHAR(STRING_ELT(st->output, 0))), "wb")) == NULL)
+      Rf_error("`output` file could not be opened for writing");
+    if (fwrite(p, 1, n, st->fp) != n)
+      Rf_error("write to `output` file failed");
+  } else {
+    SEXP chunk, call;
+    PROTECT(chunk = Rf_allocVector(RAWSXP, n));
+    memcpy(NANO_DATAPTR(chunk), p, n);
+    PROTECT(call = Rf_lang2(st->output, chunk));
+    Rf_eval(call, R_GlobalEnv);
+    UNPROTECT(2);
+  }
+  st->total += n;
+
+}
+
+// transfers len bytes of the body (or until the connection closes if eof)
+static int nano_http_read_body(nano_http_stream *st, uint64_t len, const int drain, const int eof) {
+
+  int xc;
+  while (len) {
+    if (st->pos == st->len && (xc = nano_http_fill(st)))
+      return eof && (xc == NNG_ECLOSED || xc == NNG_ECONNSHUT) ? 0 : xc;
+    size_t n = st->len - st->pos;
+    if (n > len) n = (size_t) len;
+    if (!drain)
+      nano_http_sink(st, st->buf + st->pos, n);
+    st->pos += n;
+    len -= n;
+  }
+  return 0;
+
+}
+
+static int nano_http_read_line(nano_http_stream *st, char *line, const size_t max) {
+
+  int xc;
+  size_t i = 0;
+  for (;;) {
+    if (st->pos == st->len && (xc = nano_http_fill(st)))
+      return xc;
+    const char c = (char) st->buf[st->pos++];
+    if (c == '\n') break;
+    if (c != '\r' && i < max - 1)
+      line[i++] = c;
+  }
+  line[i] = '\0';
+  return 0;
+
+}
+
+static int nano_http_read_chunked(nano_http_stream *st, const int drain) {
+
+  char line[128], *end;
+  int xc;
+  for (;;) {
+    if ((xc = nano_http_read_line(st, line, sizeof(line))))
+      return xc;
+    const uint64_t sz = (uint64_t) strtoull(line, &end, 16);
+    if (end == line)
+      return NNG_EPROTO;
+    if (sz == 0)
+      break;
+    if ((xc = nano_http_read_body(st, sz, drain, 0)) ||
+        (xc = nano_http_read_line(st, line, sizeof(line))))
+      return xc;
+  }
+  do {
+    if ((xc = nano_http_read_line(st, line, sizeof(line))))
+      return xc;
+  } while (line[0] != '\0');
+  return 0;
+
+}
+
+static int nano_http_write_upload(nano_http_stream *st) {
+
+  SEXP call, chunk;
+  char hdr[24];
+  nng_iov iov[3];
+  int xc = 0;
+
+  // built one cell at a time so that each allocation is made under protection
+  PROTECT_INDEX pxi;
+  PROTECT_WITH_INDEX(call = Rf_cons(Rf_ScalarInteger(NANO_HTTP_BUFSIZE), R_NilValue), &pxi);
+  REPROTECT(call = Rf_cons(Rf_mkString("raw"), call), pxi);
+  REPROTECT(call = Rf_cons(st->upload, call), pxi);
+  REPROTECT(call = Rf_lcons(Rf_install("readBin"), call), pxi);
+  for (;;) {
+    PROTECT(chunk = Rf_eval(call, R_BaseEnv));
+    if (TYPEOF(chunk) != RAWSXP)
+      Rf_error("`data` connection did not return raw bytes");
+    const size_t n = (size_t) XLENGTH(chunk);
+    snprintf(hdr, sizeof(hdr), "%lx\r\n", (unsigned long) n);
+    int niov = 0;
+    iov[niov].iov_buf = hdr;
+    iov[niov++].iov_len = strlen(hdr);
+    if (n) {
+      iov[niov].iov_buf = NANO_DATAPTR(chunk);
+      iov[niov++].iov_len = n;
+    }
+    iov[niov].iov_buf = "\r\n";
+    iov[niov++].iov_len = 2;
+    nng_aio_set_iov(st->aio, niov, iov);
+    nano_http_deadline(st->aio, st->handle->expire);
+    nng_http_conn_write_all(st->handle->conn, st->aio);
+    xc = nano_http_wait(st);
+    UNPROTECT(1);
+    if (xc || n == 0) break;
+  }
+  UNPROTECT(1);
+  return xc;
+
+}
+
+static SEXP nano_http_stream_exec(void *arg) {
+
+  nano_http_stream *st = (nano_http_stream *) arg;
+  nano_handle *handle = st->handle;
+  nano_http_host *h = handle->host;
+  nng_http_req *req = handle->req;
+  nng_http_res *res = handle->res;
+  int xc, sent = 0, reuse = 1;
+
+  st->buf = (unsigned char *) R_alloc(NANO_HTTP_BUFSIZE, sizeof(unsigned char));
+  st->pos = st->len = 0;
+  st->total = 0;
+
+  if (st->upload != R_NilValue &&
+      (xc = nng_http_req_set_header(req, "Transfer-Encoding", "chunked")))
+    goto fail;
+
+  handle->expire = st->dur > 0 ? nng_clock() + st->dur : 0;
+  nng_aio_set_timeout(st->aio, st->dur);
+  handle->state = nano_http_acquire(h, &handle->conn);
+  if (handle->state != 2) {
+    connect:
+    nano_http_deadline(st->aio, handle->expire);
+    nng_http_client_connect(h->cli, st->aio);
+    if ((xc = nano_http_wait(st))) {
+      if (handle->state)
+        nano_http_release(h, NULL, 0);
+      handle->state = 0;
+      goto fail;
+    }
+    handle->conn = nng_aio_get_output(st->aio, 0);
+  }
+
+  nano_http_deadline(st->aio, handle->expire);
+  nng_http_conn_write_req(handle->conn, req, st->aio);
+  if ((xc = nano_http_wait(st)))
+    goto retry;
+
+  if (st->upload != R_NilValue) {
+    sent = 1;
+    if ((xc = nano_http_write_upload(st)))
+      goto fail;
+  }
+
+  nano_http_deadline(st->aio, handle->expire);
+  nng_http_conn_read_res(handle->conn, res, st->aio);
+  if ((xc = nano_http_wait(st)))
+    goto retry;
+
+  const uint16_t code = nng_http_res_get_status(res);
+  const int drain = st->follow && code >= 300 && code < 400 && nng_http_res_get_header(res, "Location") != NULL;
+  const char *te = nng_http_res_get_header(res, "Transfer-Encoding");
+  const char *cl = nng_http_res_get_header(res, "Content-Length");
+
+  if (!strcmp(nng_http_req_get_method(req), "HEAD") || code < 200 || code == 204 || code == 304) {
+    xc = 0;
+  } else if (te != NULL && nano_http_token(te, "chunked")) {
+    xc = nano_http_read_chunked(st, drain);
+  } else if (cl != NULL) {
+    xc = nano_http_read_body(st, (uint64_t) strtoull(cl, NULL, 10), drain, 0);
+  } else {
+    xc = nano_http_read_body(st, UINT64_MAX, drain, 1);
+    reuse = 0;
+  }
+  if (xc)
+    goto fail;
+
+  if (st->output == R_NilValue && st->total > 0 &&
+      (xc = nng_http_res_copy_data(res, st->acc, (size_t) st->total)))
+    goto fail;
+
+  nano_http_stream_close(handle, reuse && nano_http_reusable(req, res));
+  st->xc = 0;
+  st->done = 1;
+  return R_NilValue;
+
+  retry:
+  if (handle->state == 2 && !sent && xc != NNG_ETIMEDOUT && xc != NNG_ECANCELED && xc != NNG_ECLOSED &&
+      nano_http_idempotent(req)) {
+    // idle connection closed by the server: retry once on a new connection
+    nng_http_conn_close(handle->conn);
+    handle->conn = NULL;
+    handle->state = 1;
+    goto connect;
+  }
+
+  fail:
+  nano_http_stream_close(handle, 0);
+  st->xc = xc;
+  st->done = 1;
+  return R_NilValue;
+
+}
+
+static void nano_http_stream_cleanup(void *arg) {
+
+  nano_http_stream *st = (nano_http_stream *) arg;
+  if (st->fp != NULL) {
+    fclose(st->fp);
+    st->fp = NULL;
+  }
+  free(st->acc);
+  st->acc = NULL;
+  if (st->done) return;
+
+  nano_handle *handle = st->handle;
+  nano_http_stream_close(handle, 0);
+  nng_aio_free(st->aio);
+  if (handle->res != NULL)
+    nng_http_res_free(handle->res);
+  if (handle->req != NULL)
+    nng_http_req_free(handle->req);
+  nng_url_free(handle->url);
+
+}
+
 // ncurl - minimalist http client ----------------------------------------------
 
 SEXP rnng_ncurl(SEXP http, SEXP convert, SEXP follow, SEXP method, SEXP headers,
-                SEXP data, SEXP response, SEXP timeout, SEXP tls) {
+                SEXP data, SEXP response, SEXP timeout, SEXP tls, SEXP output) {
 
   const char *addr = CHAR(STRING_ELT(http, 0));
   const char *mthd = method != R_NilValue ? CHAR(STRING_ELT(method, 0)) : NULL;
   const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
   if (tls != R_NilValue && NANO_PTR_CHECK(tls, nano_TlsSymbol))
     Rf_error("`tls` is not a valid TLS Configuration");
+  if (output != R_NilValue && TYPEOF(output) != CLOSXP &&
+      (TYPEOF(output) != STRSXP || XLENGTH(output) == 0))
+    Rf_error("`output` must be a file path or function");
+  const int upload = Rf_inherits(data, "connection");
   int chk_resp = response != R_NilValue && TYPEOF(response) == STRSXP;
 
-  nng_url *url = NULL;
-  nng_http_client *client = NULL;
-  nng_http_req *req = NULL;
-  nng_http_res *res = NULL;
+  nano_handle handle = {0};
+  nano_http_stream st = {0};
   nng_aio *aio = NULL;
-  nng_tls_config *cfg = NULL;
   uint16_t code, relo;
   int xc;
 
-  if ((xc = nng_url_parse(&url, addr)))
+  if ((xc = nng_url_parse(&handle.url, addr)) ||
+      (xc = nng_aio_alloc(&aio, NULL, NULL)))
     goto fail;
 
   relocall:
 
-  if ((xc = nng_http_client_alloc(&client, url)) ||
-      (xc = nng_http_req_alloc(&req, url)) ||
-      (xc = nng_http_res_alloc(&res)) ||
-      (xc = nng_aio_alloc(&aio, NULL, NULL)))
+  if ((xc = nano_http_host_get(&handle.host, handle.url, tls)) ||
+      (xc = nng_http_req_alloc(&handle.req, handle.url)) ||
+      (xc = nng_http_res_alloc(&handle.res)))
     goto fail;
 
-  if (mthd != NULL && (xc = nng_http_req_set_method(req, mthd)))
+  if ((xc = nano_http_req_init(handle.req, mthd, headers, data, 0)))
     goto fail;
 
-  if (headers != R_NilValue && TYPEOF(headers) == STRSXP) {
-    const R_xlen_t hlen = XLENGTH(headers);
-    SEXP hnames = Rf_getAttrib(headers, R_NamesSymbol);
-    if (TYPEOF(hnames) == STRSXP && XLENGTH(hnames) == hlen) {
-      for (R_xlen_t i = 0; i < hlen; i++) {
-        if ((xc = nng_http_req_set_header(req, NANO_STR_N(hnames, i), NANO_STR_N(headers, i))))
-          goto fail;
-      }
-    }
-  }
-  if (data != R_NilValue && TYPEOF(data) == STRSXP) {
-    nano_buf enc = nano_char_buf(data);
-    if ((xc = nng_http_req_set_data(req, enc.buf, enc.cur)))
-      goto fail;
-  }
-
-  if (!strcmp(url->u_scheme, "https")) {
-
-    if (tls == R_NilValue) {
-      if ((xc = nng_tls_config_alloc(&cfg, NNG_TLS_MODE_CLIENT)) ||
-          (xc = nng_tls_config_server_name(cfg, url->u_hostname)) ||
-          (xc = nng_tls_config_auth_mode(cfg, NNG_TLS_AUTH_MODE_NONE)) ||
-          (xc = nng_http_client_set_tls(client, cfg)))
-        goto fail;
-
-    } else {
-      cfg = (nng_tls_config *) NANO_PTR(tls);
-      nng_tls_config_hold(cfg);
-
-      if ((xc = nng_tls_config_server_name(cfg, url->u_hostname)) ||
-          (xc = nng_http_client_set_tls(client, cfg)))
-        goto fail;
-    }
-
+  if (upload || output != R_NilValue) {
+    st.handle = &handle;
+    st.aio = aio;
+    st.dur = dur;
+    st.upload = upload ? data : R_NilValue;
+    st.output = output;
+    st.follow = NANO_INTEGER(follow) && !upload;
+    st.done = 0;
+    R_ExecWithCleanup(nano_http_stream_exec, &st, nano_http_stream_cleanup, &st);
+    xc = st.xc;
+  } else {
+    xc = nano_http_transact(&handle, aio, dur);
   }
-
-  nng_aio_set_timeout(aio, dur);
-  nng_http_client_transact(client, req, res, aio);
-  nng_aio_wait(aio);
-  if ((xc = nng_aio_result(aio)))
+  if (xc)
     goto fail;
 
-  if (cfg != NULL)
-    nng_tls_config_free(cfg);
-  nng_aio_free(aio);
-
+  nng_http_res *res = handle.res;
   code = nng_http_res_get_status(res), relo = code >= 300 && code < 400;
 
-  if (relo && NANO_INTEGER(follow)) {
+  if (relo && NANO_INTEGER(follow) && !upload) {
     const char *location = nng_http_res_get_header(res, "Location");
     if (location == NULL) goto resume;
-    nng_url *oldurl = url;
-    xc = nng_url_parse(&url, location);
+    nng_url *oldurl = handle.url;
+    xc = nng_url_parse(&handle.url, location);
     if (xc) goto resume;
     nng_http_res_free(res);
-    res = NULL;
-    nng_http_req_free(req);
-    req = NULL;
-    nng_http_client_free(client);
-    client = NULL;
+    handle.res = NULL;
+    nng_http_req_free(handle.req);
+    handle.req = NULL;
     nng_url_free(oldurl);
-    cfg = NULL;
     goto relocall;
   }
 
@@ -267,36 +1051,35 @@ SEXP rnng_ncurl(SEXP http, SEXP convert, SEXP follow, SEXP method, SEXP headers,
   }
   if (relo) UNPROTECT(1);
 
-  nng_http_res_get_data(res, &dat, &sz);
-
-  if (NANO_INTEGER(convert)) {
-    vec = nano_raw_char(dat, sz);
+  if (output != R_NilValue) {
+    vec = Rf_ScalarReal(st.total);
   } else {
-    vec = Rf_allocVector(RAWSXP, sz);
-    if (dat != NULL)
-      memcpy(NANO_DATAPTR(vec), dat, sz);
+    nng_http_res_get_data(res, &dat, &sz);
+    if (NANO_INTEGER(convert)) {
+      vec = nano_raw_char(dat, sz);
+    } else {
+      vec = Rf_allocVector(RAWSXP, sz);
+      if (dat != NULL)
+        memcpy(NANO_DATAPTR(vec), dat, sz);
+    }
   }
   SET_VECTOR_ELT(out, 2, vec);
 
+  nng_aio_free(aio);
   nng_http_res_free(res);
-  nng_http_req_free(req);
-  nng_http_client_free(client);
-  nng_url_free(url);
+  nng_http_req_free(handle.req);
+  nng_url_free(handle.url);
 
   UNPROTECT(1);
   return out;
 
   fail:
-  if (cfg != NULL)
-    nng_tls_config_free(cfg);
   nng_aio_free(aio);
-  if (res != NULL)
-    nng_http_res_free(res);
-  if (req != NULL)
-    nng_http_req_free(req);
-  if (client != NULL)
-    nng_http_client_free(client);
-  nng_url_free(url);
+  if (handle.res != NULL)
+    nng_http_res_free(handle.res);
+  if (handle.req != NULL)
+    nng_http_req_free(handle.req);
+  nng_url_free(handle.url);
   return mk_error_ncurl(xc);
 
 }
@@ -326,53 +1109,130 @@ SEXP rnng_ncurl_aio(SEXP http, SEXP convert, SEXP method, SEXP headers, SEXP dat
   haio->next = handle;
 
   if ((xc = nng_url_parse(&handle->url, httr)) ||
-      (xc = nng_http_client_alloc(&handle->cli, handle->url)) ||
+      (xc = nano_http_host_get(&handle->host, handle->url, tls)) ||
       (xc = nng_http_req_alloc(&handle->req, handle->url)) ||
       (xc = nng_http_res_alloc(&handle->res)) ||
       (xc = nng_aio_alloc(&haio->aio, haio_complete, haio)))
     goto fail;
 
-  if (mthd != NULL && (xc = nng_http_req_set_method(handle->req, mthd)))
+  if ((xc = nano_http_req_init(handle->req, mthd, headers, data, 1)))
     goto fail;
 
-  if (headers != R_NilValue && TYPEOF(headers) == STRSXP) {
-    const R_xlen_t hlen = XLENGTH(headers);
-    SEXP hnames = Rf_getAttrib(headers, R_NamesSymbol);
-    if (TYPEOF(hnames) == STRSXP && XLENGTH(hnames) == hlen) {
-      for (R_xlen_t i = 0; i < hlen; i++) {
-        if ((xc = nng_http_req_set_header(handle->req, NANO_STR_N(hnames, i), NANO_STR_N(headers, i))))
-          goto fail;
-      }
+  nano_http_begin(handle, haio->aio, dur);
+
+  PROTECT(aio = R_MakeExternalPtr(haio, nano_AioSymbol, R_NilValue));
+  R_RegisterCFinalizerEx(aio, haio_finalizer, TRUE);
+
+  PROTECT(env = R_NewEnv(R_NilValue, 0, 0));
+  NANO_CLASS2(env, "ncurlAio", "recvAio");
+  Rf_defineVar(nano_AioSymbol, aio, env);
+  Rf_defineVar(nano_ResponseSymbol, response, env);
+
+  int i = 0;
+  for (SEXP fnlist = nano_aioNFuncs; fnlist != R_NilValue; fnlist = CDR(fnlist)) {
+    PROTECT(fun = R_mkClosure(R_NilValue, CAR(fnlist), clo));
+    switch (++i) {
+    case 1: R_MakeActiveBinding(nano_StatusSymbol, fun, env);
+    case 2: R_MakeActiveBinding(nano_HeadersSymbol, fun, env);
+    case 3: R_MakeActiveBinding(nano_DataSymbol, fun, env);
     }
-  }
-  if (data != R_NilValue && TYPEOF(data) == STRSXP) {
-    nano_buf enc = nano_char_buf(data);
-    if ((xc = nng_http_req_set_data(handle->req, enc.buf, enc.cur)))
-      goto fail;
+    UNPROTECT(1);
   }
 
-  if (!strcmp(handle->url->u_scheme, "https")) {
+  UNPROTECT(2);
+  return env;
 
-    if (tls == R_NilValue) {
-      if ((xc = nng_tls_config_alloc(&handle->cfg, NNG_TLS_MODE_CLIENT)) ||
-          (xc = nng_tls_config_server_name(handle->cfg, handle->url->u_hostname)) ||
-          (xc = nng_tls_config_auth_mode(handle->cfg, NNG_TLS_AUTH_MODE_NONE)) ||
-          (xc = nng_http_client_set_tls(handle->cli, handle->cfg)))
-        goto fail;
+  fail:
+  nng_aio_free(haio->aio);
+  if (handle->res != NULL)
+    nng_http_res_free(handle->res);
+  if (handle->req != NULL)
+    nng_http_req_free(handle->req);
+  nng_url_free(handle->url);
+  failmem:
+  free(handle);
+  free(haio);
+  return mk_error_ncurlaio(xc);
 
-    } else {
-      handle->cfg = (nng_tls_config *) NANO_PTR(tls);
-      nng_tls_config_hold(handle->cfg);
+}
 
-      if ((xc = nng_tls_config_server_name(handle->cfg, handle->url->u_hostname)) ||
-          (xc = nng_http_client_set_tls(handle->cli, handle->cfg)))
-        goto fail;
-    }
+SEXP rnng_ncurl_aio_bulk(SEXP http, SEXP convert, SEXP method, SEXP headers, SEXP data,
+                         SEXP response, SEXP timeout, SEXP tls, SEXP limit, SEXP clo) {
+
+  if (TYPEOF(http) != STRSXP || XLENGTH(http) == 0 || XLENGTH(http) > INT_MAX)
+    Rf_error("`url` must be a character vector");
+  const int n = (int) XLENGTH(http);
+  const int max = limit == R_NilValue ? n : nano_integer(limit);
+  if (max < 1)
+    Rf_error("`max_concurrency` must be a positive integer");
+  const char *mthd = method != R_NilValue ? CHAR(STRING_ELT(method, 0)) : NULL;
+  const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
+  if (tls != R_NilValue && NANO_PTR_CHECK(tls, nano_TlsSymbol))
+    Rf_error("`tls` is not a valid TLS Configuration");
+  const int hlist = TYPEOF(headers) == VECSXP && XLENGTH(headers) == n;
+  const R_xlen_t dlen = TYPEOF(data) == STRSXP ? XLENGTH(data) : 0;
+
+  SEXP aio, env, fun;
+  int xc, valid = 0;
+  nano_aio *haio = NULL;
+  nano_handle *handle = NULL;
+  nano_http_bulk *bulk = NULL;
+  haio = calloc(1, sizeof(nano_aio));
+  NANO_ENSURE_ALLOC(haio);
+  handle = calloc(1, sizeof(nano_handle));
+  NANO_ENSURE_ALLOC(handle);
+  bulk = calloc(1, sizeof(nano_http_bulk));
+  NANO_ENSURE_ALLOC(bulk);
+  bulk->aios = calloc(n, sizeof(nano_aio));
+  NANO_ENSURE_ALLOC(bulk->aios);
+  bulk->handles = calloc(n, sizeof(nano_handle));
+  NANO_ENSURE_ALLOC(bulk->handles);
+
+  haio->type = HTTP_AIO;
+  haio->mode = (uint8_t) NANO_INTEGER(convert);
+  haio->next = handle;
+  handle->bulk = bulk;
+  bulk->agg = haio;
+  bulk->dur = dur;
+
+  if ((xc = nng_mtx_alloc(&bulk->mtx)) ||
+      (xc = nng_aio_alloc(&haio->aio, haio_complete, haio)))
+    goto fail;
 
+  for (int i = 0; i < n; i++) {
+    nano_aio *xaio = &bulk->aios[i];
+    nano_handle *xhandle = &bulk->handles[i];
+    xaio->type = HTTP_AIO;
+    xaio->next = xhandle;
+    xhandle->bulk = bulk;
+    bulk->n = i + 1;
+    // a request that cannot be set up fails alone, without an aio
+    if ((xc = nng_url_parse(&xhandle->url, NANO_STR_N(http, i))) ||
+        (xc = nano_http_host_get(&xhandle->host, xhandle->url, tls)) ||
+        (xc = nng_http_req_alloc(&xhandle->req, xhandle->url)) ||
+        (xc = nng_http_res_alloc(&xhandle->res)) ||
+        (xc = nano_http_req_init(xhandle->req, mthd, hlist ? NANO_VECTOR(headers)[i] : headers,
+                                 dlen ? Rf_ScalarString(STRING_ELT(data, i % dlen)) : R_NilValue, 1)) ||
+        (xc = nng_aio_alloc(&xaio->aio, haio_complete, xaio))) {
+      xaio->result = xc;
+      continue;
+    }
+    valid++;
   }
 
-  nng_aio_set_timeout(haio->aio, dur);
-  nng_http_client_transact(handle->cli, handle->req, handle->res, haio->aio);
+  bulk->pending = valid;
+
+  nng_aio_begin(haio->aio);
+  nng_aio_defer(haio->aio, nano_http_bulk_cancel, bulk);
+  if (!valid)
+    nng_aio_finish(haio->aio, 0);
+  for (int i = 0; i < max; i++) {
+    nng_mtx_lock(bulk->mtx);
+    const int j = nano_http_bulk_take(bulk);
+    nng_mtx_unlock(bulk->mtx);
+    if (j < 0) break;
+    nano_http_bulk_start(bulk, j);
+  }
 
   PROTECT(aio = R_MakeExternalPtr(haio, nano_AioSymbol, R_NilValue));
   R_RegisterCFinalizerEx(aio, haio_finalizer, TRUE);
@@ -397,17 +1257,15 @@ SEXP rnng_ncurl_aio(SEXP http, SEXP convert, SEXP method, SEXP headers, SEXP dat
   return env;
 
   fail:
-  if (handle->cfg != NULL)
-    nng_tls_config_free(handle->cfg);
   nng_aio_free(haio->aio);
-  if (handle->res != NULL)
-    nng_http_res_free(handle->res);
-  if (handle->req != NULL)
-    nng_http_req_free(handle->req);
-  if (handle->cli != NULL)
-    nng_http_client_free(handle->cli);
-  nng_url_free(handle->url);
+  nano_http_bulk_free(bulk);
+  bulk = NULL;
   failmem:
+  if (bulk != NULL) {
+    free(bulk->handles);
+    free(bulk->aios);
+  }
+  free(bulk);
   free(handle);
   free(haio);
   return mk_error_ncurlaio(xc);
@@ -435,53 +1293,42 @@ static SEXP rnng_aio_http_impl(SEXP env, const int typ) {
   if (haio->result > 0)
     return mk_error_haio(haio->result, env);
 
-  void *dat;
-  size_t sz;
-  SEXP out, vec, rvec, response;
+  SEXP out, response;
   nano_handle *handle = (nano_handle *) haio->next;
+  nano_http_bulk *bulk = handle->bulk;
 
   PROTECT(response = Rf_findVarInFrame(env, nano_ResponseSymbol));
-  int chk_resp = response != R_NilValue && TYPEOF(response) == STRSXP;
-  const uint16_t code = nng_http_res_get_status(handle->res), relo = code >= 300 && code < 400;
-  Rf_defineVar(nano_ResultSymbol, Rf_ScalarInteger(code), env);
 
-  if (relo) {
-    if (chk_resp) {
-      const R_xlen_t rlen = XLENGTH(response);
-      PROTECT(response = Rf_xlengthgets(response, rlen + 1));
-      SET_STRING_ELT(response, rlen, Rf_mkChar("Location"));
-    } else {
-      PROTECT(response = Rf_mkString("Location"));
-      chk_resp = 1;
-    }
-  }
-
-  if (chk_resp) {
-    const R_xlen_t rlen = XLENGTH(response);
-    PROTECT(rvec = Rf_allocVector(VECSXP, rlen));
-    Rf_namesgets(rvec, response);
-    for (R_xlen_t i = 0; i < rlen; i++) {
-      const char *r = nng_http_res_get_header(handle->res, NANO_STR_N(response, i));
-      SET_VECTOR_ELT(rvec, i, r == NULL ? R_NilValue : Rf_mkString(r));
+  if (bulk != NULL) {
+    SEXP status, headers, data, err;
+    PROTECT(status = Rf_allocVector(INTSXP, bulk->n));
+    PROTECT(headers = Rf_allocVector(VECSXP, bulk->n));
+    PROTECT(data = Rf_allocVector(VECSXP, bulk->n));
+    for (int i = 0; i < bulk->n; i++) {
+      const int xc = bulk->aios[i].result;
+      nng_http_res *res = bulk->handles[i].res;
+      if (xc > 0) {
+        INTEGER(status)[i] = xc;
+        err = Rf_ScalarInteger(xc);
+        SET_VECTOR_ELT(headers, i, err);
+        Rf_classgets(err, nano_error);
+        SET_VECTOR_ELT(data, i, err);
+      } else {
+        INTEGER(status)[i] = nng_http_res_get_status(res);
+        SET_VECTOR_ELT(headers, i, nano_http_headers(res, response));
+        SET_VECTOR_ELT(data, i, nano_http_body(res, haio->mode));
+      }
     }
-    UNPROTECT(1);
-  } else {
-    rvec = R_NilValue;
-  }
-  if (relo) UNPROTECT(1);
-  UNPROTECT(1);
-  Rf_defineVar(nano_ProtocolSymbol, rvec, env);
-
-  nng_http_res_get_data(handle->res, &dat, &sz);
-
-  if (haio->mode) {
-    vec = nano_raw_char(dat, sz);
+    Rf_defineVar(nano_ResultSymbol, status, env);
+    Rf_defineVar(nano_ProtocolSymbol, headers, env);
+    Rf_defineVar(nano_ValueSymbol, data, env);
+    UNPROTECT(4);
   } else {
-    vec = Rf_allocVector(RAWSXP, sz);
-    if (dat != NULL)
-      memcpy(NANO_DATAPTR(vec), dat, sz);
+    Rf_defineVar(nano_ResultSymbol, Rf_ScalarInteger(nng_http_res_get_status(handle->res)), env);
+    Rf_defineVar(nano_ProtocolSymbol, nano_http_headers(handle->res, response), env);
+    Rf_defineVar(nano_ValueSymbol, nano_http_body(handle->res, haio->mode), env);
+    UNPROTECT(1);
   }
-  Rf_defineVar(nano_ValueSymbol, vec, env);
 
   Rf_defineVar(nano_AioSymbol, R_NilValue, env);
 
@@ -537,45 +1384,13 @@ SEXP rnng_ncurl_session(SEXP http, SEXP convert, SEXP method, SEXP headers, SEXP
       (xc = nng_aio_alloc(&haio->aio, session_complete, haio)))
     goto fail;
 
-  if (mthd != NULL && (xc = nng_http_req_set_method(handle->req, mthd)))
+  if ((xc = nano_http_req_init(handle->req, mthd, headers, data, 1)))
     goto fail;
 
-  if (headers != R_NilValue && TYPEOF(headers) == STRSXP) {
-    const R_xlen_t hlen = XLENGTH(headers);
-    SEXP hnames = Rf_getAttrib(headers, R_NamesSymbol);
-    if (TYPEOF(hnames) == STRSXP && XLENGTH(hnames) == hlen) {
-      for (R_xlen_t i = 0; i < hlen; i++) {
-        if ((xc = nng_http_req_set_header(handle->req, NANO_STR_N(hnames, i), NANO_STR_N(headers, i))))
-          goto fail;
-      }
-    }
-  }
-  if (data != R_NilValue && TYPEOF(data) == STRSXP) {
-    nano_buf enc = nano_char_buf(data);
-    if ((xc = nng_http_req_set_data(handle->req, enc.buf, enc.cur)))
-      goto fail;
-  }
-
-  if (!strcmp(handle->url->u_scheme, "https")) {
-
-    if (tls == R_NilValue) {
-      if ((xc = nng_tls_config_alloc(&handle->cfg, NNG_TLS_MODE_CLIENT)) ||
-          (xc = nng_tls_config_server_name(handle->cfg, handle->url->u_hostname)) ||
-          (xc = nng_tls_config_auth_mode(handle->cfg, NNG_TLS_AUTH_MODE_NONE)) ||
-          (xc = nng_http_client_set_tls(handle->cli, handle->cfg)))
-        goto fail;
-
-    } else {
-
-      handle->cfg = (nng_tls_config *) NANO_PTR(tls);
-      nng_tls_config_hold(handle->cfg);
-
-      if ((xc = nng_tls_config_server_name(handle->cfg, handle->url->u_hostname)) ||
-          (xc = nng_http_client_set_tls(handle->cli, handle->cfg)))
-        goto fail;
-    }
-
-  }
+  if (!strcmp(handle->url->u_scheme, "https") &&
+      ((xc = nano_tls_host(&handle->cfg, tls, handle->url->u_hostname)) ||
+      (xc = nng_http_client_set_tls(handle->cli, handle->cfg))))
+    goto fail;
 
   nng_aio_set_timeout(haio->aio, dur);
   nng_http_client_connect(handle->cli, haio->aio);
@@ -623,10 +1438,12 @@ SEXP rnng_ncurl_transact(SEXP session) {
 
   nng_http_conn *conn = (nng_http_conn *) haio->data;
   nano_handle *handle = (nano_handle *) haio->next;
+  const uint64_t start = nano_hist_start(&nano_http_hist);
   nng_http_conn_transact(conn, handle->req, handle->res, haio->aio);
   nng_aio_wait(haio->aio);
   if (haio->result > 0)
     return mk_error_ncurl(haio->result);
+  nano_hist_record(&nano_http_hist, 0, start);
 
   SEXP out, vec, rvec, response;
   void *dat;
@@ -686,3 +1503,52 @@ SEXP rnng_ncurl_session_close(SEXP session) {
   return nano_success;
 
 }
+
+// connection pool settings ----------------------------------------------------
+
+SEXP rnng_http_pool(SEXP max, SEXP idle) {
+
+  int vmax = nano_http_max, vidle = nano_http_timeout;
+  if (max != R_NilValue && (vmax = nano_integer(max)) < 0)
+    Rf_error("`max` must be a non-negative integer");
+  if (idle != R_NilValue && (vidle = nano_integer(idle)) < 0)
+    Rf_error("`idle` must be a non-negative integer");
+
+  double open = 0, cached = 0, hits = 0, misses = 0;
+  if (nano_http_mtx != NULL) {
+    nng_mtx_lock(nano_http_mtx);
+    nano_http_max = vmax;
+    nano_http_timeout = vidle;
+    nng_mtx_unlock(nano_http_mtx);
+    nano_http_trim();
+    nng_mtx_lock(nano_http_mtx);
+    for (nano_http_host *h = nano_http_hosts; h != NULL; h = h->next) {
+      open += h->open;
+      for (nano_http_idle *item = h->idle; item != NULL; item = item->next)
+        cached++;
+    }
+    hits = nano_http_hits;
+    misses = nano_http_misses;
+    nng_mtx_unlock(nano_http_mtx);
+  } else {
+    nano_http_max = vmax;
+    nano_http_timeout = vidle;
+  }
+
+  const char *names[] = {"max", "idle", "connections", ""};
+  const char *cnames[] = {"open", "cached", "hits", "misses", ""};
+  SEXP out, vec;
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(out, 0, Rf_ScalarInteger(nano_http_max));
+  SET_VECTOR_ELT(out, 1, Rf_ScalarInteger(nano_http_timeout));
+  vec = Rf_mkNamed(REALSXP, cnames);
+  SET_VECTOR_ELT(out, 2, vec);
+  REAL(vec)[0] = open;
+  REAL(vec)[1] = cached;
+  REAL(vec)[2] = hits;
+  REAL(vec)[3] = misses;
+
+  UNPROTECT(1);
+  return out;
+
+}
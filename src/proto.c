@@ -20,6 +20,7 @@ static void stream_finalizer(SEXP xptr) {
   }
   if (xp->tls != NULL)
     nng_tls_config_free(xp->tls);
+  free(xp->rbuf);
   free(xp);
 
 }
@@ -36,7 +37,7 @@ SEXP rnng_protocol_open(SEXP protocol, SEXP dial, SEXP listen, SEXP tls, SEXP au
   int xc;
   SEXP socket;
 
-  nng_socket *sock = malloc(sizeof(nng_socket));
+  nng_socket *sock = calloc(1, sizeof(nano_sock));
   NANO_ENSURE_ALLOC(sock);
 
   switch (slen) {
@@ -160,6 +161,7 @@ SEXP rnng_close(SEXP socket) {
   const int xc = nng_close(*sock);
   if (xc)
     ERROR_RET(xc);
+  nano_shm_accept(&((nano_sock *) sock)->shmrx, 0);
 
   Rf_setAttrib(socket, nano_StateSymbol, Rf_mkString("closed"));
   return nano_success;
@@ -171,10 +173,12 @@ SEXP rnng_reap(SEXP con) {
   int xc;
 
   if (!NANO_PTR_CHECK(con, nano_ContextSymbol)) {
-    xc = nng_ctx_close(*(nng_ctx *) NANO_PTR(con));
+    if (!(xc = nng_ctx_close(*(nng_ctx *) NANO_PTR(con))))
+      nano_shm_accept(&((nano_ctx *) NANO_PTR(con))->shmrx, 0);
 
   } else if (!NANO_PTR_CHECK(con, nano_SocketSymbol)) {
-    xc = nng_close(*(nng_socket *) NANO_PTR(con));
+    if (!(xc = nng_close(*(nng_socket *) NANO_PTR(con))))
+      nano_shm_accept(&((nano_sock *) NANO_PTR(con))->shmrx, 0);
 
   } else if (!NANO_PTR_CHECK(con, nano_ListenerSymbol)) {
     xc = nng_listener_close(*(nng_listener *) NANO_PTR(con));
@@ -225,21 +229,9 @@ static SEXP nano_stream_dial(SEXP url, SEXP textframes, SEXP tls) {
 
   if (!strcmp(up->u_scheme, "wss")) {
 
-    if (tls == R_NilValue) {
-      if ((xc = nng_tls_config_alloc(&nst->tls, NNG_TLS_MODE_CLIENT)) ||
-          (xc = nng_tls_config_server_name(nst->tls, up->u_hostname)) ||
-          (xc = nng_tls_config_auth_mode(nst->tls, NNG_TLS_AUTH_MODE_NONE)) ||
-          (xc = nng_stream_dialer_set_ptr(nst->endpoint.dial, NNG_OPT_TLS_CONFIG, nst->tls)))
-        goto fail;
-    } else {
-
-      nst->tls = (nng_tls_config *) NANO_PTR(tls);
-      nng_tls_config_hold(nst->tls);
-
-      if ((xc = nng_tls_config_server_name(nst->tls, up->u_hostname)) ||
-          (xc = nng_stream_dialer_set_ptr(nst->endpoint.dial, NNG_OPT_TLS_CONFIG, nst->tls)))
-        goto fail;
-    }
+    if ((xc = nano_tls_host(&nst->tls, tls, up->u_hostname)) ||
+        (xc = nng_stream_dialer_set_ptr(nst->endpoint.dial, NNG_OPT_TLS_CONFIG, nst->tls)))
+      goto fail;
 
   }
 
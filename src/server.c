@@ -0,0 +1,707 @@
+// nanonext - C level - HTTP server --------------------------------------------
+
+#define NANONEXT_HTTP
+#define NANONEXT_SERVER
+#include "nanonext.h"
+
+// internals -------------------------------------------------------------------
+
+// the server is referenced by its R object and by each registered handler, as
+// handlers are only destroyed by nng once all connections have been reaped
+
+static void server_unref(nano_server *s) {
+
+  if (atomic_fetch_sub(&s->refs, 1) == 1) {
+    nng_cv_free(s->cv);
+    nng_mtx_free(s->mtx);
+    free(s);
+  }
+
+}
+
+static void route_clear(nano_http_route *r) {
+
+#ifndef _WIN32
+  if (r->fd >= 0)
+    close(r->fd);
+#endif
+  free(r->buf);
+  free(r->type);
+  free(r);
+
+}
+
+static void route_free(void *arg) {
+
+  nano_http_route *r = (nano_http_route *) arg;
+  nano_server *s = r->s;
+  route_clear(r);
+  server_unref(s);
+
+}
+
+// request queue, protected by the server mutex: a request is queued with state
+// 0 before its cancel callback is armed, and only becomes visible to the R
+// thread at state 1 once the handler has confirmed the aio is still live -
+// state 2 marks a request cancelled before that point
+
+static void server_unlink(nano_server *s, nano_http_request *q) {
+
+  nano_http_request *prev = NULL, *p = s->head;
+  while (p != NULL && p != q) {
+    prev = p;
+    p = p->next;
+  }
+  if (p == NULL) return;
+  if (prev == NULL) {
+    s->head = q->next;
+  } else {
+    prev->next = q->next;
+  }
+  if (s->tail == q)
+    s->tail = prev;
+  if (q->state == 1)
+    s->ready--;
+
+}
+
+static nano_http_request *server_pop(nano_server *s) {
+
+  nano_http_request *q = s->head;
+  while (q != NULL && q->state != 1)
+    q = q->next;
+  if (q != NULL)
+    server_unlink(s, q);
+
+  return q;
+
+}
+
+static void server_cancel(nng_aio *aio, void *arg, int rv) {
+
+  nano_server *s = (nano_server *) arg;
+  nano_http_request *q;
+
+  nng_mtx_lock(s->mtx);
+  for (q = s->head; q != NULL && q->aio != aio; q = q->next);
+  if (q == NULL) {
+    nng_mtx_unlock(s->mtx);
+    return;
+  }
+  if (q->state == 0) {
+    q->state = 2;
+    nng_mtx_unlock(s->mtx);
+    nng_aio_finish(aio, rv);
+    return;
+  }
+  server_unlink(s, q);
+  nng_mtx_unlock(s->mtx);
+
+  free(q);
+  nng_aio_finish(aio, rv);
+
+}
+
+static void server_route(nng_aio *aio) {
+
+  nng_http_handler *h = nng_aio_get_input(aio, 1);
+  nano_http_route *r = (nano_http_route *) nng_http_handler_get_data(h);
+  nano_server *s = r->s;
+  int busy;
+
+  nano_http_request *q = malloc(sizeof(nano_http_request));
+  if (q == NULL) {
+    nng_aio_finish(aio, NNG_ENOMEM);
+    return;
+  }
+  q->aio = aio;
+  q->route = r;
+  q->next = NULL;
+  q->state = 0;
+
+  nng_mtx_lock(s->mtx);
+  if (s->tail != NULL) {
+    s->tail->next = q;
+  } else {
+    s->head = q;
+  }
+  s->tail = q;
+  nng_mtx_unlock(s->mtx);
+
+  nng_aio_defer(aio, server_cancel, s);
+
+  nng_mtx_lock(s->mtx);
+  busy = q->state == 0 && nng_aio_busy(aio);
+  if (busy && !s->closed) {
+    q->state = 1;
+    s->ready++;
+    nng_cv_wake(s->cv);
+    q = NULL;
+  } else {
+    server_unlink(s, q);
+  }
+  nng_mtx_unlock(s->mtx);
+
+  if (q != NULL) {
+    free(q);
+    if (busy)
+      nng_aio_finish(aio, NNG_ECLOSED);
+  }
+
+}
+
+#ifndef _WIN32
+
+// the file is read afresh with pread() for each request, so that a file
+// truncated whilst being served is sent at its current length - a mapping
+// would instead fault on access beyond the new end of file
+
+static int server_read(nano_http_route *r, nng_http_res *res) {
+
+  struct stat st;
+  unsigned char *buf = NULL;
+  size_t len, got = 0;
+  ssize_t n;
+  int xc;
+
+  if (fstat(r->fd, &st))
+    return NNG_ESYSERR;
+  len = (size_t) st.st_size;
+  if (len && (buf = malloc(len)) == NULL)
+    return NNG_ENOMEM;
+  while (got < len && (n = pread(r->fd, buf + got, len - got, (off_t) got))) {
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      free(buf);
+      return NNG_ESYSERR;
+    }
+    got += (size_t) n;
+  }
+  xc = got ? nng_http_res_copy_data(res, buf, got) : nng_http_res_set_data(res, NULL, 0);
+  free(buf);
+
+  return xc;
+
+}
+
+#endif
+
+static void server_file(nng_aio *aio) {
+
+  nng_http_handler *h = nng_aio_get_input(aio, 1);
+  nano_http_route *r = (nano_http_route *) nng_http_handler_get_data(h);
+  nng_http_res *res;
+  int xc;
+
+  if ((xc = nng_http_res_alloc(&res))) {
+    nng_aio_finish(aio, xc);
+    return;
+  }
+#ifndef _WIN32
+  if ((xc = nng_http_res_set_header(res, "Content-Type", r->type)) ||
+      (xc = server_read(r, res))) {
+#else
+  if ((xc = nng_http_res_set_header(res, "Content-Type", r->type)) ||
+      (xc = nng_http_res_set_data(res, r->buf, r->len))) {
+#endif
+    nng_http_res_free(res);
+    nng_aio_finish(aio, xc);
+    return;
+  }
+
+  nng_aio_set_output(aio, 0, res);
+  nng_aio_finish(aio, 0);
+
+}
+
+static int server_open(nano_http_route *r, const char *path) {
+
+#ifndef _WIN32
+  struct stat st;
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NNG_ENOENT;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return NNG_ENOENT;
+  }
+  r->fd = fd;
+#else
+  FILE *f = fopen(path, "rb");
+  long sz;
+  if (f == NULL)
+    return NNG_ENOENT;
+  if (fseek(f, 0, SEEK_END) || (sz = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+    fclose(f);
+    return NNG_ENOENT;
+  }
+  r->len = (size_t) sz;
+  if (r->len) {
+    if ((r->buf = malloc(r->len)) == NULL) {
+      fclose(f);
+      return NNG_ENOMEM;
+    }
+    if (fread(r->buf, 1, r->len, f) != r->len) {
+      fclose(f);
+      return NNG_ENOENT;
+    }
+  }
+  fclose(f);
+#endif
+
+  return 0;
+
+}
+
+static SEXP server_request(nng_http_req *req, SEXP headers) {
+
+  const char *names[] = {"method", "uri", "headers", "data", ""};
+  SEXP out, hvec, data;
+  void *buf;
+  size_t sz;
+
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(out, 0, Rf_mkString(nng_http_req_get_method(req)));
+  SET_VECTOR_ELT(out, 1, Rf_mkString(nng_http_req_get_uri(req)));
+
+  if (headers != R_NilValue) {
+    const R_xlen_t hlen = XLENGTH(headers);
+    hvec = Rf_allocVector(VECSXP, hlen);
+    SET_VECTOR_ELT(out, 2, hvec);
+    Rf_namesgets(hvec, headers);
+    for (R_xlen_t i = 0; i < hlen; i++) {
+      const char *r = nng_http_req_get_header(req, NANO_STR_N(headers, i));
+      SET_VECTOR_ELT(hvec, i, r == NULL ? R_NilValue : Rf_mkString(r));
+    }
+  }
+
+  nng_http_req_get_data(req, &buf, &sz);
+  data = Rf_allocVector(RAWSXP, sz);
+  SET_VECTOR_ELT(out, 3, data);
+  if (sz)
+    memcpy(NANO_DATAPTR(data), buf, sz);
+
+  UNPROTECT(1);
+  return out;
+
+}
+
+static int server_response(nng_http_res **resp, SEXP x) {
+
+  SEXP headers = R_NilValue, data = x;
+  int status = 200, xc;
+
+  if (TYPEOF(x) == VECSXP) {
+    data = R_NilValue;
+    const SEXP names = Rf_getAttrib(x, R_NamesSymbol);
+    if (names != R_NilValue) {
+      for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+        const char *nm = NANO_STR_N(names, i);
+        if (!strcmp(nm, "status")) {
+          status = nano_integer(NANO_VECTOR(x)[i]);
+        } else if (!strcmp(nm, "headers")) {
+          headers = NANO_VECTOR(x)[i];
+        } else if (!strcmp(nm, "data")) {
+          data = NANO_VECTOR(x)[i];
+        }
+      }
+    }
+  }
+
+  if (status < 100 || status > 599)
+    Rf_error("response `status` must be a valid HTTP status code");
+
+  if ((xc = nng_http_res_alloc(resp)))
+    return xc;
+
+  nng_http_res *res = *resp;
+  const char *type = "application/octet-stream";
+
+  if ((xc = nng_http_res_set_status(res, (uint16_t) status)))
+    return xc;
+
+  if (TYPEOF(headers) == STRSXP) {
+    const R_xlen_t hlen = XLENGTH(headers);
+    SEXP hnames = Rf_getAttrib(headers, R_NamesSymbol);
+    if (TYPEOF(hnames) == STRSXP && XLENGTH(hnames) == hlen) {
+      for (R_xlen_t i = 0; i < hlen; i++) {
+        if ((xc = nng_http_res_set_header(res, NANO_STR_N(hnames, i), NANO_STR_N(headers, i))))
+          return xc;
+      }
+    }
+  }
+
+  switch (TYPEOF(data)) {
+  case RAWSXP:
+    xc = nng_http_res_copy_data(res, NANO_DATAPTR(data), XLENGTH(data));
+    break;
+  case STRSXP:
+    if (XLENGTH(data)) {
+      const char *s = NANO_STRING(data);
+      xc = nng_http_res_copy_data(res, s, strlen(s));
+    }
+    type = "text/plain; charset=UTF-8";
+    break;
+  case NILSXP:
+    break;
+  default:
+    Rf_error("response `data` must be a character or raw vector");
+  }
+  if (xc)
+    return xc;
+
+  if (nng_http_res_get_header(res, "Content-Type") == NULL)
+    xc = nng_http_res_set_header(res, "Content-Type", type);
+
+  return xc;
+
+}
+
+typedef struct nano_serve_call_s {
+  nano_http_request *q;
+  nng_http_res *res;
+  SEXP out;
+  int xc;
+} nano_serve_call;
+
+static void server_eval(void *arg) {
+
+  nano_serve_call *sc = (nano_serve_call *) arg;
+  nano_http_route *r = sc->q->route;
+  nng_http_req *req = nng_aio_get_input(sc->q->aio, 0);
+  SEXP request, call, res;
+
+  PROTECT(request = server_request(req, r->headers));
+  PROTECT(call = Rf_lcons(r->fun, Rf_cons(request, R_NilValue)));
+  res = Rf_eval(call, R_GlobalEnv);
+  SET_VECTOR_ELT(sc->out, 0, res);
+  sc->xc = server_response(&sc->res, res);
+  UNPROTECT(2);
+
+}
+
+static void server_close(nano_server *s) {
+
+  nano_http_request *q, *list = NULL;
+
+  nng_mtx_lock(s->mtx);
+  s->closed = 1;
+  while ((q = server_pop(s)) != NULL) {
+    q->next = list;
+    list = q;
+  }
+  nng_mtx_unlock(s->mtx);
+
+  while (list != NULL) {
+    q = list;
+    list = q->next;
+    nng_aio_finish(q->aio, NNG_ECLOSED);
+    free(q);
+  }
+
+  nng_http_server_stop(s->srv);
+  nng_http_server_release(s->srv);
+  server_unref(s);
+
+}
+
+static void server_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  server_close((nano_server *) NANO_PTR(xptr));
+
+}
+
+static nano_server *server_check(SEXP server) {
+
+  if (NANO_PTR_CHECK(server, nano_ServerSymbol))
+    Rf_error("`server` is not a valid HTTP Server");
+
+  return (nano_server *) NANO_PTR(server);
+
+}
+
+static void server_add(nano_server *s, nng_http_handler *h, nano_http_route *r) {
+
+  int xc;
+  atomic_fetch_add(&s->refs, 1);
+  if ((xc = nng_http_handler_set_data(h, r, route_free))) {
+    atomic_fetch_sub(&s->refs, 1);
+    nng_http_handler_free(h);
+    route_clear(r);
+    ERROR_OUT(xc);
+  }
+  if ((xc = nng_http_server_add_handler(s->srv, h))) {
+    nng_http_handler_free(h);
+    ERROR_OUT(xc);
+  }
+
+}
+
+// server ----------------------------------------------------------------------
+
+SEXP rnng_http_server_create(SEXP url, SEXP tls) {
+
+  const char *addr = CHAR(STRING_ELT(url, 0));
+  if (tls != R_NilValue && NANO_PTR_CHECK(tls, nano_TlsSymbol))
+    Rf_error("`tls` is not a valid TLS Configuration");
+
+  nano_server *s = NULL;
+  nng_url *up = NULL;
+  nng_sockaddr sa;
+  SEXP xp;
+  int xc;
+
+  s = calloc(1, sizeof(nano_server));
+  NANO_ENSURE_ALLOC(s);
+  atomic_init(&s->refs, 1);
+
+  if ((xc = nng_mtx_alloc(&s->mtx)))
+    goto fail;
+  if ((xc = nng_cv_alloc(&s->cv, s->mtx)))
+    goto fail;
+  if ((xc = nng_url_parse(&up, addr)) ||
+      (xc = nng_http_server_hold(&s->srv, up)))
+    goto fail;
+
+  if (tls != R_NilValue &&
+      (xc = nng_http_server_set_tls(s->srv, (nng_tls_config *) NANO_PTR(tls))))
+    goto fail;
+
+  if ((xc = nng_http_server_start(s->srv)))
+    goto fail;
+
+  PROTECT(xp = R_MakeExternalPtr(s, nano_ServerSymbol, tls));
+  R_RegisterCFinalizerEx(xp, server_finalizer, TRUE);
+  NANO_CLASS2(xp, "nanoServer", "nano");
+  Rf_setAttrib(xp, nano_StateSymbol, Rf_mkString("opened"));
+
+  if (!strcmp(up->u_port, "0") && !nng_http_server_get_addr(s->srv, &sa) &&
+      sa.s_family == NNG_AF_INET) {
+    const uint8_t *p = (const uint8_t *) &sa.s_in.sa_port;
+    char buf[NANONEXT_STR_SIZE];
+    snprintf(buf, NANONEXT_STR_SIZE, "%d", p[0] << 8 | p[1]);
+    size_t sz = strlen(up->u_scheme) + strlen(up->u_hostname) + strlen(buf) + strlen(up->u_path) + 5;
+    char *nurl = R_alloc(sz, sizeof(char));
+    snprintf(nurl, sz, "%s://%s:%s%s", up->u_scheme, up->u_hostname, buf, up->u_path);
+    Rf_setAttrib(xp, nano_UrlSymbol, Rf_mkString(nurl));
+  } else {
+    Rf_setAttrib(xp, nano_UrlSymbol, url);
+  }
+
+  nng_url_free(up);
+  UNPROTECT(1);
+  return xp;
+
+  fail:
+  if (s->srv != NULL)
+    nng_http_server_release(s->srv);
+  nng_url_free(up);
+  nng_cv_free(s->cv);
+  nng_mtx_free(s->mtx);
+  free(s);
+  failmem:
+  ERROR_OUT(xc);
+
+}
+
+SEXP rnng_http_route(SEXP server, SEXP path, SEXP fun, SEXP method, SEXP headers, SEXP prefix) {
+
+  nano_server *s = server_check(server);
+  const char *uri = CHAR(STRING_ELT(path, 0));
+  if (TYPEOF(fun) != CLOSXP)
+    Rf_error("`fun` must be a function");
+  if (headers != R_NilValue && TYPEOF(headers) != STRSXP)
+    Rf_error("`headers` must be a character vector of header names");
+
+  nng_http_handler *h;
+  nano_http_route *r;
+  int xc;
+
+  r = calloc(1, sizeof(nano_http_route));
+  NANO_ENSURE_ALLOC(r);
+  r->s = s;
+  r->fd = -1;
+  r->fun = fun;
+  r->headers = headers;
+
+  if ((xc = nng_http_handler_alloc(&h, uri, server_route))) {
+    free(r);
+    ERROR_OUT(xc);
+  }
+  if ((xc = nng_http_handler_set_method(h, method == R_NilValue ? NULL : CHAR(STRING_ELT(method, 0)))) ||
+      (NANO_INTEGER(prefix) && (xc = nng_http_handler_set_tree(h)))) {
+    nng_http_handler_free(h);
+    free(r);
+    ERROR_OUT(xc);
+  }
+
+  server_add(s, h, r);
+  NANO_SET_PROT(server, Rf_cons(fun, Rf_cons(headers, NANO_PROT(server))));
+
+  return nano_success;
+
+  failmem:
+  ERROR_OUT(xc);
+
+}
+
+SEXP rnng_http_static(SEXP server, SEXP path, SEXP data, SEXP file, SEXP directory, SEXP type) {
+
+  nano_server *s = server_check(server);
+  const char *uri = CHAR(STRING_ELT(path, 0));
+  const char *ctype = type == R_NilValue ? NULL : CHAR(STRING_ELT(type, 0));
+  nng_http_handler *h;
+  nano_http_route *r;
+  int xc;
+
+  if (directory != R_NilValue) {
+
+    if ((xc = nng_http_handler_alloc_directory(&h, uri, CHAR(STRING_ELT(directory, 0)))))
+      ERROR_OUT(xc);
+
+  } else if (file != R_NilValue) {
+
+    r = calloc(1, sizeof(nano_http_route));
+    NANO_ENSURE_ALLOC(r);
+    r->s = s;
+    r->fd = -1;
+    if (ctype == NULL)
+      ctype = "application/octet-stream";
+    if ((r->type = malloc(strlen(ctype) + 1)) == NULL) {
+      free(r);
+      xc = 2;
+      goto failmem;
+    }
+    strcpy(r->type, ctype);
+
+    if ((xc = server_open(r, CHAR(STRING_ELT(file, 0))))) {
+      route_clear(r);
+      if (xc == NNG_ENOENT)
+        Rf_error("`file` is not a readable file");
+      ERROR_OUT(xc);
+    }
+    if ((xc = nng_http_handler_alloc(&h, uri, server_file))) {
+      route_clear(r);
+      ERROR_OUT(xc);
+    }
+    server_add(s, h, r);
+    return nano_success;
+
+  } else {
+
+    const void *buf;
+    size_t sz;
+    switch (TYPEOF(data)) {
+    case RAWSXP:
+      buf = NANO_DATAPTR(data);
+      sz = XLENGTH(data);
+      if (ctype == NULL)
+        ctype = "application/octet-stream";
+      break;
+    case STRSXP:
+      buf = NANO_STRING(data);
+      sz = strlen((const char *) buf);
+      if (ctype == NULL)
+        ctype = "text/plain; charset=UTF-8";
+      break;
+    default:
+      Rf_error("`data` must be a character or raw vector");
+    }
+    if ((xc = nng_http_handler_alloc_static(&h, uri, buf, sz, ctype)))
+      ERROR_OUT(xc);
+
+  }
+
+  if ((xc = nng_http_server_add_handler(s->srv, h))) {
+    nng_http_handler_free(h);
+    ERROR_OUT(xc);
+  }
+
+  return nano_success;
+
+  failmem:
+  ERROR_OUT(xc);
+
+}
+
+SEXP rnng_http_serve(SEXP server, SEXP max, SEXP timeout) {
+
+  nano_server *s = server_check(server);
+  const int limit = max == R_NilValue ? INT_MAX : nano_integer(max);
+  const int forever = timeout == R_NilValue;
+  const int tmo = forever ? 0 : nano_integer(timeout);
+  if (tmo < 0)
+    Rf_error("`timeout` must be a non-negative integer");
+  if (limit < 1)
+    return Rf_ScalarInteger(0);
+  nng_time period = (nng_time) tmo;
+
+  nng_time time, now = nng_clock();
+  int ready;
+  while (1) {
+    time = forever || period > 400 ? now + 400 : now + period;
+    nng_mtx_lock(s->mtx);
+    while (s->ready == 0) {
+      if (nng_cv_until(s->cv, time) == NNG_ETIMEDOUT)
+        break;
+    }
+    ready = s->ready;
+    nng_mtx_unlock(s->mtx);
+    if (ready || !(forever || period > 400)) break;
+    if (!forever) period -= 400;
+    R_CheckUserInterrupt();
+    now += 400;
+  }
+
+  if (ready == 0)
+    return Rf_ScalarInteger(0);
+
+  nano_serve_call sc;
+  PROTECT(sc.out = Rf_allocVector(VECSXP, 1));
+  atomic_fetch_add(&s->refs, 1);
+
+  int served = 0;
+  nano_http_request *q;
+  while (served < limit) {
+    nng_mtx_lock(s->mtx);
+    q = server_pop(s);
+    nng_mtx_unlock(s->mtx);
+    if (q == NULL) break;
+
+    sc.q = q;
+    sc.res = NULL;
+    sc.xc = 0;
+    if (!R_ToplevelExec(server_eval, &sc) || sc.xc) {
+      if (sc.res != NULL)
+        nng_http_res_free(sc.res);
+      if (nng_http_res_alloc_error(&sc.res, NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR))
+        sc.res = NULL;
+    }
+    SET_VECTOR_ELT(sc.out, 0, R_NilValue);
+
+    if (sc.res == NULL) {
+      nng_aio_finish(q->aio, NNG_ENOMEM);
+    } else {
+      nng_aio_set_output(q->aio, 0, sc.res);
+      nng_aio_finish(q->aio, 0);
+    }
+    free(q);
+    served++;
+  }
+
+  server_unref(s);
+  UNPROTECT(1);
+  return Rf_ScalarInteger(served);
+
+}
+
+SEXP rnng_http_server_close(SEXP server) {
+
+  server_close(server_check(server));
+  R_ClearExternalPtr(server);
+  Rf_setAttrib(server, nano_StateSymbol, Rf_mkString("closed"));
+
+  return nano_success;
+
+}
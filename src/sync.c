@@ -16,13 +16,29 @@ static void nano_load_later(void) {
 
 }
 
+// wakes all waiters on a condition variable, including any wait_any() it is
+// part of - called with the condition variable's mutex held
+
+void nano_cv_wake(nano_cv *ncv) {
+
+  nng_cv_wake(ncv->cv);
+  nano_cv *any = ncv->any;
+  if (any != NULL) {
+    nng_mtx_lock(any->mtx);
+    any->condition++;
+    nng_cv_wake(any->cv);
+    nng_mtx_unlock(any->mtx);
+  }
+
+}
+
 // aio completion callbacks ----------------------------------------------------
 
 static void sendaio_complete(void *arg) {
 
   nng_aio *aio = ((nano_saio *) arg)->aio;
   if (nng_aio_result(aio))
-    nng_msg_free(nng_aio_get_msg(aio));
+    nano_msg_free(nng_aio_get_msg(aio));
 
 }
 
@@ -33,6 +49,7 @@ static void request_complete(void *arg) {
   int res = nng_aio_result(raio->aio);
   if (res == 0) {
     nng_msg *msg = nng_aio_get_msg(raio->aio);
+    nano_shm_mark(msg);
     raio->data = msg;
     nng_pipe p = nng_msg_get_pipe(msg);
     res = - (int) p.id;
@@ -50,22 +67,26 @@ static void request_complete(void *arg) {
     }
   }
 
+  if (res <= 0)
+    nano_hist_record(raio->hist, 2, raio->start);
   if (raio->next != NULL) {
     nano_cv *ncv = (nano_cv *) raio->next;
-    nng_cv *cv = ncv->cv;
     nng_mtx *mtx = ncv->mtx;
 
     nng_mtx_lock(mtx);
     raio->result = res;
     ncv->condition++;
-    nng_cv_wake(cv);
+    nano_cv_wake(ncv);
     nng_mtx_unlock(mtx);
   } else {
     raio->result = res;
   }
+  nano_wait_signal();
+  if (raio->queue != NULL)
+    nano_queue_push((nano_queue_node *) raio->queue);
 
   if (saio->cb != NULL)
-    later2(raio_invoke_cb, saio->cb);
+    nano_later(raio, raio_invoke_cb, saio->cb);
 
 }
 
@@ -75,16 +96,22 @@ static void request_complete_dropcon(void *arg) {
   int res = nng_aio_result(raio->aio);
   if (res == 0) {
     nng_msg *msg = nng_aio_get_msg(raio->aio);
+    nano_shm_mark(msg);
     raio->data = msg;
     nng_pipe p = nng_msg_get_pipe(msg);
     res = - (int) p.id;
     nng_pipe_close(p);
   }
+  if (res <= 0)
+    nano_hist_record(raio->hist, 2, raio->start);
   raio->result = res;
+  nano_wait_signal();
+  if (raio->queue != NULL)
+    nano_queue_push((nano_queue_node *) raio->queue);
 
   nano_saio *saio = (nano_saio *) raio->cb;
   if (saio->cb != NULL)
-    later2(raio_invoke_cb, saio->cb);
+    nano_later(raio, raio_invoke_cb, saio->cb);
 
 }
 
@@ -92,14 +119,13 @@ void pipe_cb_signal(nng_pipe p, nng_pipe_ev ev, void *arg) {
 
   int sig;
   nano_cv *ncv = (nano_cv *) arg;
-  nng_cv *cv = ncv->cv;
   nng_mtx *mtx = ncv->mtx;
 
   nng_mtx_lock(mtx);
   sig = ncv->flag;
   if (sig > 0) ncv->flag = -1;
   ncv->condition++;
-  nng_cv_wake(cv);
+  nano_cv_wake(ncv);
   nng_mtx_unlock(mtx);
   if (sig > 1) {
 #ifdef _WIN32
@@ -119,7 +145,6 @@ static void pipe_cb_monitor(nng_pipe p, nng_pipe_ev ev, void *arg) {
   nano_monitor *monitor = (nano_monitor *) arg;
 
   nano_cv *ncv = monitor->cv;
-  nng_cv *cv = ncv->cv;
   nng_mtx *mtx = ncv->mtx;
 
   const int id = (int) p.id;
@@ -140,7 +165,7 @@ static void pipe_cb_monitor(nng_pipe p, nng_pipe_ev ev, void *arg) {
   monitor->ids[monitor->updates] = ev == NNG_PIPE_EV_ADD_POST ? id : -id;
   monitor->updates++;
   ncv->condition++;
-  nng_cv_wake(cv);
+  nano_cv_wake(ncv);
   nng_mtx_unlock(mtx);
 
 }
@@ -157,6 +182,45 @@ static void cv_finalizer(SEXP xptr) {
 
 }
 
+// marks the stack of a finalized queue, so later completions free their node
+static nano_queue_node nano_queue_closed;
+
+static int nano_queue_free_list(nano_queue_node *node) {
+
+  nano_queue_node *next;
+  int n = 0;
+  while (node != NULL) {
+    next = node->next;
+    free(node);
+    node = next;
+    n++;
+  }
+  return n;
+
+}
+
+// the queue is referenced by its R object and by each bound node, as nodes of
+// Aios still outstanding may complete after the queue itself is discarded
+
+static void nano_queue_unref(nano_queue *q, const int n) {
+
+  if (atomic_fetch_sub(&q->refs, n) == n)
+    free(q);
+
+}
+
+static void queue_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_queue *q = (nano_queue *) NANO_PTR(xptr);
+  nano_queue_node *node = atomic_exchange_explicit(&q->head, &nano_queue_closed, memory_order_acquire);
+  int n = 1;
+  n += nano_queue_free_list(node);
+  n += nano_queue_free_list(q->ready);
+  nano_queue_unref(q, n);
+
+}
+
 static void request_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
@@ -165,7 +229,7 @@ static void request_finalizer(SEXP xptr) {
   nng_aio_free(saio->aio);
   nng_aio_free(xp->aio);
   if (xp->data != NULL)
-    nng_msg_free((nng_msg *) xp->data);
+    nano_msg_drop((nng_msg *) xp->data);
   if (saio->alloc) {
     nng_ctx_close(*saio->ctx);
     free(saio->ctx);
@@ -397,21 +461,272 @@ SEXP rnng_cv_signal(SEXP cvar) {
     Rf_error("`cv` is not a valid Condition Variable");
 
   nano_cv *ncv = (nano_cv *) NANO_PTR(cvar);
-  nng_cv *cv = ncv->cv;
   nng_mtx *mtx = ncv->mtx;
 
   nng_mtx_lock(mtx);
   ncv->condition++;
-  nng_cv_wake(cv);
+  nano_cv_wake(ncv);
   nng_mtx_unlock(mtx);
 
   return nano_success;
 
 }
 
+// wait_any() registers a single waiter with each condition variable, which
+// every signal also wakes, so any number may be waited on by one thread
+
+static nano_cv *nano_any = NULL;
+
+static int nano_cv_any_take(nano_cv **cvs, const R_xlen_t n) {
+
+  int idx = 0;
+  for (R_xlen_t i = 0; i < n && !idx; i++) {
+    nano_cv *ncv = cvs[i];
+    nng_mtx_lock(ncv->mtx);
+    if (ncv->condition > 0) {
+      ncv->condition--;
+      idx = (int) i + 1;
+    }
+    nng_mtx_unlock(ncv->mtx);
+  }
+  return idx;
+
+}
+
+static void nano_cv_any_register(nano_cv **cvs, const R_xlen_t n, nano_cv *any) {
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    nng_mtx_lock(cvs[i]->mtx);
+    cvs[i]->any = any;
+    nng_mtx_unlock(cvs[i]->mtx);
+  }
+
+}
+
+void nano_cv_any_free(void) {
+
+  if (nano_any == NULL) return;
+  nng_cv_free(nano_any->cv);
+  nng_mtx_free(nano_any->mtx);
+  free(nano_any);
+  nano_any = NULL;
+
+}
+
+SEXP rnng_cv_wait_any(SEXP cvars, SEXP msec, SEXP spin) {
+
+  if (TYPEOF(cvars) != VECSXP || !XLENGTH(cvars))
+    Rf_error("`cvs` must be a list of Condition Variables");
+
+  const R_xlen_t n = XLENGTH(cvars);
+  nano_cv **cvs = (nano_cv **) R_alloc(n, sizeof(nano_cv *));
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP cvar = VECTOR_ELT(cvars, i);
+    if (NANO_PTR_CHECK(cvar, nano_CvSymbol))
+      Rf_error("`cvs` must be a list of Condition Variables");
+    cvs[i] = (nano_cv *) NANO_PTR(cvar);
+  }
+
+  const int timeout = msec == R_NilValue ? -1 : Rf_asInteger(msec);
+  const int spinus = spin == R_NilValue ? 0 : Rf_asInteger(spin);
+
+  int idx = nano_cv_any_take(cvs, n);
+  if (idx)
+    return Rf_ScalarInteger(idx);
+
+  if (spinus > 0) {
+    const uint64_t spinns = timeout >= 0 && (uint64_t) timeout * 1000 < (uint64_t) spinus ?
+      (uint64_t) timeout * 1000000 : (uint64_t) spinus * 1000;
+    const uint64_t end = nano_hrtime() + spinns;
+    do {
+      if ((idx = nano_cv_any_take(cvs, n)))
+        return Rf_ScalarInteger(idx);
+    } while (nano_hrtime() < end);
+  }
+
+  int xc;
+  if (nano_any == NULL) {
+    nano_cv *any = calloc(1, sizeof(nano_cv));
+    NANO_ENSURE_ALLOC(any);
+    if ((xc = nng_mtx_alloc(&any->mtx))) {
+      free(any);
+      goto failmem;
+    }
+    if ((xc = nng_cv_alloc(&any->cv, any->mtx))) {
+      nng_mtx_free(any->mtx);
+      free(any);
+      goto failmem;
+    }
+    nano_any = any;
+  }
+  nano_cv *any = nano_any;
+
+  const nng_time deadline = timeout >= 0 ? nng_clock() + (nng_time) timeout : 0;
+  nng_time now, time;
+
+  while (1) {
+    nng_mtx_lock(any->mtx);
+    any->condition = 0;
+    nng_mtx_unlock(any->mtx);
+    nano_cv_any_register(cvs, n, any);
+
+    if (!(idx = nano_cv_any_take(cvs, n))) {
+      now = nng_clock();
+      time = timeout >= 0 && deadline < now + 400 ? deadline : now + 400;
+      nng_mtx_lock(any->mtx);
+      while (any->condition == 0) {
+        if (nng_cv_until(any->cv, time) == NNG_ETIMEDOUT)
+          break;
+      }
+      nng_mtx_unlock(any->mtx);
+    }
+
+    nano_cv_any_register(cvs, n, NULL);
+    if (idx || (idx = nano_cv_any_take(cvs, n)))
+      break;
+    if (timeout >= 0 && nng_clock() >= deadline)
+      break;
+    R_CheckUserInterrupt();
+  }
+
+  return Rf_ScalarInteger(idx);
+
+  failmem:
+  ERROR_OUT(xc);
+
+}
+
+// completion queues -----------------------------------------------------------
+
+// completions push from nng threads onto a lock-free stack, which the R thread
+// takes whole on each drain, reversing it onto a list held in completion order
+
+nano_queue_node *nano_queue_node_alloc(SEXP queue) {
+
+  if (queue == R_NilValue)
+    return NULL;
+
+  if (NANO_PTR_CHECK(queue, nano_QueueSymbol))
+    Rf_error("`queue` is not a valid Completion Queue");
+
+  nano_queue_node *node = malloc(sizeof(nano_queue_node));
+  if (node == NULL)
+    return NULL;
+
+  node->next = NULL;
+  node->q = (nano_queue *) NANO_PTR(queue);
+  node->obj = R_NilValue;
+
+  return node;
+
+}
+
+// the env is retained on the queue's own list, as for nano_PreserveObject(), so
+// that it is released along with a queue discarded without being drained
+
+void nano_queue_bind(nano_queue_node *node, SEXP env, SEXP queue) {
+
+  SEXP list = NANO_PROT(queue);
+  SEXP tail = CDR(list);
+  SEXP obj = Rf_cons(list, tail);
+  SETCDR(list, obj);
+  if (tail != R_NilValue)
+    SETCAR(tail, obj);
+  SET_TAG(obj, env);
+  node->obj = obj;
+  atomic_fetch_add(&node->q->refs, 1);
+
+}
+
+void nano_queue_push(nano_queue_node *node) {
+
+  nano_queue *q = node->q;
+  nano_queue_node *head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  do {
+    if (head == &nano_queue_closed) {
+      free(node);
+      nano_queue_unref(q, 1);
+      return;
+    }
+    node->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&q->head, &head, node, memory_order_release, memory_order_relaxed));
+
+}
+
+SEXP rnng_queue_alloc(void) {
+
+  nano_queue *q = calloc(1, sizeof(nano_queue));
+  if (q == NULL)
+    ERROR_OUT(NNG_ENOMEM);
+  atomic_init(&q->head, NULL);
+  atomic_init(&q->refs, 1);
+
+  SEXP xp;
+  PROTECT(xp = R_MakeExternalPtr(q, nano_QueueSymbol, R_NilValue));
+  NANO_SET_PROT(xp, Rf_cons(R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(xp, queue_finalizer, TRUE);
+  Rf_classgets(xp, Rf_mkString("completionQueue"));
+
+  UNPROTECT(1);
+  return xp;
+
+}
+
+SEXP rnng_queue_drain(SEXP queue, SEXP max) {
+
+  if (NANO_PTR_CHECK(queue, nano_QueueSymbol))
+    Rf_error("`q` is not a valid Completion Queue");
+
+  nano_queue *q = (nano_queue *) NANO_PTR(queue);
+
+  nano_queue_node *node = atomic_exchange_explicit(&q->head, NULL, memory_order_acquire);
+  if (node != NULL) {
+    nano_queue_node *last = node, *rev = NULL, *next;
+    while (node != NULL) {
+      next = node->next;
+      node->next = rev;
+      rev = node;
+      node = next;
+      q->count++;
+    }
+    if (q->tail != NULL) {
+      q->tail->next = rev;
+    } else {
+      q->ready = rev;
+    }
+    q->tail = last;
+  }
+
+  R_xlen_t n = q->count;
+  if (max != R_NilValue) {
+    const int m = nano_integer(max);
+    if (m >= 0 && m < n) n = m;
+  }
+
+  SEXP out, env;
+  PROTECT(out = Rf_allocVector(VECSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    node = q->ready;
+    q->ready = node->next;
+    env = TAG(node->obj);
+    SET_VECTOR_ELT(out, i, env);
+    nano_ReleaseObject(node->obj);
+    free(node);
+    nano_queue_unref(q, 1);
+    rnng_aio_call(env);
+  }
+  q->count -= n;
+  if (q->ready == NULL)
+    q->tail = NULL;
+
+  UNPROTECT(1);
+  return out;
+
+}
+
 // request ---------------------------------------------------------------------
 
-SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeout, SEXP cvar, SEXP msgid, SEXP clo) {
+SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeout, SEXP cvar, SEXP msgid, SEXP queue, SEXP clo) {
 
   const int sock = !NANO_PTR_CHECK(con, nano_SocketSymbol);
   if (!sock && NANO_PTR_CHECK(con, nano_ContextSymbol))
@@ -419,7 +734,7 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
 
   const nng_duration dur = timeout == R_NilValue ? NNG_DURATION_DEFAULT : (nng_duration) nano_integer(timeout);
   const uint8_t mod = (uint8_t) nano_matcharg(recvmode);
-  const int raw = nano_encode_mode(sendmode);
+  const int enc = nano_encode_mode(sendmode);
   const int id = msgid != R_NilValue ? NANO_INTEGER(msgid) : 0;
   int signal, drop, xc;
   if (cvar == R_NilValue) {
@@ -435,12 +750,19 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   nng_ctx *ctx = NULL;
   nng_msg *msg = NULL;
   SEXP aio, env, fun;
-  nano_buf buf;
 
-  if (raw) {
-    nano_encode(&buf, data);
-  } else {
-    nano_serialize(&buf, data, NANO_PROT(con));
+  nano_queue_node *qn = NULL;
+
+  if (queue != R_NilValue && NANO_PTR_CHECK(queue, nano_QueueSymbol))
+    Rf_error("`queue` is not a valid Completion Queue");
+
+  // encoding may raise an error, so precedes any allocation
+  if ((xc = nano_encode_data(&msg, data, enc, NANO_PROT(con), 0, NANO_HINT(con, sock), NANO_SHM(con, sock), NANO_SOCKID(con, sock))))
+    return mk_error_data(xc);
+
+  if (queue != R_NilValue) {
+    qn = nano_queue_node_alloc(queue);
+    NANO_ENSURE_ALLOC(qn);
   }
 
   saio = calloc(1, sizeof(nano_saio));
@@ -464,27 +786,25 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   saio->msgid = id;
   saio->alloc = sock;
 
-  if ((xc = nng_msg_alloc(&msg, 0)) ||
-      (xc = nng_msg_append(msg, buf.buf, buf.cur)) ||
-      (xc = nng_aio_alloc(&saio->aio, sendaio_complete, saio))) {
-    nng_msg_free(msg);
+  if ((xc = nng_aio_alloc(&saio->aio, sendaio_complete, saio)))
     goto fail;
-  }
 
+  nano_hist_arm(raio, NANO_HIST(con, sock));
   nng_aio_set_msg(saio->aio, msg);
   nng_ctx_send(*ctx, saio->aio);
+  msg = NULL;
 
   raio->type = signal ? REQAIOS : REQAIO;
   raio->mode = mod;
   raio->cb = saio;
   raio->next = ncv;
+  raio->queue = qn;
 
   if ((xc = nng_aio_alloc(&raio->aio, drop ? request_complete_dropcon : request_complete, raio)))
     goto fail;
 
   nng_aio_set_timeout(raio->aio, dur);
   nng_ctx_recv(*ctx, raio->aio);
-  NANO_FREE(buf);
 
   PROTECT(aio = R_MakeExternalPtr(raio, nano_AioSymbol, NANO_PROT(con)));
   R_RegisterCFinalizerEx(aio, request_finalizer, TRUE);
@@ -498,6 +818,9 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
   PROTECT(fun = R_mkClosure(R_NilValue, nano_aioFuncMsg, clo));
   R_MakeActiveBinding(nano_DataSymbol, fun, env);
 
+  if (qn != NULL)
+    nano_queue_bind(qn, env, queue);
+
   UNPROTECT(3);
   return env;
 
@@ -508,7 +831,8 @@ SEXP rnng_request(SEXP con, SEXP data, SEXP sendmode, SEXP recvmode, SEXP timeou
     free(ctx);
   free(raio);
   free(saio);
-  NANO_FREE(buf);
+  free(qn);
+  nano_msg_free(msg);
   return mk_error_data(xc);
 
 }
@@ -539,11 +863,13 @@ SEXP rnng_set_promise_context(SEXP x, SEXP ctx) {
   case IOV_RECVAIO:
   case IOV_RECVAIOS:
   case HTTP_AIO:
+  case BATCH_RECVAIO:
     NANO_SET_ENCLOS(x, ctx);
     raio->cb = nano_PreserveObject(x);
     break;
   case SENDAIO:
   case IOV_SENDAIO:
+  case BATCH_SENDAIO:
     break;
   }
 
@@ -553,6 +879,132 @@ SEXP rnng_set_promise_context(SEXP x, SEXP ctx) {
 
 // pipes -----------------------------------------------------------------------
 
+// nng allows one pipe callback per event, so a single dispatcher is registered
+// per socket, passing each event to routes and conflators before the callback
+// set by pipe_notify() or monitor(), which is held here in place of nng
+
+typedef struct nano_pipe_hook_s {
+  int sock;
+  nng_pipe_cb cb[2];
+  void *arg[2];
+  struct nano_pipe_hook_s *next;
+} nano_pipe_hook;
+
+static nng_mtx *nano_pipe_mtx = NULL;
+static nano_pipe_hook *nano_pipe_hooks = NULL;
+
+static nano_pipe_hook *nano_pipe_hook_find(const int sock) {
+
+  for (nano_pipe_hook *h = nano_pipe_hooks; h != NULL; h = h->next) {
+    if (h->sock == sock)
+      return h;
+  }
+  return NULL;
+
+}
+
+static void pipe_cb_dispatch(nng_pipe p, nng_pipe_ev ev, void *arg) {
+
+  nano_route_event(p, ev);
+  nano_conflate_event(p, ev);
+
+  const int rem = ev == NNG_PIPE_EV_REM_POST;
+  nng_pipe_cb cb = NULL;
+  void *cbarg = NULL;
+  nng_mtx_lock(nano_pipe_mtx);
+  nano_pipe_hook *h = nano_pipe_hook_find(nng_socket_id(nng_pipe_socket(p)));
+  if (h != NULL) {
+    cb = h->cb[rem];
+    cbarg = h->arg[rem];
+  }
+  nng_mtx_unlock(nano_pipe_mtx);
+
+  if (cb != NULL)
+    cb(p, ev, cbarg);
+
+}
+
+static int nano_pipe_hook_set(nng_socket sock, const int ev, const int set, nng_pipe_cb cb, void *arg) {
+
+  int xc;
+  if (nano_pipe_mtx == NULL && (xc = nng_mtx_alloc(&nano_pipe_mtx)))
+    return xc;
+
+  const int id = nng_socket_id(sock);
+  nng_mtx_lock(nano_pipe_mtx);
+  nano_pipe_hook *h = nano_pipe_hook_find(id);
+  if (h == NULL) {
+    if ((h = calloc(1, sizeof(nano_pipe_hook))) == NULL) {
+      nng_mtx_unlock(nano_pipe_mtx);
+      return 2;
+    }
+    h->sock = id;
+    h->next = nano_pipe_hooks;
+    nano_pipe_hooks = h;
+  }
+  if (set) {
+    const int rem = ev == NNG_PIPE_EV_REM_POST;
+    h->cb[rem] = cb;
+    h->arg[rem] = arg;
+  }
+  nng_mtx_unlock(nano_pipe_mtx);
+
+  return nng_pipe_notify(sock, (nng_pipe_ev) ev, pipe_cb_dispatch, NULL);
+
+}
+
+static int nano_pipe_notify(nng_socket sock, nng_pipe_ev ev, nng_pipe_cb cb, void *arg) {
+
+  return nano_pipe_hook_set(sock, ev, 1, cb, arg);
+
+}
+
+// ensures events reach routes and conflators, keeping any callback already set
+static int nano_pipe_listen(nng_socket sock) {
+
+  int xc;
+  if ((xc = nano_pipe_hook_set(sock, NNG_PIPE_EV_ADD_POST, 0, NULL, NULL)) ||
+      (xc = nano_pipe_hook_set(sock, NNG_PIPE_EV_REM_POST, 0, NULL, NULL)))
+    return xc;
+  return 0;
+
+}
+
+static void nano_pipe_hook_remove(const int sock) {
+
+  if (nano_pipe_mtx == NULL)
+    return;
+
+  nng_mtx_lock(nano_pipe_mtx);
+  nano_pipe_hook **hp = &nano_pipe_hooks, *h;
+  while ((h = *hp) != NULL) {
+    if (h->sock == sock) {
+      *hp = h->next;
+      free(h);
+      break;
+    }
+    hp = &h->next;
+  }
+  nng_mtx_unlock(nano_pipe_mtx);
+
+}
+
+void nano_pipe_hook_free(void) {
+
+  nano_pipe_hook *h = nano_pipe_hooks, *next;
+  while (h != NULL) {
+    next = h->next;
+    free(h);
+    h = next;
+  }
+  nano_pipe_hooks = NULL;
+  if (nano_pipe_mtx != NULL) {
+    nng_mtx_free(nano_pipe_mtx);
+    nano_pipe_mtx = NULL;
+  }
+
+}
+
 SEXP rnng_pipe_notify(SEXP socket, SEXP cv, SEXP add, SEXP remove, SEXP flag) {
 
   if (NANO_PTR_CHECK(socket, nano_SocketSymbol))
@@ -564,10 +1016,10 @@ SEXP rnng_pipe_notify(SEXP socket, SEXP cv, SEXP add, SEXP remove, SEXP flag) {
   if (cv == R_NilValue) {
 
     sock = (nng_socket *) NANO_PTR(socket);
-    if (NANO_INTEGER(add) && (xc = nng_pipe_notify(*sock, NNG_PIPE_EV_ADD_POST, NULL, NULL)))
+    if (NANO_INTEGER(add) && (xc = nano_pipe_notify(*sock, NNG_PIPE_EV_ADD_POST, NULL, NULL)))
       ERROR_OUT(xc);
 
-    if (NANO_INTEGER(remove) && (xc = nng_pipe_notify(*sock, NNG_PIPE_EV_REM_POST, NULL, NULL)))
+    if (NANO_INTEGER(remove) && (xc = nano_pipe_notify(*sock, NNG_PIPE_EV_REM_POST, NULL, NULL)))
       ERROR_OUT(xc);
 
     return nano_success;
@@ -582,10 +1034,10 @@ SEXP rnng_pipe_notify(SEXP socket, SEXP cv, SEXP add, SEXP remove, SEXP flag) {
 
   cvp->flag = flg < 0 ? 1 : flg;
 
-  if (NANO_INTEGER(add) && (xc = nng_pipe_notify(*sock, NNG_PIPE_EV_ADD_POST, pipe_cb_signal, cvp)))
+  if (NANO_INTEGER(add) && (xc = nano_pipe_notify(*sock, NNG_PIPE_EV_ADD_POST, pipe_cb_signal, cvp)))
     ERROR_OUT(xc);
 
-  if (NANO_INTEGER(remove) && (xc = nng_pipe_notify(*sock, NNG_PIPE_EV_REM_POST, pipe_cb_signal, cvp)))
+  if (NANO_INTEGER(remove) && (xc = nano_pipe_notify(*sock, NNG_PIPE_EV_REM_POST, pipe_cb_signal, cvp)))
     ERROR_OUT(xc);
 
   R_MakeWeakRef(socket, cv, R_NilValue, FALSE);
@@ -615,10 +1067,10 @@ SEXP rnng_monitor_create(SEXP socket, SEXP cv) {
   monitor->cv = (nano_cv *) NANO_PTR(cv);
   nng_socket *sock = (nng_socket *) NANO_PTR(socket);
 
-  if ((xc = nng_pipe_notify(*sock, NNG_PIPE_EV_ADD_POST, pipe_cb_monitor, monitor)))
+  if ((xc = nano_pipe_notify(*sock, NNG_PIPE_EV_ADD_POST, pipe_cb_monitor, monitor)))
     goto fail;
 
-  if ((xc = nng_pipe_notify(*sock, NNG_PIPE_EV_REM_POST, pipe_cb_monitor, monitor)))
+  if ((xc = nano_pipe_notify(*sock, NNG_PIPE_EV_REM_POST, pipe_cb_monitor, monitor)))
     goto fail;
 
   PROTECT(xptr = R_MakeExternalPtr(monitor, nano_MonitorSymbol, R_NilValue));
@@ -664,3 +1116,705 @@ SEXP rnng_monitor_read(SEXP x) {
   return out;
 
 }
+
+// pipe routing ----------------------------------------------------------------
+
+// routes are held in a registry keyed by socket id, consulted by the pipe event
+// dispatcher, and by completions to account for each reply from a pipe
+
+typedef struct nano_route_pipe_s {
+  uint32_t id;
+  int inflight;
+  int head;
+  int pending;
+  double latency;
+  double sent;
+  uint64_t times[NANONEXT_ROUTE_RING];
+} nano_route_pipe;
+
+typedef struct nano_route_s {
+  int sock;
+  int policy;
+  int n;
+  int size;
+  nano_route_pipe *pipes;
+  struct nano_route_s *next;
+} nano_route;
+
+static nng_mtx *nano_route_mtx = NULL;
+static nano_route *nano_routes = NULL;
+static atomic_int nano_route_count = 0;
+
+static nano_route *nano_route_find(const int sock) {
+
+  for (nano_route *r = nano_routes; r != NULL; r = r->next) {
+    if (r->sock == sock)
+      return r;
+  }
+  return NULL;
+
+}
+
+static nano_route_pipe *nano_route_pipe_find(nano_route *r, const uint32_t id) {
+
+  for (int i = 0; i < r->n; i++) {
+    if (r->pipes[i].id == id)
+      return &r->pipes[i];
+  }
+  return NULL;
+
+}
+
+static void nano_route_pipe_add(nano_route *r, const uint32_t id) {
+
+  if (nano_route_pipe_find(r, id) != NULL)
+    return;
+  if (r->n >= r->size) {
+    nano_route_pipe *pipes = realloc(r->pipes, (r->size + 8) * sizeof(nano_route_pipe));
+    if (pipes == NULL)
+      return;
+    r->pipes = pipes;
+    r->size += 8;
+  }
+  memset(&r->pipes[r->n], 0, sizeof(nano_route_pipe));
+  r->pipes[r->n++].id = id;
+
+}
+
+void nano_route_event(nng_pipe p, nng_pipe_ev ev) {
+
+  if (!atomic_load_explicit(&nano_route_count, memory_order_acquire))
+    return;
+
+  nng_mtx_lock(nano_route_mtx);
+  nano_route *r = nano_route_find(nng_socket_id(nng_pipe_socket(p)));
+  if (r != NULL) {
+    if (ev == NNG_PIPE_EV_ADD_POST) {
+      nano_route_pipe_add(r, p.id);
+    } else {
+      nano_route_pipe *rp = nano_route_pipe_find(r, p.id);
+      if (rp != NULL)
+        *rp = r->pipes[--r->n];
+    }
+  }
+  nng_mtx_unlock(nano_route_mtx);
+
+}
+
+// least-loaded takes the fewest in flight, breaking ties on latency, whilst
+// latency takes the lowest expected completion time, pipes without a sample
+// yet being assumed as fast as the fastest so that each is tried
+int nano_route_pick(const int sock, nng_msg *msg) {
+
+  if (!atomic_load_explicit(&nano_route_count, memory_order_acquire))
+    return 0;
+
+  int routed = 0;
+  nng_mtx_lock(nano_route_mtx);
+  nano_route *r = nano_route_find(sock);
+  if (r != NULL && r->policy && r->n) {
+    double fastest = 0;
+    for (int i = 0; i < r->n; i++) {
+      const double lat = r->pipes[i].latency;
+      if (lat > 0 && (fastest == 0 || lat < fastest))
+        fastest = lat;
+    }
+    nano_route_pipe *best = NULL;
+    double bscore = 0;
+    for (int i = 0; i < r->n; i++) {
+      nano_route_pipe *rp = &r->pipes[i];
+      const double lat = rp->latency > 0 ? rp->latency : fastest;
+      const double score = r->policy == 1 ? rp->inflight + lat / (lat + 1e9) : lat * (rp->inflight + 1) + rp->inflight;
+      if (best == NULL || score < bscore) {
+        best = rp;
+        bscore = score;
+      }
+    }
+    best->inflight++;
+    best->sent++;
+    if (best->pending < NANONEXT_ROUTE_RING) {
+      best->times[(best->head + best->pending) % NANONEXT_ROUTE_RING] = nano_hrtime();
+      best->pending++;
+    }
+    nng_pipe p;
+    p.id = best->id;
+    nng_msg_set_pipe(msg, p);
+    routed = 1;
+  }
+  nng_mtx_unlock(nano_route_mtx);
+
+  return routed;
+
+}
+
+static void nano_route_update(nng_msg *msg, const int ack) {
+
+  if (!atomic_load_explicit(&nano_route_count, memory_order_acquire))
+    return;
+
+  nng_pipe p = nng_msg_get_pipe(msg);
+  if (!p.id)
+    return;
+
+  nng_mtx_lock(nano_route_mtx);
+  nano_route *r = nano_route_find(nng_socket_id(nng_pipe_socket(p)));
+  nano_route_pipe *rp = r == NULL ? NULL : nano_route_pipe_find(r, p.id);
+  if (rp != NULL) {
+    if (rp->inflight)
+      rp->inflight--;
+    if (ack) {
+      if (rp->pending) {
+        const double sample = (double) (nano_hrtime() - rp->times[rp->head]) / 1000;
+        rp->latency = rp->latency > 0 ? 0.8 * rp->latency + 0.2 * sample : sample;
+        rp->head = (rp->head + 1) % NANONEXT_ROUTE_RING;
+        rp->pending--;
+      }
+    } else {
+      rp->sent--;
+      if (rp->pending)
+        rp->pending--;
+    }
+  }
+  nng_mtx_unlock(nano_route_mtx);
+
+}
+
+void nano_route_ack(nng_msg *msg) {
+
+  nano_route_update(msg, 1);
+
+}
+
+void nano_route_undo(nng_msg *msg) {
+
+  nano_route_update(msg, 0);
+
+}
+
+static void nano_route_remove(const int sock) {
+
+  if (!atomic_load_explicit(&nano_route_count, memory_order_acquire))
+    return;
+
+  nng_mtx_lock(nano_route_mtx);
+  nano_route **rp = &nano_routes, *r;
+  while ((r = *rp) != NULL) {
+    if (r->sock == sock) {
+      *rp = r->next;
+      free(r->pipes);
+      free(r);
+      atomic_fetch_sub(&nano_route_count, 1);
+      break;
+    }
+    rp = &r->next;
+  }
+  nng_mtx_unlock(nano_route_mtx);
+
+}
+
+void nano_route_free(void) {
+
+  nano_route *r = nano_routes, *next;
+  while (r != NULL) {
+    next = r->next;
+    free(r->pipes);
+    free(r);
+    r = next;
+  }
+  nano_routes = NULL;
+  atomic_store(&nano_route_count, 0);
+  if (nano_route_mtx != NULL) {
+    nng_mtx_free(nano_route_mtx);
+    nano_route_mtx = NULL;
+  }
+
+}
+
+// pipes already connected are found from the stats tree, after the callbacks
+// are in place so that none are missed
+static void nano_route_seed(nano_route *r) {
+
+  nng_stat *nst;
+  if (nng_stats_get(&nst))
+    return;
+
+  for (nng_stat *sst = nng_stat_child(nst); sst != NULL; sst = nng_stat_next(sst)) {
+    if (strcmp(nng_stat_name(sst), "pipe")) continue;
+    nng_stat *ssock = nng_stat_find(sst, "socket");
+    nng_stat *sid = nng_stat_find(sst, "id");
+    if (ssock != NULL && sid != NULL && (int) nng_stat_value(ssock) == r->sock)
+      nano_route_pipe_add(r, (uint32_t) nng_stat_value(sid));
+  }
+  nng_stats_free(nst);
+
+}
+
+// registers a socket for its pipes to be tracked, with a routing policy, or
+// if negative, leaving any policy already set
+static int nano_route_add(nng_socket sock, const int policy) {
+
+  int xc;
+  if (nano_route_mtx == NULL && (xc = nng_mtx_alloc(&nano_route_mtx)))
+    return xc;
+
+  const int id = nng_socket_id(sock);
+  nng_mtx_lock(nano_route_mtx);
+  nano_route *r = nano_route_find(id);
+  if (r != NULL && policy >= 0)
+    r->policy = policy;
+  nng_mtx_unlock(nano_route_mtx);
+  if (r != NULL)
+    return 0;
+
+  if ((xc = nano_pipe_listen(sock)))
+    return xc;
+  if ((r = calloc(1, sizeof(nano_route))) == NULL)
+    return NNG_ENOMEM;
+  r->sock = id;
+  r->policy = policy > 0 ? policy : 0;
+  nng_mtx_lock(nano_route_mtx);
+  r->next = nano_routes;
+  nano_routes = r;
+  atomic_fetch_add(&nano_route_count, 1);
+  nano_route_seed(r);
+  nng_mtx_unlock(nano_route_mtx);
+
+  return 0;
+
+}
+
+// tracks the pipes of a socket without routing, for nano_route_all()
+int nano_route_track(nng_socket sock) {
+
+  return nano_route_add(sock, -1);
+
+}
+
+// whether a socket has pipes and each passes check, for a message that may
+// be sent over any of them
+int nano_route_all(const int sock, int (*check)(nng_pipe)) {
+
+  if (!atomic_load_explicit(&nano_route_count, memory_order_acquire))
+    return 0;
+
+  int ok = 0;
+  nng_mtx_lock(nano_route_mtx);
+  nano_route *r = nano_route_find(sock);
+  if (r != NULL && r->n) {
+    ok = 1;
+    for (int i = 0; i < r->n && ok; i++) {
+      nng_pipe p;
+      p.id = r->pipes[i].id;
+      ok = check(p);
+    }
+  }
+  nng_mtx_unlock(nano_route_mtx);
+
+  return ok;
+
+}
+
+SEXP rnng_pipe_route(SEXP socket, SEXP policy) {
+
+  if (NANO_PTR_CHECK(socket, nano_SocketSymbol))
+    Rf_error("`socket` is not a valid Socket");
+
+  nng_socket *sock = (nng_socket *) NANO_PTR(socket);
+  const int id = nng_socket_id(*sock);
+  int xc;
+
+  if (policy != R_NilValue) {
+    SEXP proto = Rf_getAttrib(socket, nano_ProtocolSymbol);
+    if (TYPEOF(proto) != STRSXP || strcmp(NANO_STRING(proto), "poly"))
+      Rf_error("`socket` must use the 'poly' protocol for pipe routing");
+    const char *pol = TYPEOF(policy) == STRSXP ? CHAR(STRING_ELT(policy, 0)) : "";
+    const int pl = !strcmp(pol, "none") ? 0 : !strcmp(pol, "least-loaded") ? 1 : !strcmp(pol, "latency") ? 2 : -1;
+    if (pl < 0)
+      Rf_error("`policy` should be one of: none, least-loaded, latency");
+
+    int tracked = 0;
+    if (nano_route_mtx != NULL) {
+      nng_mtx_lock(nano_route_mtx);
+      tracked = nano_route_find(id) != NULL;
+      nng_mtx_unlock(nano_route_mtx);
+    }
+    if ((pl || tracked) && (xc = nano_route_add(*sock, pl)))
+      ERROR_OUT(xc);
+  }
+
+  const char *names[] = {"policy", "pipes", ""};
+  const char *cols[] = {"id", "inflight", "latency", "sent"};
+  const char *policies[] = {"none", "least-loaded", "latency"};
+  SEXP out, mat, dimnames, cnames;
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+
+  int n = 0, pl = 0;
+  if (nano_route_mtx != NULL) {
+    nng_mtx_lock(nano_route_mtx);
+    nano_route *r = nano_route_find(id);
+    if (r != NULL) {
+      n = r->n;
+      pl = r->policy;
+    }
+    nng_mtx_unlock(nano_route_mtx);
+  }
+  SET_VECTOR_ELT(out, 0, Rf_mkString(policies[pl]));
+  mat = Rf_allocMatrix(REALSXP, n, 4);
+  SET_VECTOR_ELT(out, 1, mat);
+  double *val = REAL(mat);
+  for (int i = 0; i < 4 * n; i++)
+    val[i] = NA_REAL;
+
+  // pipes may have been removed in the meantime, leaving trailing rows NA
+  if (n) {
+    nng_mtx_lock(nano_route_mtx);
+    nano_route *r = nano_route_find(id);
+    const int m = r == NULL ? 0 : r->n < n ? r->n : n;
+    for (int i = 0; i < m; i++) {
+      nano_route_pipe *rp = &r->pipes[i];
+      val[i] = (double) rp->id;
+      val[i + n] = (double) rp->inflight;
+      val[i + 2 * n] = rp->latency > 0 ? rp->latency / 1000 : NA_REAL;
+      val[i + 3 * n] = rp->sent;
+    }
+    nng_mtx_unlock(nano_route_mtx);
+  }
+
+  PROTECT(dimnames = Rf_allocVector(VECSXP, 2));
+  cnames = Rf_allocVector(STRSXP, 4);
+  SET_VECTOR_ELT(dimnames, 1, cnames);
+  for (int i = 0; i < 4; i++)
+    SET_STRING_ELT(cnames, i, Rf_mkChar(cols[i]));
+  Rf_setAttrib(mat, R_DimNamesSymbol, dimnames);
+
+  UNPROTECT(2);
+  return out;
+
+}
+
+// conflation ------------------------------------------------------------------
+
+// sends on a conflated pub socket matching a topic replace the value held for
+// that topic, the latest held values being published by a thread once each
+// interval, and all values again at the next interval after a pipe is added
+
+typedef struct nano_conflate_topic_s {
+  unsigned char *key;
+  size_t len;
+  uint64_t hash;
+  nng_msg *last;
+  int dirty;
+} nano_conflate_topic;
+
+typedef struct nano_conflate_s {
+  int sock;
+  nng_socket socket;
+  int interval;
+  int stop;
+  int snapshot;
+  int n;
+  int nlens;
+  int mask;
+  int *slots;
+  size_t *lens;
+  nano_conflate_topic *topics;
+  nng_msg **out;
+  nng_mtx *mtx;
+  nng_cv *cv;
+  nng_thread *thr;
+  struct nano_conflate_s *next;
+} nano_conflate;
+
+static nng_mtx *nano_conflate_mtx = NULL;
+static nano_conflate *nano_conflates = NULL;
+static atomic_int nano_conflate_count = 0;
+
+static uint64_t nano_conflate_hash(const unsigned char *buf, const size_t len) {
+
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= buf[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+
+}
+
+// the longest matching topic is found by hashing the message prefix at each
+// distinct topic length, longest first
+static nano_conflate_topic *nano_conflate_match(nano_conflate *c, const unsigned char *buf, const size_t len) {
+
+  for (int i = 0; i < c->nlens; i++) {
+    const size_t tlen = c->lens[i];
+    if (tlen > len) continue;
+    const uint64_t h = nano_conflate_hash(buf, tlen);
+    for (int j = (int) (h & c->mask); c->slots[j]; j = (j + 1) & c->mask) {
+      nano_conflate_topic *t = &c->topics[c->slots[j] - 1];
+      if (t->hash == h && t->len == tlen && !memcmp(t->key, buf, tlen))
+        return t;
+    }
+  }
+  return NULL;
+
+}
+
+static void nano_conflate_thread(void *arg) {
+
+  nano_conflate *c = (nano_conflate *) arg;
+  int stop, m;
+
+  do {
+    const nng_time time = nng_clock() + c->interval;
+    nng_mtx_lock(c->mtx);
+    while (!c->stop) {
+      if (nng_cv_until(c->cv, time) == NNG_ETIMEDOUT)
+        break;
+    }
+    stop = c->stop;
+    m = 0;
+    for (int i = 0; i < c->n; i++) {
+      nano_conflate_topic *t = &c->topics[i];
+      if (t->last != NULL && (t->dirty || c->snapshot) && !nng_msg_dup(&c->out[m], t->last))
+        m++;
+      t->dirty = 0;
+    }
+    c->snapshot = 0;
+    nng_mtx_unlock(c->mtx);
+
+    for (int i = 0; i < m; i++) {
+      if (nng_sendmsg(c->socket, c->out[i], NNG_FLAG_NONBLOCK))
+        nng_msg_free(c->out[i]);
+    }
+  } while (!stop);
+
+}
+
+static void nano_conflate_destroy(nano_conflate *c) {
+
+  if (c->thr != NULL) {
+    nng_mtx_lock(c->mtx);
+    c->stop = 1;
+    nng_cv_wake(c->cv);
+    nng_mtx_unlock(c->mtx);
+    nng_thread_destroy(c->thr);
+  }
+  for (int i = 0; i < c->n; i++) {
+    if (c->topics[i].last != NULL)
+      nng_msg_free(c->topics[i].last);
+    free(c->topics[i].key);
+  }
+  if (c->cv != NULL) nng_cv_free(c->cv);
+  if (c->mtx != NULL) nng_mtx_free(c->mtx);
+  free(c->topics);
+  free(c->slots);
+  free(c->lens);
+  free(c->out);
+  free(c);
+
+}
+
+static nano_conflate *nano_conflate_unlink(const int sock) {
+
+  nano_conflate **cp = &nano_conflates, *c;
+  while ((c = *cp) != NULL) {
+    if (c->sock == sock) {
+      *cp = c->next;
+      atomic_fetch_sub(&nano_conflate_count, 1);
+      return c;
+    }
+    cp = &c->next;
+  }
+  return NULL;
+
+}
+
+// takes ownership of the message if it matches a topic, returning 1
+int nano_conflate_put(const int sock, nng_msg *msg) {
+
+  if (!atomic_load_explicit(&nano_conflate_count, memory_order_acquire))
+    return 0;
+
+  nano_conflate *c = NULL;
+  nng_mtx_lock(nano_conflate_mtx);
+  for (c = nano_conflates; c != NULL; c = c->next) {
+    if (c->sock == sock)
+      break;
+  }
+  if (c == NULL) {
+    nng_mtx_unlock(nano_conflate_mtx);
+    return 0;
+  }
+  nng_mtx_lock(c->mtx);
+  nng_mtx_unlock(nano_conflate_mtx);
+
+  nano_conflate_topic *t = nano_conflate_match(c, (unsigned char *) nng_msg_body(msg), nng_msg_len(msg));
+  if (t != NULL) {
+    if (t->last != NULL)
+      nng_msg_free(t->last);
+    t->last = msg;
+    t->dirty = 1;
+  }
+  nng_mtx_unlock(c->mtx);
+
+  return t != NULL;
+
+}
+
+void nano_conflate_event(nng_pipe p, nng_pipe_ev ev) {
+
+  if (ev != NNG_PIPE_EV_ADD_POST || !atomic_load_explicit(&nano_conflate_count, memory_order_acquire))
+    return;
+
+  const int sock = nng_socket_id(nng_pipe_socket(p));
+  nng_mtx_lock(nano_conflate_mtx);
+  for (nano_conflate *c = nano_conflates; c != NULL; c = c->next) {
+    if (c->sock == sock) {
+      nng_mtx_lock(c->mtx);
+      c->snapshot = 1;
+      nng_mtx_unlock(c->mtx);
+      break;
+    }
+  }
+  nng_mtx_unlock(nano_conflate_mtx);
+
+}
+
+static void nano_conflate_remove(const int sock) {
+
+  if (!atomic_load_explicit(&nano_conflate_count, memory_order_acquire))
+    return;
+
+  nng_mtx_lock(nano_conflate_mtx);
+  nano_conflate *c = nano_conflate_unlink(sock);
+  nng_mtx_unlock(nano_conflate_mtx);
+  if (c != NULL)
+    nano_conflate_destroy(c);
+
+}
+
+void nano_conflate_free(void) {
+
+  nano_conflate *c = nano_conflates, *next;
+  while (c != NULL) {
+    next = c->next;
+    nano_conflate_destroy(c);
+    c = next;
+  }
+  nano_conflates = NULL;
+  atomic_store(&nano_conflate_count, 0);
+  if (nano_conflate_mtx != NULL) {
+    nng_mtx_free(nano_conflate_mtx);
+    nano_conflate_mtx = NULL;
+  }
+
+}
+
+SEXP rnng_conflate(SEXP socket, SEXP topics, SEXP interval) {
+
+  if (NANO_PTR_CHECK(socket, nano_SocketSymbol))
+    Rf_error("`socket` is not a valid Socket");
+
+  SEXP proto = Rf_getAttrib(socket, nano_ProtocolSymbol);
+  if (TYPEOF(proto) != STRSXP || strcmp(NANO_STRING(proto), "pub"))
+    Rf_error("`socket` must use the 'pub' protocol for conflation");
+
+  if (topics != R_NilValue && (TYPEOF(topics) != STRSXP || !XLENGTH(topics)))
+    Rf_error("`topics` must be a character vector");
+
+  const int ival = interval == R_NilValue ? 100 : nano_integer(interval);
+  if (ival <= 0)
+    Rf_error("`interval` must be a positive integer value");
+
+  nng_socket *sock = (nng_socket *) NANO_PTR(socket);
+  const int id = nng_socket_id(*sock);
+  int xc;
+
+  if (nano_conflate_mtx == NULL && (xc = nng_mtx_alloc(&nano_conflate_mtx)))
+    ERROR_OUT(xc);
+
+  // any existing conflator is stopped first, publishing its pending values
+  nano_conflate_remove(id);
+  if (topics == R_NilValue)
+    return socket;
+
+  if ((xc = nano_pipe_listen(*sock)))
+    ERROR_OUT(xc);
+
+  const int n = (int) XLENGTH(topics);
+  int size = 16;
+  while (size < 2 * n) size <<= 1;
+
+  nano_conflate *c = calloc(1, sizeof(nano_conflate));
+  NANO_ENSURE_ALLOC(c);
+  c->sock = id;
+  c->socket = *sock;
+  c->interval = ival;
+  c->mask = size - 1;
+  c->slots = calloc(size, sizeof(int));
+  c->lens = calloc(n, sizeof(size_t));
+  c->topics = calloc(n, sizeof(nano_conflate_topic));
+  c->out = calloc(n, sizeof(nng_msg *));
+  if (c->slots == NULL || c->lens == NULL || c->topics == NULL || c->out == NULL) {
+    xc = 2;
+    goto fail;
+  }
+
+  for (int i = 0; i < n; i++) {
+    const char *key = CHAR(STRING_ELT(topics, i));
+    const size_t len = strlen(key);
+    const uint64_t h = nano_conflate_hash((const unsigned char *) key, len);
+    int j = (int) (h & c->mask), dup = 0;
+    for (; c->slots[j]; j = (j + 1) & c->mask) {
+      nano_conflate_topic *t = &c->topics[c->slots[j] - 1];
+      if (t->hash == h && t->len == len && !memcmp(t->key, key, len)) {
+        dup = 1;
+        break;
+      }
+    }
+    if (dup) continue;
+    nano_conflate_topic *t = &c->topics[c->n];
+    if ((t->key = malloc(len + 1)) == NULL) {
+      xc = 2;
+      goto fail;
+    }
+    memcpy(t->key, key, len + 1);
+    t->len = len;
+    t->hash = h;
+    c->slots[j] = ++c->n;
+    int k = 0;
+    while (k < c->nlens && c->lens[k] > len) k++;
+    if (k == c->nlens || c->lens[k] != len) {
+      memmove(&c->lens[k + 1], &c->lens[k], (c->nlens - k) * sizeof(size_t));
+      c->lens[k] = len;
+      c->nlens++;
+    }
+  }
+
+  if ((xc = nng_mtx_alloc(&c->mtx)) ||
+      (xc = nng_cv_alloc(&c->cv, c->mtx)) ||
+      (xc = nano_thread_create(&c->thr, nano_conflate_thread, c)))
+    goto fail;
+
+  nng_mtx_lock(nano_conflate_mtx);
+  c->next = nano_conflates;
+  nano_conflates = c;
+  atomic_fetch_add(&nano_conflate_count, 1);
+  nng_mtx_unlock(nano_conflate_mtx);
+
+  return socket;
+
+  fail:
+  nano_conflate_destroy(c);
+  failmem:
+  ERROR_OUT(xc);
+
+}
+
+// called on socket finalization to release all state held by socket id
+void nano_socket_release(const int sock) {
+
+  nano_route_remove(sock);
+  nano_conflate_remove(sock);
+  nano_pipe_hook_remove(sock);
+
+}
@@ -2,31 +2,114 @@
 
 #define NANONEXT_PROTOCOLS
 #define NANONEXT_IO
+#define NANONEXT_AFFINITY
 #include "nanonext.h"
 
-// threads callable and messenger ----------------------------------------------
+// thread pools and CPU affinity -----------------------------------------------
+
+#ifdef __linux__
+static cpu_set_t nano_cpus;
+static int nano_cpus_on = 0;
+
+// parses a list such as '0-3,8,10-11', returning the number of CPUs set
+static int nano_cpus_parse(const char *s, cpu_set_t *set) {
+
+  char *end;
+  long lo, hi;
+
+  CPU_ZERO(set);
+  while (*s) {
+    lo = strtol(s, &end, 10);
+    if (end == s || lo < 0)
+      return 0;
+    hi = lo;
+    if (*end == '-') {
+      s = end + 1;
+      hi = strtol(s, &end, 10);
+      if (end == s || hi < lo)
+        return 0;
+    }
+    if (hi >= CPU_SETSIZE)
+      return 0;
+    for (long i = lo; i <= hi; i++)
+      CPU_SET((int) i, set);
+    s = end;
+    if (*s == ',')
+      s++;
+    else if (*s)
+      return 0;
+  }
+
+  return CPU_COUNT(set);
+
+}
+#endif
+
+static void nano_init_param(const char *name, const nng_init_parameter num, const nng_init_parameter max) {
+
+  const char *val = getenv(name);
+  if (val == NULL)
+    return;
+
+  char *end;
+  const long n = strtol(val, &end, 10);
+  if (end == val || *end || n <= 0 || n > INT_MAX)
+    return;
 
-static nng_mtx *nano_wait_mtx = NULL;
-static nng_cv *nano_wait_cv = NULL;
-static nng_thread *nano_wait_thr = NULL;
-static nng_aio *nano_shared_aio = NULL;
-static int nano_wait_condition = 0;
+  nng_init_set_parameter(num, (uint64_t) n);
+  if (max != NNG_INIT_PARAMETER_NONE)
+    nng_init_set_parameter(max, (uint64_t) n);
 
-void nano_thread_shutdown(void) {
-  if (nano_wait_thr == NULL)
+}
+
+// called once on package load, before NNG is initialised by its first use
+void nano_thread_init(void) {
+
+  nano_init_param("NANONEXT_TASK_THREADS", NNG_INIT_NUM_TASK_THREADS, NNG_INIT_MAX_TASK_THREADS);
+  nano_init_param("NANONEXT_EXPIRE_THREADS", NNG_INIT_NUM_EXPIRE_THREADS, NNG_INIT_MAX_EXPIRE_THREADS);
+  nano_init_param("NANONEXT_POLLER_THREADS", NNG_INIT_NUM_POLLER_THREADS, NNG_INIT_MAX_POLLER_THREADS);
+  nano_init_param("NANONEXT_RESOLVER_THREADS", NNG_INIT_NUM_RESOLVER_THREADS, NNG_INIT_PARAMETER_NONE);
+
+#ifdef __linux__
+  const char *cpus = getenv("NANONEXT_CPUS");
+  if (cpus == NULL || !nano_cpus_parse(cpus, &nano_cpus))
+    return;
+  nano_cpus_on = 1;
+
+  // threads inherit the affinity of their creator: NNG starts all of its
+  // threads on initialisation, so initialising it now with this thread pinned
+  // confines them to the set, leaving the R thread itself unaffected
+  cpu_set_t prev;
+  nng_mtx *mtx;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(prev), &prev) ||
+      pthread_setaffinity_np(pthread_self(), sizeof(nano_cpus), &nano_cpus))
     return;
-  if (nano_shared_aio != NULL)
-    nng_aio_stop(nano_shared_aio);
-  nng_mtx_lock(nano_wait_mtx);
-  nano_wait_condition = -1;
-  nng_cv_wake(nano_wait_cv);
-  nng_mtx_unlock(nano_wait_mtx);
-  nng_thread_destroy(nano_wait_thr);
-  nng_cv_free(nano_wait_cv);
-  nng_mtx_free(nano_wait_mtx);
-  nano_wait_thr = NULL;
+  if (!nng_mtx_alloc(&mtx))
+    nng_mtx_free(mtx);
+  pthread_setaffinity_np(pthread_self(), sizeof(prev), &prev);
+#endif
+
 }
 
+// creates threads confined to the configured CPU set, if any
+int nano_thread_create(nng_thread **thr, void (*func)(void *), void *arg) {
+
+#ifdef __linux__
+  cpu_set_t prev;
+  if (nano_cpus_on && !pthread_getaffinity_np(pthread_self(), sizeof(prev), &prev) &&
+      !pthread_setaffinity_np(pthread_self(), sizeof(nano_cpus), &nano_cpus)) {
+    const int xc = nng_thread_create(thr, func, arg);
+    pthread_setaffinity_np(pthread_self(), sizeof(prev), &prev);
+    return xc;
+  }
+#endif
+
+  return nng_thread_create(thr, func, arg);
+
+}
+
+// threads callable and messenger ----------------------------------------------
+
 // # nocov start
 // tested interactively
 
@@ -43,7 +126,7 @@ static SEXP rnng_thread_create(void (*func)(void *), void *arg) {
   nng_thread *thr;
   int xc;
 
-  if ((xc = nng_thread_create(&thr, func, arg)))
+  if ((xc = nano_thread_create(&thr, func, arg)))
     ERROR_OUT(xc);
 
   SEXP xptr = R_MakeExternalPtr(thr, R_NilValue, R_NilValue);
@@ -139,7 +222,7 @@ SEXP rnng_messenger(SEXP url) {
   int xc, dialer = 0;
   SEXP socket, con;
 
-  nng_socket *sock = malloc(sizeof(nng_socket));
+  nng_socket *sock = calloc(1, sizeof(nano_sock));
   NANO_ENSURE_ALLOC(sock);
 
   if ((xc = nng_pair0_open(sock)))
@@ -196,106 +279,6 @@ SEXP rnng_messenger_thread_create(SEXP args) {
 
 // threaded functions ----------------------------------------------------------
 
-// # nocov start
-// tested interactively
-
-static void thread_aio_finalizer(SEXP xptr) {
-
-  if (NANO_PTR(xptr) == NULL) return;
-  nano_thread_aio *xp = (nano_thread_aio *) NANO_PTR(xptr);
-  nano_cv *ncv = xp->cv;
-  nng_mtx *mtx = ncv->mtx;
-  nng_cv *cv = ncv->cv;
-  nng_aio_stop(xp->aio);
-  nng_thread_destroy(xp->thr);
-  nng_cv_free(cv);
-  nng_mtx_free(mtx);
-  free(ncv);
-  free(xp);
-
-}
-
-
-static void rnng_wait_thread_single(void *args) {
-
-  nano_thread_aio *taio = (nano_thread_aio *) args;
-  nano_cv *ncv = taio->cv;
-  nng_mtx *mtx = ncv->mtx;
-  nng_cv *cv = ncv->cv;
-
-  nng_aio_wait(taio->aio);
-
-  nng_mtx_lock(mtx);
-  ncv->condition = 1;
-  nng_cv_wake(cv);
-  nng_mtx_unlock(mtx);
-
-}
-
-void single_wait_thread_create(SEXP x) {
-
-  nano_aio *aiop = (nano_aio *) NANO_PTR(x);
-
-  int xc, signalled;
-  nano_thread_aio *taio = NULL;
-  nano_cv *ncv = NULL;
-
-  taio = malloc(sizeof(nano_thread_aio));
-  NANO_ENSURE_ALLOC(taio);
-  ncv = malloc(sizeof(nano_cv));
-  NANO_ENSURE_ALLOC(ncv);
-  taio->aio = aiop->aio;
-  taio->cv = ncv;
-  nng_mtx *mtx = NULL;
-  nng_cv *cv = NULL;
-
-  if ((xc = nng_mtx_alloc(&mtx)) ||
-      (xc = nng_cv_alloc(&cv, mtx)))
-    goto fail;
-
-  ncv->mtx = mtx;
-  ncv->cv = cv;
-
-  if ((xc = nng_thread_create(&taio->thr, rnng_wait_thread_single, taio)))
-    goto fail;
-
-  SEXP xptr;
-  PROTECT(xptr = R_MakeExternalPtr(taio, R_NilValue, R_NilValue));
-  R_RegisterCFinalizerEx(xptr, thread_aio_finalizer, TRUE);
-  R_MakeWeakRef(x, xptr, R_NilValue, TRUE);
-  UNPROTECT(1);
-
-  nng_time time = nng_clock();
-
-  while (1) {
-    time = time + 400;
-    signalled = 1;
-    nng_mtx_lock(mtx);
-    while (ncv->condition == 0) {
-      if (nng_cv_until(cv, time) == NNG_ETIMEDOUT) {
-        signalled = 0;
-        break;
-      }
-    }
-    nng_mtx_unlock(mtx);
-    if (signalled) break;
-    R_CheckUserInterrupt();
-  }
-
-  return;
-
-  fail:
-  nng_cv_free(cv);
-  nng_mtx_free(mtx);
-  failmem:
-  free(ncv);
-  free(taio);
-  ERROR_OUT(xc);
-
-}
-
-// # nocov end
-
 static void thread_duo_finalizer(SEXP xptr) {
 
   if (NANO_PTR(xptr) == NULL) return;
@@ -314,125 +297,6 @@ static void thread_duo_finalizer(SEXP xptr) {
 
 }
 
-static void rnng_wait_thread(void *args) {
-
-  while (1) {
-    nng_mtx_lock(nano_wait_mtx);
-    while (nano_wait_condition == 0)
-      nng_cv_wait(nano_wait_cv);
-    if (nano_wait_condition == -1) {
-      nng_mtx_unlock(nano_wait_mtx);
-      break;
-    }
-    nng_mtx_unlock(nano_wait_mtx);
-
-    nng_aio_wait(nano_shared_aio);
-
-    nng_mtx_lock(nano_wait_mtx);
-    nano_shared_aio = NULL;
-    nano_wait_condition = 0;
-    nng_cv_wake(nano_wait_cv);
-    nng_mtx_unlock(nano_wait_mtx);
-  }
-
-}
-
-SEXP rnng_wait_thread_create(SEXP x) {
-
-  const SEXPTYPE typ = TYPEOF(x);
-  if (typ == ENVSXP) {
-
-    const SEXP coreaio = Rf_findVarInFrame(x, nano_AioSymbol);
-    if (NANO_PTR_CHECK(coreaio, nano_AioSymbol))
-      return x;
-
-    nano_aio *aiop = (nano_aio *) NANO_PTR(coreaio);
-
-    int xc, signalled;
-
-    if (nano_wait_thr == NULL) {
-      if ((xc = nng_mtx_alloc(&nano_wait_mtx)) ||
-          (xc = nng_cv_alloc(&nano_wait_cv, nano_wait_mtx)) ||
-          (xc = nng_thread_create(&nano_wait_thr, rnng_wait_thread, NULL)))
-        goto fail;
-    }
-
-    int thread_required = 0;
-    nng_mtx_lock(nano_wait_mtx);
-    if (nano_wait_condition == 0) {
-      nano_shared_aio = aiop->aio;
-      nano_wait_condition = 1;
-      nng_cv_wake(nano_wait_cv);
-    } else {
-      thread_required = nano_shared_aio != aiop->aio;
-    }
-    nng_mtx_unlock(nano_wait_mtx);
-
-    if (thread_required) {
-
-      PROTECT(coreaio);
-      single_wait_thread_create(coreaio);
-      UNPROTECT(1);
-
-    } else {
-
-      nng_time time = nng_clock();
-
-      while (1) {
-        time = time + 400;
-        signalled = 1;
-        nng_mtx_lock(nano_wait_mtx);
-        while (nano_wait_condition == 1) {
-          if (nng_cv_until(nano_wait_cv, time) == NNG_ETIMEDOUT) {
-            signalled = 0;
-            break;
-          }
-        }
-        nng_mtx_unlock(nano_wait_mtx);
-        if (signalled) break;
-        R_CheckUserInterrupt();
-      }
-
-    }
-
-    switch (aiop->type) {
-    case RECVAIO:
-    case REQAIO:
-    case IOV_RECVAIO:
-    case RECVAIOS:
-    case REQAIOS:
-    case IOV_RECVAIOS:
-      rnng_aio_get_msg(x);
-      break;
-    case SENDAIO:
-    case IOV_SENDAIO:
-      rnng_aio_result(x);
-      break;
-    case HTTP_AIO:
-      rnng_aio_http_status(x);
-      break;
-    }
-
-    return x;
-
-    fail:
-    nng_cv_free(nano_wait_cv);
-    nng_mtx_free(nano_wait_mtx);
-    ERROR_OUT(xc);
-
-  } else if (typ == VECSXP) {
-
-    const R_xlen_t xlen = Rf_xlength(x);
-    for (R_xlen_t i = 0; i < xlen; i++) {
-      rnng_wait_thread_create(NANO_VECTOR(x)[i]);
-    }
-
-  }
-
-  return x;
-
-}
-
 static void rnng_signal_thread(void *args) {
 
   nano_thread_duo *duo = (nano_thread_duo *) args;
@@ -441,7 +305,6 @@ static void rnng_signal_thread(void *args) {
   nng_cv *cv = ncv->cv;
   nano_cv *ncv2 = duo->cv2;
   nng_mtx *mtx2 = ncv2->mtx;
-  nng_cv *cv2 = ncv2->cv;
 
   int incr, cond = 0;
 
@@ -461,7 +324,7 @@ static void rnng_signal_thread(void *args) {
 
     nng_mtx_lock(mtx2);
     ncv2->condition = ncv2->condition + incr;
-    nng_cv_wake(cv2);
+    nano_cv_wake(ncv2);
     nng_mtx_unlock(mtx2);
 
     nng_mtx_lock(mtx);
@@ -508,7 +371,7 @@ SEXP rnng_signal_thread_create(SEXP cv, SEXP cv2) {
   ncv->condition = 0;
   nng_mtx_unlock(dmtx);
 
-  if ((xc = nng_thread_create(&duo->thr, rnng_signal_thread, duo)))
+  if ((xc = nano_thread_create(&duo->thr, rnng_signal_thread, duo)))
     goto fail;
 
   SEXP xptr = R_MakeExternalPtr(duo, R_NilValue, R_NilValue);
@@ -593,7 +456,7 @@ SEXP rnng_read_stdin(SEXP interactive) {
   int xc;
   nng_socket *sock = NULL;
   nng_listener *lp = NULL;
-  sock = malloc(sizeof(nng_socket));
+  sock = calloc(1, sizeof(nano_sock));
   NANO_ENSURE_ALLOC(sock);
   lp = calloc(1, sizeof(nng_listener));
   NANO_ENSURE_ALLOC(lp);
@@ -605,7 +468,7 @@ SEXP rnng_read_stdin(SEXP interactive) {
 
   nng_thread *thr;
 
-  if ((xc = nng_thread_create(&thr, nano_read_thread, NULL)))
+  if ((xc = nano_thread_create(&thr, nano_read_thread, NULL)))
     ERROR_OUT(xc);
 
   SEXP socket, con, thread;
@@ -632,3 +495,168 @@ SEXP rnng_read_stdin(SEXP interactive) {
   ERROR_OUT(xc);
 
 }
+
+// benchmark driver ------------------------------------------------------------
+
+// the peer runs on its own thread and the timed loop entirely in C, so that
+// results reflect the library and transport without any R overhead
+
+typedef struct nano_bench_s {
+  nng_socket sock;
+  size_t size;
+  int count;
+  int echo;
+  int xc;
+  uint64_t end;
+} nano_bench;
+
+static void nano_bench_peer(void *arg) {
+
+  nano_bench *b = (nano_bench *) arg;
+  nng_msg *msg;
+  int xc = 0;
+
+  for (int i = 0; i < b->count; i++) {
+    if ((xc = nng_recvmsg(b->sock, &msg, 0)))
+      break;
+    if (b->echo) {
+      if ((xc = nng_sendmsg(b->sock, msg, 0))) {
+        nng_msg_free(msg);
+        break;
+      }
+    } else {
+      nng_msg_free(msg);
+    }
+  }
+  b->end = nano_hrtime();
+  b->xc = xc;
+
+}
+
+static int nano_bench_socket(nng_socket *sock, const int echo, const int server) {
+
+  int xc;
+  if ((xc = echo ? (server ? nng_rep0_open(sock) : nng_req0_open(sock)) :
+                   (server ? nng_pull0_open(sock) : nng_push0_open(sock))))
+    return xc;
+
+  if ((xc = nng_socket_set_size(*sock, NNG_OPT_RECVMAXSZ, 0)) ||
+      (xc = nng_socket_set_ms(*sock, NNG_OPT_RECVTIMEO, 10000)) ||
+      (xc = nng_socket_set_ms(*sock, NNG_OPT_SENDTIMEO, 10000)) ||
+      (echo && !server && (xc = nng_socket_set_ms(*sock, NNG_OPT_REQ_RESENDTIME, NNG_DURATION_INFINITE)))) {
+    nng_close(*sock);
+    return xc;
+  }
+
+  return 0;
+
+}
+
+SEXP rnng_bench(SEXP url, SEXP size, SEXP count, SEXP latency, SEXP tls) {
+
+  const char *up = CHAR(STRING_ELT(url, 0));
+  const int n = nano_integer(count);
+  const double dsz = Rf_asReal(size);
+  const int echo = NANO_INTEGER(latency);
+  if (n <= 0)
+    Rf_error("`count` must be a positive integer");
+  if (!(dsz >= 0))
+    Rf_error("`size` must be a non-negative numeric value");
+  nng_tls_config *scfg = NULL, *ccfg = NULL;
+  if (tls != R_NilValue) {
+    if (TYPEOF(tls) != VECSXP || XLENGTH(tls) != 2 ||
+        NANO_PTR_CHECK(VECTOR_ELT(tls, 0), nano_TlsSymbol) ||
+        NANO_PTR_CHECK(VECTOR_ELT(tls, 1), nano_TlsSymbol))
+      Rf_error("`tls` must be a list of server and client 'tlsConfig'");
+    scfg = (nng_tls_config *) NANO_PTR(VECTOR_ELT(tls, 0));
+    ccfg = (nng_tls_config *) NANO_PTR(VECTOR_ELT(tls, 1));
+  }
+
+  nano_bench b = {.size = (size_t) dsz, .count = n, .echo = echo, .xc = 0, .end = 0};
+  nng_socket csock;
+  nng_listener lp;
+  nng_dialer dp;
+  nng_thread *thr = NULL;
+  nano_hist *h = NULL;
+  nng_msg *msg;
+  uint64_t start = 0;
+  int xc, sent = 0;
+
+  if (echo && (h = calloc(1, sizeof(nano_hist))) == NULL)
+    Rf_error("memory allocation failed");
+
+  if ((xc = nano_bench_socket(&b.sock, echo, 1)))
+    goto failmem;
+
+  if ((xc = nano_bench_socket(&csock, echo, 0)))
+    goto failserv;
+
+  if ((xc = nng_listener_create(&lp, b.sock, up)) ||
+      (scfg != NULL && (xc = nng_listener_set_ptr(lp, NNG_OPT_TLS_CONFIG, scfg))) ||
+      (xc = nng_listener_start(lp, 0)) ||
+      (xc = nng_dialer_create(&dp, csock, up)) ||
+      (ccfg != NULL && (xc = nng_dialer_set_ptr(dp, NNG_OPT_TLS_CONFIG, ccfg))) ||
+      (xc = nng_dialer_start(dp, 0)) ||
+      (xc = nano_thread_create(&thr, nano_bench_peer, &b)))
+    goto fail;
+
+  start = nano_hrtime();
+  for (; sent < n; sent++) {
+    if ((xc = nng_msg_alloc(&msg, b.size)))
+      break;
+    const uint64_t t0 = h != NULL ? nano_hrtime() : 0;
+    if ((xc = nng_sendmsg(csock, msg, 0))) {
+      nng_msg_free(msg);
+      break;
+    }
+    if (echo) {
+      if ((xc = nng_recvmsg(csock, &msg, 0)))
+        break;
+      nng_msg_free(msg);
+      nano_hist_record(h, 0, t0);
+    }
+  }
+  if (xc)
+    nng_close(b.sock);
+  nng_thread_destroy(thr);
+  if (!xc)
+    xc = b.xc;
+  if (xc)
+    goto fail;
+
+  nng_close(csock);
+  nng_close(b.sock);
+
+  const char *names[] = {"count", "size", "seconds", "msgs_per_sec", "mb_per_sec",
+                         "mean", "p50", "p90", "p99", "p999", "max", ""};
+  SEXP out = PROTECT(Rf_mkNamed(REALSXP, names));
+  double *val = REAL(out);
+  const double secs = (double) (b.end - start) / 1e9;
+  val[0] = (double) n;
+  val[1] = (double) b.size;
+  val[2] = secs;
+  val[3] = secs > 0 ? n / secs : NA_REAL;
+  val[4] = secs > 0 ? (double) n * b.size / secs / 1e6 : NA_REAL;
+  if (echo) {
+    double sum[7];
+    nano_hist_summary(&h->series[0], sum, 1, 0);
+    for (int i = 1; i < 7; i++)
+      val[4 + i] = sum[i];
+  } else {
+    for (int i = 5; i < 11; i++)
+      val[i] = NA_REAL;
+  }
+
+  free(h);
+  UNPROTECT(1);
+  return out;
+
+  fail:
+  nng_close(csock);
+  failserv:
+  nng_close(b.sock);
+  failmem:
+  free(h);
+  ERROR_OUT(xc);
+
+}
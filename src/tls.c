@@ -5,20 +5,13 @@
 
 // internals -------------------------------------------------------------------
 
-static SEXP nano_hash_char(unsigned char *buf, const size_t sz) {
+static void nano_hex(char *out, const unsigned char *buf, const size_t sz) {
 
-  SEXP out;
-  char cbuf[sz + sz + 1];
-  char *cptr = cbuf;
-
-  for (size_t i = 0; i < sz; i++)
-    cptr += snprintf(cptr, 3, "%.2x", buf[i]);
-
-  PROTECT(out = Rf_allocVector(STRSXP, 1));
-  SET_STRING_ELT(out, 0, Rf_mkCharLenCE(cbuf, (int) (sz + sz), CE_NATIVE));
-
-  UNPROTECT(1);
-  return out;
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < sz; i++) {
+    out[i + i] = digits[buf[i] >> 4];
+    out[i + i + 1] = digits[buf[i] & 0x0f];
+  }
 
 }
 
@@ -62,49 +55,138 @@ static int parse_serial_decimal_format(unsigned char *obuf, size_t obufmax,
 
 // Mbed TLS Random Data Generator ----------------------------------------------
 
-SEXP rnng_random(SEXP n, SEXP convert) {
+// a single DRBG is seeded on first use and shared by all calls, being reseeded
+// from the entropy source automatically at the reseed interval, and in full
+// within a forked child process so that its output is never duplicated
+
+static nng_mtx *nano_rng_mtx = NULL;
+static mbedtls_entropy_context nano_rng_entropy;
+static mbedtls_ctr_drbg_context nano_rng_drbg;
+static int nano_rng_seeded = 0;
+#ifndef _WIN32
+static pid_t nano_rng_pid;
+#endif
+
+static void nano_rng_clear(void) {
+
+  if (nano_rng_seeded) {
+    mbedtls_ctr_drbg_free(&nano_rng_drbg);
+    mbedtls_entropy_free(&nano_rng_entropy);
+    nano_rng_seeded = 0;
+  }
+
+}
+
+static int nano_rng_seed(void) {
+
+  const char *pers = "r-nanonext-rng";
+  int xc;
+
+  nano_rng_clear();
+  mbedtls_entropy_init(&nano_rng_entropy);
+  mbedtls_ctr_drbg_init(&nano_rng_drbg);
+  if ((xc = mbedtls_ctr_drbg_seed(&nano_rng_drbg, mbedtls_entropy_func, &nano_rng_entropy, (const unsigned char *) pers, strlen(pers)))) {
+    mbedtls_ctr_drbg_free(&nano_rng_drbg);
+    mbedtls_entropy_free(&nano_rng_entropy);
+    return xc;
+  }
+  mbedtls_ctr_drbg_set_reseed_interval(&nano_rng_drbg, NANONEXT_RNG_RESEED);
+#ifndef _WIN32
+  nano_rng_pid = getpid();
+#endif
+  nano_rng_seeded = 1;
 
-  int sz, xc;
+  return 0;
+
+}
+
+static int nano_rng_fill(unsigned char *buf, size_t sz) {
+
+  int xc = 0;
+  if (nano_rng_mtx == NULL && (xc = nng_mtx_alloc(&nano_rng_mtx)))
+    return xc;
+
+  nng_mtx_lock(nano_rng_mtx);
+#ifndef _WIN32
+  if (!nano_rng_seeded || nano_rng_pid != getpid())
+#else
+  if (!nano_rng_seeded)
+#endif
+    xc = nano_rng_seed();
+  while (xc == 0 && sz) {
+    const size_t len = sz > MBEDTLS_CTR_DRBG_MAX_REQUEST ? MBEDTLS_CTR_DRBG_MAX_REQUEST : sz;
+    xc = mbedtls_ctr_drbg_random(&nano_rng_drbg, buf, len);
+    buf += len;
+    sz -= len;
+  }
+  nng_mtx_unlock(nano_rng_mtx);
+
+  return xc;
+
+}
+
+void nano_rng_free(void) {
+
+  nano_rng_clear();
+  if (nano_rng_mtx != NULL) {
+    nng_mtx_free(nano_rng_mtx);
+    nano_rng_mtx = NULL;
+  }
+
+}
+
+SEXP rnng_random(SEXP n, SEXP convert, SEXP count) {
+
+  int sz, cnt = 1;
   switch (TYPEOF(n)) {
   case INTSXP:
   case LGLSXP:
     sz = NANO_INTEGER(n);
-    if (sz >= 0 && sz <= 1024) break;
+    if (sz >= 0) break;
   case REALSXP:
     sz = Rf_asInteger(n);
-    if (sz >= 0 && sz <= 1024) break;
+    if (sz >= 0) break;
   default:
-    Rf_error("`n` must be an integer value between 0 and 1024");
+    Rf_error("`n` must be a non-negative integer value");
   }
+  if (count != R_NilValue && (cnt = nano_integer(count)) < 0)
+    Rf_error("`count` must be a non-negative integer value");
 
-  SEXP out;
-  unsigned char buf[sz];
-  mbedtls_entropy_context entropy;
-  mbedtls_ctr_drbg_context ctr_drbg;
-  const char *pers = "r-nanonext-rng";
+  const int conv = NANO_INTEGER(convert);
+  if (conv && sz > INT_MAX / 2)
+    Rf_error("`n` is too large to convert to a character string");
 
-  mbedtls_entropy_init(&entropy);
-  mbedtls_ctr_drbg_init(&ctr_drbg);
+  const size_t total = (size_t) sz * cnt;
+  SEXP out;
+  unsigned char *buf;
 
-  xc = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, (const unsigned char *) pers, strlen(pers));
-  if (xc == 0) {
-    xc = mbedtls_ctr_drbg_random(&ctr_drbg, buf, sz);
+  if (count == R_NilValue && !conv) {
+    PROTECT(out = Rf_allocVector(RAWSXP, sz));
+    buf = (unsigned char *) NANO_DATAPTR(out);
+  } else {
+    PROTECT(out = Rf_allocVector(count == R_NilValue ? STRSXP : conv ? STRSXP : VECSXP, cnt));
+    buf = (unsigned char *) R_alloc(total ? total : 1, sizeof(unsigned char));
   }
 
-  mbedtls_ctr_drbg_free(&ctr_drbg);
-  mbedtls_entropy_free(&entropy);
-
-  if (xc)
+  if (total && nano_rng_fill(buf, total))
     Rf_error("error generating random bytes");
 
-  if (NANO_INTEGER(convert)) {
-    out = nano_hash_char(buf, sz);
-  } else {
-    out = Rf_allocVector(RAWSXP, sz);
-    if (sz)
-      memcpy(NANO_DATAPTR(out), buf, sz);
+  if (conv) {
+    char *cbuf = R_alloc((size_t) sz + sz + 1, sizeof(char));
+    for (int i = 0; i < cnt; i++) {
+      nano_hex(cbuf, buf + (size_t) i * sz, sz);
+      SET_STRING_ELT(out, i, Rf_mkCharLenCE(cbuf, sz + sz, CE_NATIVE));
+    }
+  } else if (count != R_NilValue) {
+    for (int i = 0; i < cnt; i++) {
+      SEXP raw = Rf_allocVector(RAWSXP, sz);
+      SET_VECTOR_ELT(out, i, raw);
+      if (sz)
+        memcpy(NANO_DATAPTR(raw), buf + (size_t) i * sz, sz);
+    }
   }
 
+  UNPROTECT(1);
   return out;
 
 }
@@ -242,57 +324,310 @@ SEXP rnng_write_cert(SEXP cn, SEXP valid) {
 
 // TLS Config ------------------------------------------------------------------
 
-SEXP rnng_tls_config(SEXP client, SEXP server, SEXP pass, SEXP auth) {
+// configurations are cached by their certificate, key and CA content (or file
+// path, size and modification time), and client configurations with a server
+// name also by host, so that dialers and http clients for different hosts never
+// share a configuration - the cache holds one reference to each, and is only
+// accessed from the R thread. A configuration returned by tls_config() is never
+// modified, as identical calls share it, and keeps a copy of its material so
+// that a configuration for each host may be built from it once evicted
+
+typedef struct nano_tls_entry_s {
+  nng_tls_config *cfg;
+  char *host;
+  char *cert;
+  char *key;
+  char *pass;
+  double mtime;
+  double size;
+  int mode;
+  int auth;
+  int file;
+  struct nano_tls_entry_s *next;
+} nano_tls_entry;
+
+static nano_tls_entry *nano_tls_cache = NULL;
+static int nano_tls_max = 32;
+static double nano_tls_hits = 0;
+static double nano_tls_misses = 0;
+
+static int nano_tls_streq(const char *a, const char *b) {
+
+  return a == NULL ? b == NULL : b != NULL && !strcmp(a, b);
+
+}
+
+static char *nano_tls_strdup(const char *s) {
+
+  if (s == NULL) return NULL;
+  const size_t sz = strlen(s) + 1;
+  char *out = malloc(sz);
+  if (out != NULL)
+    memcpy(out, s, sz);
+
+  return out;
+
+}
+
+static void nano_tls_entry_free(nano_tls_entry *e) {
+
+  if (e->cfg != NULL)
+    nng_tls_config_free(e->cfg);
+  free(e->host);
+  free(e->cert);
+  free(e->key);
+  free(e->pass);
+  free(e);
+
+}
+
+static int nano_tls_match(const nano_tls_entry *e, const nano_tls_entry *k) {
+
+  return e->mode == k->mode && e->auth == k->auth && e->file == k->file &&
+    e->mtime == k->mtime && e->size == k->size && nano_tls_streq(e->cert, k->cert) &&
+    nano_tls_streq(e->key, k->key) && nano_tls_streq(e->pass, k->pass);
+
+}
+
+static void nano_tls_trim(void) {
+
+  nano_tls_entry *e = nano_tls_cache, *prev = NULL;
+  int n = 0;
+  while (e != NULL && n < nano_tls_max) {
+    prev = e;
+    e = e->next;
+    n++;
+  }
+  if (prev == NULL) {
+    nano_tls_cache = NULL;
+  } else {
+    prev->next = NULL;
+  }
+  while (e != NULL) {
+    nano_tls_entry *next = e->next;
+    nano_tls_entry_free(e);
+    e = next;
+  }
+
+}
+
+// returns the first entry matching the material of k and host (NULL for none),
+// moving it to the front of the cache
+
+static nano_tls_entry *nano_tls_lookup(const nano_tls_entry *k, const char *host) {
+
+  nano_tls_entry *e = nano_tls_cache, *prev = NULL;
+  while (e != NULL && !(nano_tls_match(e, k) && nano_tls_streq(e->host, host))) {
+    prev = e;
+    e = e->next;
+  }
+  if (e != NULL && prev != NULL) {
+    prev->next = e->next;
+    e->next = nano_tls_cache;
+    nano_tls_cache = e;
+  }
+
+  return e;
+
+}
+
+static int nano_tls_build(nng_tls_config **cfgp, const nano_tls_entry *k) {
 
-  const nng_tls_auth_mode mod = NANO_INTEGER(auth) ? NNG_TLS_AUTH_MODE_REQUIRED : NNG_TLS_AUTH_MODE_OPTIONAL;
-  R_xlen_t usefile;
   nng_tls_config *cfg = NULL;
   int xc;
-  const char *crl, *file, *key, *pss;
-  SEXP xp;
 
-  if (client != R_NilValue) {
-    file = CHAR(STRING_ELT(client, 0));
-    usefile = XLENGTH(client);
-    if ((xc = nng_tls_config_alloc(&cfg, NNG_TLS_MODE_CLIENT)) ||
-        (xc = nng_tls_config_auth_mode(cfg, mod)))
+  if ((xc = nng_tls_config_alloc(&cfg, k->mode == 2 ? NNG_TLS_MODE_SERVER : NNG_TLS_MODE_CLIENT)) ||
+      (xc = nng_tls_config_auth_mode(cfg, k->auth)))
+    goto fail;
+
+  if (k->mode == 1) {
+    if ((xc = k->file ? nng_tls_config_ca_file(cfg, k->cert) : nng_tls_config_ca_chain(cfg, k->cert, k->key)))
       goto fail;
+  } else if (k->mode == 2) {
+    if ((xc = k->file ? nng_tls_config_cert_key_file(cfg, k->cert, k->pass) : nng_tls_config_own_cert(cfg, k->cert, k->key, k->pass)))
+      goto fail;
+  }
 
-    if (usefile > 1) {
-      crl = NANO_STR_N(client, 1);
-      if ((xc = nng_tls_config_ca_chain(cfg, file, strncmp(crl, "", 1) ? crl : NULL)))
-        goto fail;
-    } else {
-      file = R_ExpandFileName(file);
-      if ((xc = nng_tls_config_ca_file(cfg, file)))
-        goto fail;
+  *cfgp = cfg;
+  return 0;
+
+  fail:
+  if (cfg != NULL)
+    nng_tls_config_free(cfg);
+  return xc;
+
+}
+
+// copies the material of k, with cfg NULL
+
+static nano_tls_entry *nano_tls_copy(const nano_tls_entry *k, const char *host) {
+
+  nano_tls_entry *e = calloc(1, sizeof(nano_tls_entry));
+  if (e == NULL) return NULL;
+  *e = *k;
+  e->cfg = NULL;
+  e->host = NULL;
+  e->cert = e->key = e->pass = NULL;
+  e->next = NULL;
+  if ((host != NULL && (e->host = nano_tls_strdup(host)) == NULL) ||
+      (k->cert != NULL && (e->cert = nano_tls_strdup(k->cert)) == NULL) ||
+      (k->key != NULL && (e->key = nano_tls_strdup(k->key)) == NULL) ||
+      (k->pass != NULL && (e->pass = nano_tls_strdup(k->pass)) == NULL)) {
+    nano_tls_entry_free(e);
+    return NULL;
+  }
+
+  return e;
+
+}
+
+static void tls_key_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_tls_entry_free((nano_tls_entry *) NANO_PTR(xptr));
+
+}
+
+// creates a new entry from the material of k, taking ownership of cfg
+
+static nano_tls_entry *nano_tls_insert(const nano_tls_entry *k, nng_tls_config *cfg, const char *host) {
+
+  nano_tls_entry *e = nano_tls_copy(k, host);
+  if (e == NULL) goto fail;
+  e->cfg = cfg;
+  e->next = nano_tls_cache;
+  nano_tls_cache = e;
+  nano_tls_trim();
+
+  return e;
+
+  fail:
+  nng_tls_config_free(cfg);
+  return NULL;
+
+}
+
+// resolves the client configuration to use for a connection to host, tls being
+// a 'tlsConfig' supplied by the user or R_NilValue for the default that does
+// not authenticate the server. The server name is only ever set on a
+// configuration built for the host - on success, the caller owns one reference
+// to the result
+
+int nano_tls_host(nng_tls_config **out, SEXP tls, const char *host) {
+
+  nano_tls_entry k = {.mode = 0, .auth = NNG_TLS_AUTH_MODE_NONE}, *e;
+  nng_tls_config *ncfg;
+  int xc;
+
+  if (tls != R_NilValue) {
+    const SEXP kp = NANO_PROT(tls);
+    // server configurations, and any without material, are used as supplied
+    if (TYPEOF(kp) != EXTPTRSXP || NANO_PTR(kp) == NULL ||
+        ((nano_tls_entry *) NANO_PTR(kp))->mode == 2) {
+      ncfg = (nng_tls_config *) NANO_PTR(tls);
+      nng_tls_config_hold(ncfg);
+      *out = ncfg;
+      return 0;
     }
+    k = *(nano_tls_entry *) NANO_PTR(kp);
+    k.next = NULL;
+  }
 
-  } else if (server != R_NilValue) {
-    file = CHAR(STRING_ELT(server, 0));
-    usefile = XLENGTH(server);
-    pss = pass != R_NilValue ? CHAR(STRING_ELT(pass, 0)) : NULL;
-    if ((xc = nng_tls_config_alloc(&cfg, NNG_TLS_MODE_SERVER)) ||
-        (xc = nng_tls_config_auth_mode(cfg, mod)))
-      goto fail;
+  if ((e = nano_tls_lookup(&k, host)) != NULL) {
+    nano_tls_hits++;
+    nng_tls_config_hold(e->cfg);
+    *out = e->cfg;
+    return 0;
+  }
+
+  nano_tls_misses++;
+  if ((xc = nano_tls_build(&ncfg, &k)))
+    return xc;
+  if ((xc = nng_tls_config_server_name(ncfg, host))) {
+    nng_tls_config_free(ncfg);
+    return xc;
+  }
+  if (nano_tls_max > 0) {
+    nng_tls_config_hold(ncfg);
+    if (nano_tls_insert(&k, ncfg, host) == NULL) {
+      nng_tls_config_free(ncfg);
+      return 2;
+    }
+  }
+
+  *out = ncfg;
+  return 0;
 
-    if (usefile > 1) {
-      key = NANO_STR_N(server, 1);
-      if ((xc = nng_tls_config_own_cert(cfg, file, key, pss)))
-        goto fail;
+}
+
+void nano_tls_cache_free(void) {
+
+  nano_tls_entry *e = nano_tls_cache;
+  while (e != NULL) {
+    nano_tls_entry *next = e->next;
+    nano_tls_entry_free(e);
+    e = next;
+  }
+  nano_tls_cache = NULL;
+
+}
+
+SEXP rnng_tls_config(SEXP client, SEXP server, SEXP pass, SEXP auth) {
+
+  const nng_tls_auth_mode mod = NANO_INTEGER(auth) ? NNG_TLS_AUTH_MODE_REQUIRED : NNG_TLS_AUTH_MODE_OPTIONAL;
+  nano_tls_entry k = {.mode = 0, .auth = NNG_TLS_AUTH_MODE_NONE}, *e;
+  nng_tls_config *cfg = NULL;
+  struct stat sb;
+  int xc;
+  SEXP xp, kp;
+
+  if (client != R_NilValue || server != R_NilValue) {
+    const SEXP cert = client != R_NilValue ? client : server;
+    k.mode = client != R_NilValue ? 1 : 2;
+    k.auth = mod;
+    k.file = XLENGTH(cert) == 1;
+    if (k.file) {
+      k.cert = (char *) R_ExpandFileName(CHAR(STRING_ELT(cert, 0)));
+      if (!stat(k.cert, &sb)) {
+        k.mtime = (double) sb.st_mtime;
+        k.size = (double) sb.st_size;
+      }
     } else {
-      file = R_ExpandFileName(file);
-      if ((xc = nng_tls_config_cert_key_file(cfg, file, pss)))
-        goto fail;
+      k.cert = (char *) CHAR(STRING_ELT(cert, 0));
+      k.key = (char *) NANO_STR_N(cert, 1);
+      if (k.mode == 1 && !strncmp(k.key, "", 1))
+        k.key = NULL;
     }
+    if (k.mode == 2 && pass != R_NilValue)
+      k.pass = (char *) CHAR(STRING_ELT(pass, 0));
+  }
 
+  if ((e = nano_tls_lookup(&k, NULL)) != NULL) {
+    nano_tls_hits++;
+    cfg = e->cfg;
+    nng_tls_config_hold(cfg);
   } else {
-    if ((xc = nng_tls_config_alloc(&cfg, NNG_TLS_MODE_CLIENT)) ||
-        (xc = nng_tls_config_auth_mode(cfg, NNG_TLS_AUTH_MODE_NONE)))
-      goto fail;
+    nano_tls_misses++;
+    if ((xc = nano_tls_build(&cfg, &k)))
+      ERROR_OUT(xc);
+    if (nano_tls_max > 0) {
+      nng_tls_config_hold(cfg);
+      if (nano_tls_insert(&k, cfg, NULL) == NULL) {
+        nng_tls_config_free(cfg);
+        ERROR_OUT(2);
+      }
+    }
   }
 
-  PROTECT(xp = R_MakeExternalPtr(cfg, nano_TlsSymbol, R_NilValue));
+  if ((e = nano_tls_copy(&k, NULL)) == NULL) {
+    nng_tls_config_free(cfg);
+    ERROR_OUT(2);
+  }
+  PROTECT(kp = R_MakeExternalPtr(e, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(kp, tls_key_finalizer, TRUE);
+  xp = R_MakeExternalPtr(cfg, nano_TlsSymbol, kp);
+  UNPROTECT(1);
+  PROTECT(xp);
   R_RegisterCFinalizerEx(xp, tls_finalizer, TRUE);
   Rf_classgets(xp, Rf_mkString("tlsConfig"));
   if (client != R_NilValue) {
@@ -309,10 +644,34 @@ SEXP rnng_tls_config(SEXP client, SEXP server, SEXP pass, SEXP auth) {
   UNPROTECT(1);
   return xp;
 
-  fail:
-  if (cfg != NULL)
-    nng_tls_config_free(cfg);
-  ERROR_OUT(xc);
+}
+
+SEXP rnng_tls_cache(SEXP max) {
+
+  int vmax = nano_tls_max;
+  if (max != R_NilValue && (vmax = nano_integer(max)) < 0)
+    Rf_error("`max` must be a non-negative integer");
+
+  nano_tls_max = vmax;
+  nano_tls_trim();
+
+  double entries = 0;
+  for (nano_tls_entry *e = nano_tls_cache; e != NULL; e = e->next)
+    entries++;
+
+  const char *names[] = {"max", "configs", ""};
+  const char *cnames[] = {"cached", "hits", "misses", ""};
+  SEXP out, vec;
+  PROTECT(out = Rf_mkNamed(VECSXP, names));
+  SET_VECTOR_ELT(out, 0, Rf_ScalarInteger(nano_tls_max));
+  vec = Rf_mkNamed(REALSXP, cnames);
+  SET_VECTOR_ELT(out, 1, vec);
+  REAL(vec)[0] = entries;
+  REAL(vec)[1] = nano_tls_hits;
+  REAL(vec)[2] = nano_tls_misses;
+
+  UNPROTECT(1);
+  return out;
 
 }
 
@@ -525,49 +525,541 @@ SEXP rnng_stats_get(SEXP object, SEXP stat) {
 
 }
 
+// previous values of counter stats are retained per object for delta mode,
+// entries being pruned once their object no longer exists
+
+typedef struct nano_stats_entry_s {
+  int kind;
+  int id;
+  uint64_t time;
+  int n;
+  char **names;
+  double *vals;
+  struct nano_stats_entry_s *next;
+} nano_stats_entry;
+
+static nano_stats_entry *nano_stats_cache = NULL;
+
+static void nano_stats_entry_clear(nano_stats_entry *e) {
+
+  for (int i = 0; i < e->n; i++)
+    free(e->names[i]);
+  free(e->names);
+  free(e->vals);
+  e->names = NULL;
+  e->vals = NULL;
+  e->n = 0;
+
+}
+
+void nano_stats_free(void) {
+
+  nano_stats_entry *e = nano_stats_cache, *next;
+  while (e != NULL) {
+    next = e->next;
+    nano_stats_entry_clear(e);
+    free(e);
+    e = next;
+  }
+  nano_stats_cache = NULL;
+
+}
+
+static nng_stat *nano_stats_scope(nng_stat *nst, const SEXP object, int *kind, int *id) {
+
+  if (!NANO_PTR_CHECK(object, nano_SocketSymbol)) {
+    nng_socket *sock = (nng_socket *) NANO_PTR(object);
+    *kind = 0;
+    *id = nng_socket_id(*sock);
+    return nng_stat_find_socket(nst, *sock);
+  } else if (!NANO_PTR_CHECK(object, nano_ListenerSymbol)) {
+    nng_listener *list = (nng_listener *) NANO_PTR(object);
+    *kind = 1;
+    *id = nng_listener_id(*list);
+    return nng_stat_find_listener(nst, *list);
+  } else if (!NANO_PTR_CHECK(object, nano_DialerSymbol)) {
+    nng_dialer *dial = (nng_dialer *) NANO_PTR(object);
+    *kind = 2;
+    *id = nng_dialer_id(*dial);
+    return nng_stat_find_dialer(nst, *dial);
+  }
+  *kind = -1;
+  return NULL;
+
+}
+
+static nng_stat *nano_stats_find_id(nng_stat *nst, const int kind, const int id) {
+
+  static const char *scopes[] = {"socket", "listener", "dialer"};
+  for (nng_stat *sst = nng_stat_child(nst); sst != NULL; sst = nng_stat_next(sst)) {
+    if (strcmp(nng_stat_name(sst), scopes[kind])) continue;
+    nng_stat *sid = nng_stat_find(sst, "id");
+    if (sid != NULL && (int) nng_stat_value(sid) == id)
+      return sst;
+  }
+  return NULL;
+
+}
+
+static nano_stats_entry *nano_stats_entry_get(const int kind, const int id) {
+
+  for (nano_stats_entry *e = nano_stats_cache; e != NULL; e = e->next) {
+    if (e->kind == kind && e->id == id)
+      return e;
+  }
+  nano_stats_entry *e = calloc(1, sizeof(nano_stats_entry));
+  if (e == NULL)
+    return NULL;
+  e->kind = kind;
+  e->id = id;
+  e->next = nano_stats_cache;
+  nano_stats_cache = e;
+  return e;
+
+}
+
+static void nano_stats_prune(nng_stat *nst) {
+
+  nano_stats_entry **pp = &nano_stats_cache, *e;
+  while ((e = *pp) != NULL) {
+    if (nano_stats_find_id(nst, e->kind, e->id) == NULL) {
+      *pp = e->next;
+      nano_stats_entry_clear(e);
+      free(e);
+    } else {
+      pp = &e->next;
+    }
+  }
+
+}
+
+static inline int nano_stats_numeric(nng_stat *sst) {
+
+  const int type = nng_stat_type(sst);
+  return type == NNG_STAT_LEVEL || type == NNG_STAT_COUNTER || type == NNG_STAT_BOOLEAN || type == NNG_STAT_ID;
+
+}
+
+SEXP rnng_stats_snapshot(SEXP object, SEXP names, SEXP delta) {
+
+  const int single = TYPEOF(object) != VECSXP;
+  const R_xlen_t nobj = single ? 1 : XLENGTH(object);
+  const int dlt = NANO_INTEGER(delta);
+  if (names != R_NilValue && TYPEOF(names) != STRSXP)
+    Rf_error("`names` must be a character vector or NULL");
+
+  nng_stat *nst, **scopes;
+  int *kinds, *ids, xc;
+  scopes = (nng_stat **) R_alloc(nobj ? nobj : 1, sizeof(nng_stat *));
+  kinds = (int *) R_alloc(nobj ? nobj : 1, sizeof(int));
+  ids = (int *) R_alloc(nobj ? nobj : 1, sizeof(int));
+
+  if ((xc = nng_stats_get(&nst)))
+    ERROR_OUT(xc);
+
+  R_xlen_t nitems = 0;
+  for (R_xlen_t i = 0; i < nobj; i++) {
+    scopes[i] = nano_stats_scope(nst, single ? object : VECTOR_ELT(object, i), &kinds[i], &ids[i]);
+    if (kinds[i] < 0) {
+      nng_stats_free(nst);
+      Rf_error("`object` must be a Socket, Listener or Dialer, or a list of these");
+    }
+    if (scopes[i] != NULL) {
+      for (nng_stat *sst = nng_stat_child(scopes[i]); sst != NULL; sst = nng_stat_next(sst))
+        nitems++;
+    }
+  }
+
+  const char **cols;
+  R_xlen_t ncol;
+  if (names == R_NilValue) {
+    cols = (const char **) R_alloc(nitems ? nitems : 1, sizeof(char *));
+    ncol = 0;
+    for (R_xlen_t i = 0; i < nobj; i++) {
+      if (scopes[i] == NULL) continue;
+      for (nng_stat *sst = nng_stat_child(scopes[i]); sst != NULL; sst = nng_stat_next(sst)) {
+        if (!nano_stats_numeric(sst)) continue;
+        const char *name = nng_stat_name(sst);
+        R_xlen_t j = 0;
+        while (j < ncol && strcmp(cols[j], name)) j++;
+        if (j == ncol)
+          cols[ncol++] = name;
+      }
+    }
+  } else {
+    ncol = XLENGTH(names);
+    cols = (const char **) R_alloc(ncol ? ncol : 1, sizeof(char *));
+    for (R_xlen_t j = 0; j < ncol; j++)
+      cols[j] = CHAR(STRING_ELT(names, j));
+  }
+
+  SEXP out, dimnames, colnames;
+  PROTECT(out = single ? Rf_allocVector(REALSXP, ncol) : Rf_allocMatrix(REALSXP, (int) nobj, (int) ncol));
+  PROTECT(colnames = Rf_allocVector(STRSXP, ncol));
+  for (R_xlen_t j = 0; j < ncol; j++)
+    SET_STRING_ELT(colnames, j, Rf_mkChar(cols[j]));
+  double *val = REAL(out);
+
+  for (R_xlen_t i = 0; i < nobj; i++) {
+    nano_stats_entry *e = NULL;
+    double secs = 0;
+    uint64_t now = 0;
+    double *prev = NULL;
+    char **pnames = NULL;
+    if (dlt && scopes[i] != NULL) {
+      e = nano_stats_entry_get(kinds[i], ids[i]);
+      now = nng_stat_timestamp(scopes[i]);
+      if (e != NULL && e->n && now > e->time)
+        secs = (double) (now - e->time) / 1000;
+      if (e != NULL) {
+        prev = calloc(ncol ? ncol : 1, sizeof(double));
+        pnames = calloc(ncol ? ncol : 1, sizeof(char *));
+      }
+    }
+    int m = 0;
+    for (R_xlen_t j = 0; j < ncol; j++) {
+      nng_stat *sst = scopes[i] == NULL ? NULL : nng_stat_find(scopes[i], cols[j]);
+      double v = NA_REAL;
+      if (sst != NULL && nano_stats_numeric(sst)) {
+        v = nng_stat_type(sst) == NNG_STAT_BOOLEAN ? (double) nng_stat_bool(sst) : (double) nng_stat_value(sst);
+        if (dlt && nng_stat_type(sst) == NNG_STAT_COUNTER) {
+          const double cur = v;
+          v = NA_REAL;
+          if (secs > 0) {
+            for (int k = 0; k < e->n; k++) {
+              if (!strcmp(e->names[k], cols[j])) {
+                v = (cur - e->vals[k]) / secs;
+                break;
+              }
+            }
+          }
+          if (pnames != NULL && (pnames[m] = strdup(cols[j])) != NULL)
+            prev[m++] = cur;
+        }
+      }
+      val[single ? j : i + j * nobj] = v;
+    }
+    if (e != NULL) {
+      if (prev != NULL && pnames != NULL) {
+        nano_stats_entry_clear(e);
+        e->names = pnames;
+        e->vals = prev;
+        e->n = m;
+        e->time = now;
+      } else {
+        free(prev);
+        free(pnames);
+      }
+    }
+  }
+
+  if (dlt)
+    nano_stats_prune(nst);
+  nng_stats_free(nst);
+
+  if (single) {
+    Rf_namesgets(out, colnames);
+  } else {
+    PROTECT(dimnames = Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(dimnames, 0, Rf_getAttrib(object, R_NamesSymbol));
+    SET_VECTOR_ELT(dimnames, 1, colnames);
+    Rf_setAttrib(out, R_DimNamesSymbol, dimnames);
+    UNPROTECT(1);
+  }
+
+  UNPROTECT(2);
+  return out;
+
+}
+
+// latency histograms ----------------------------------------------------------
+
+// log-linear buckets of microseconds with 16 sub-buckets per power of 2, giving
+// a relative error within 6.25%, updated lock-free from completion callbacks -
+// histograms are retained until unload as in-flight aios may still record
+
+nano_hist nano_http_hist;
+static nano_hist *nano_hist_list = NULL;
+
+uint64_t nano_hrtime(void) {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+
+}
+
+uint64_t nano_hist_start(nano_hist *h) {
+
+  return h != NULL && atomic_load_explicit(&h->on, memory_order_relaxed) ? nano_hrtime() : 0;
+
+}
+
+void nano_hist_arm(nano_aio *xaio, nano_hist *h) {
+
+  xaio->start = nano_hist_start(h);
+  xaio->hist = xaio->start ? h : NULL;
+
+}
+
+static inline int nano_hist_index(const uint64_t v) {
+
+  if (v < NANONEXT_HIST_SUB)
+    return (int) v;
+  const int m = 63 - __builtin_clzll(v);
+  const int idx = (m - 3) * NANONEXT_HIST_SUB + (int) (v >> (m - 4)) - NANONEXT_HIST_SUB;
+  return idx < NANONEXT_HIST_BUCKETS ? idx : NANONEXT_HIST_BUCKETS - 1;
+
+}
+
+static inline uint64_t nano_hist_upper(const int idx) {
+
+  if (idx < NANONEXT_HIST_SUB)
+    return (uint64_t) idx;
+  const int m = idx / NANONEXT_HIST_SUB + 3;
+  const uint64_t mant = (uint64_t) (idx % NANONEXT_HIST_SUB + NANONEXT_HIST_SUB);
+  return ((mant + 1) << (m - 4)) - 1;
+
+}
+
+void nano_hist_record(nano_hist *h, const int series, const uint64_t start) {
+
+  if (h == NULL || !start)
+    return;
+  const uint64_t v = (nano_hrtime() - start) / 1000;
+  nano_hist_series *hs = &h->series[series];
+  atomic_fetch_add_explicit(&hs->buckets[nano_hist_index(v)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&hs->sum, v, memory_order_relaxed);
+  atomic_fetch_add_explicit(&hs->n, 1, memory_order_relaxed);
+  uint_fast64_t max = atomic_load_explicit(&hs->max, memory_order_relaxed);
+  while (v > max && !atomic_compare_exchange_weak_explicit(&hs->max, &max, v, memory_order_relaxed, memory_order_relaxed));
+
+}
+
+void nano_hist_free(void) {
+
+  nano_hist *h = nano_hist_list, *next;
+  while (h != NULL) {
+    next = h->next;
+    free(h);
+    h = next;
+  }
+  nano_hist_list = NULL;
+
+}
+
+static void nano_hist_reset(nano_hist_series *hs) {
+
+  atomic_store_explicit(&hs->n, 0, memory_order_relaxed);
+  atomic_store_explicit(&hs->sum, 0, memory_order_relaxed);
+  atomic_store_explicit(&hs->max, 0, memory_order_relaxed);
+  for (int i = 0; i < NANONEXT_HIST_BUCKETS; i++)
+    atomic_store_explicit(&hs->buckets[i], 0, memory_order_relaxed);
+
+}
+
+// writes count, mean, p50, p90, p99, p999 and max (in ms) at intervals of stride
+void nano_hist_summary(nano_hist_series *hs, double *val, const int stride, const int reset) {
+
+  const uint_fast64_t q[] = {500, 900, 990, 999}; // per mille
+  uint_fast64_t counts[NANONEXT_HIST_BUCKETS];
+  const uint_fast64_t max = atomic_load_explicit(&hs->max, memory_order_relaxed);
+  const uint_fast64_t sum = atomic_load_explicit(&hs->sum, memory_order_relaxed);
+  uint_fast64_t n = 0;
+  for (int j = 0; j < NANONEXT_HIST_BUCKETS; j++) {
+    counts[j] = atomic_load_explicit(&hs->buckets[j], memory_order_relaxed);
+    n += counts[j];
+  }
+  if (reset)
+    nano_hist_reset(hs);
+
+  val[0] = (double) n;
+  val[stride] = n ? (double) sum / n / 1000 : NA_REAL;
+  for (int k = 0; k < 4; k++) {
+    double v = NA_REAL;
+    if (n) {
+      const uint_fast64_t target = (n * q[k] + 999) / 1000;
+      uint_fast64_t cum = 0;
+      int j = 0;
+      while (j < NANONEXT_HIST_BUCKETS - 1 && (cum += counts[j]) < target) j++;
+      const uint64_t upper = nano_hist_upper(j);
+      v = (double) (upper < max ? upper : max) / 1000;
+    }
+    val[(k + 2) * stride] = v;
+  }
+  val[6 * stride] = n ? (double) max / 1000 : NA_REAL;
+
+}
+
+SEXP rnng_latency(SEXP con, SEXP enable, SEXP reset) {
+
+  nano_hist *h, **hp = NULL;
+  int sock, nseries;
+
+  if (con == R_NilValue) {
+    h = &nano_http_hist;
+    nseries = 1;
+  } else if ((sock = !NANO_PTR_CHECK(con, nano_SocketSymbol)) || !NANO_PTR_CHECK(con, nano_ContextSymbol)) {
+    hp = sock ? &((nano_sock *) NANO_PTR(con))->hist : &((nano_ctx *) NANO_PTR(con))->hist;
+    h = *hp;
+    nseries = NANONEXT_HIST_SERIES;
+  } else {
+    Rf_error("`con` is not a valid Socket or Context");
+  }
+
+  if (enable != R_NilValue) {
+    const int on = NANO_INTEGER(enable);
+    if (on && h == NULL) {
+      h = calloc(1, sizeof(nano_hist));
+      if (h == NULL)
+        Rf_error("memory allocation failed");
+      h->next = nano_hist_list;
+      nano_hist_list = h;
+      *hp = h;
+    }
+    if (h != NULL)
+      atomic_store(&h->on, on);
+  }
+
+  if (h == NULL)
+    return R_NilValue;
+
+  const int clr = NANO_INTEGER(reset);
+  const char *rows[] = {"send", "recv", "request"};
+  const char *cols[] = {"count", "mean", "p50", "p90", "p99", "p999", "max"};
+  const int ncol = 7;
+  SEXP out, dimnames, rnames, cnames;
+
+  PROTECT(out = Rf_allocMatrix(REALSXP, nseries, ncol));
+  double *val = REAL(out);
+
+  for (int i = 0; i < nseries; i++)
+    nano_hist_summary(&h->series[i], val + i, nseries, clr);
+
+  PROTECT(dimnames = Rf_allocVector(VECSXP, 2));
+  rnames = Rf_allocVector(STRSXP, nseries);
+  SET_VECTOR_ELT(dimnames, 0, rnames);
+  for (int i = 0; i < nseries; i++)
+    SET_STRING_ELT(rnames, i, Rf_mkChar(con == R_NilValue ? "http" : rows[i]));
+  cnames = Rf_allocVector(STRSXP, ncol);
+  SET_VECTOR_ELT(dimnames, 1, cnames);
+  for (int i = 0; i < ncol; i++)
+    SET_STRING_ELT(cnames, i, Rf_mkChar(cols[i]));
+  Rf_setAttrib(out, R_DimNamesSymbol, dimnames);
+
+  UNPROTECT(2);
+  return out;
+
+}
+
 // serialization config --------------------------------------------------------
 
-SEXP rnng_serial_config(SEXP klass, SEXP sfunc, SEXP ufunc) {
+// classes are looked up in a hashed table built once per configuration, and
+// functions given as 'package::name' are resolved to native C-callables
 
-  SEXP out;
-  PROTECT(out = Rf_allocVector(VECSXP, 3));
+static uint64_t nano_serial_hash(const char *s) {
 
-  if (TYPEOF(klass) != STRSXP)
-    Rf_error("`class` must be a character vector");
-  SET_VECTOR_ELT(out, 0, klass);
+  uint64_t h = 14695981039346656037ULL;
+  while (*s) {
+    h ^= (unsigned char) *s++;
+    h *= 1099511628211ULL;
+  }
+  return h;
 
-  R_xlen_t xlen = XLENGTH(klass);
-  if (Rf_xlength(sfunc) != xlen || Rf_xlength(ufunc) != xlen)
-    Rf_error("`class`, `sfunc` and `ufunc` must all be the same length");
+}
 
-  switch (TYPEOF(sfunc)) {
-  case VECSXP:
-    SET_VECTOR_ELT(out, 1, sfunc);
-    break;
-  case CLOSXP:
-  case SPECIALSXP:
-  case BUILTINSXP: ;
-    SEXP slist = Rf_allocVector(VECSXP, 1);
-    SET_VECTOR_ELT(out, 1, slist);
-    SET_VECTOR_ELT(slist, 0, sfunc);
-    break;
-  default:
-    Rf_error("`sfunc` must be a function or list of functions");
+static int nano_serial_find(nano_serial_tab *tab, SEXP klass, const char *s) {
+
+  const uint64_t h = nano_serial_hash(s);
+  for (int j = (int) (h & tab->mask); tab->slots[j]; j = (j + 1) & tab->mask) {
+    const int idx = tab->slots[j] - 1;
+    if (tab->hashes[idx] == h && !strcmp(NANO_STR_N(klass, idx), s))
+      return idx;
   }
+  return -1;
+
+}
+
+// returns the index of the first configured class inherited from, or -1
+int nano_serial_match(nano_serial_tab *tab, SEXP klass, SEXP x) {
+
+  if (!Rf_isObject(x))
+    return -1;
+
+  SEXP cls = Rf_getAttrib(x, R_ClassSymbol);
+  const R_xlen_t n = XLENGTH(cls);
+  int best = -1;
+  for (R_xlen_t i = 0; i < n; i++) {
+    const int idx = nano_serial_find(tab, klass, CHAR(STRING_ELT(cls, i)));
+    if (idx >= 0 && (best < 0 || idx < best))
+      best = idx;
+  }
+  return best;
+
+}
+
+static void serial_tab_finalizer(SEXP xptr) {
+
+  if (NANO_PTR(xptr) == NULL) return;
+  nano_serial_tab *tab = (nano_serial_tab *) NANO_PTR(xptr);
+  free(tab->slots);
+  free(tab->hashes);
+  free(tab->sfn);
+  free(tab->ufn);
+  free(tab);
+
+}
 
-  switch (TYPEOF(ufunc)) {
+// resolves a 'package::name' C-callable, returning NULL if x is not of this
+// form - R_GetCCallable() raises an error if it is not registered
+DL_FUNC nano_callable(SEXP x) {
+
+  const char *s = TYPEOF(x) == STRSXP && XLENGTH(x) == 1 ? CHAR(STRING_ELT(x, 0)) : "";
+  const char *sep = strstr(s, "::");
+  const size_t plen = sep == NULL ? 0 : (size_t) (sep - s);
+  if (!plen || plen >= 256 || !sep[2])
+    return NULL;
+
+  char pkg[256];
+  memcpy(pkg, s, plen);
+  pkg[plen] = '\0';
+  return R_GetCCallable(pkg, sep + 2);
+
+}
+
+static SEXP nano_serial_funcs(SEXP func, const R_xlen_t xlen, DL_FUNC *native, const char *arg) {
+
+  SEXP out;
+  switch (TYPEOF(func)) {
   case VECSXP:
-    SET_VECTOR_ELT(out, 2, ufunc);
+    PROTECT(out = func);
+    break;
+  case STRSXP:
+    PROTECT(out = Rf_allocVector(VECSXP, xlen));
+    for (R_xlen_t i = 0; i < xlen; i++)
+      SET_VECTOR_ELT(out, i, Rf_ScalarString(STRING_ELT(func, i)));
     break;
   case CLOSXP:
   case SPECIALSXP:
-  case BUILTINSXP: ;
-    SEXP ulist = Rf_allocVector(VECSXP, 1);
-    SET_VECTOR_ELT(out, 2, ulist);
-    SET_VECTOR_ELT(ulist, 0, ufunc);
+  case BUILTINSXP:
+    PROTECT(out = Rf_allocVector(VECSXP, 1));
+    SET_VECTOR_ELT(out, 0, func);
     break;
   default:
-    Rf_error("`ufunc` must be a function or list of functions");
+    Rf_error("`%s` must be a function or list of functions, or 'package::name' C-callables", arg);
+  }
+
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    SEXP f = NANO_VECTOR(out)[i];
+    switch (TYPEOF(f)) {
+    case CLOSXP:
+    case SPECIALSXP:
+    case BUILTINSXP:
+      break;
+    default:
+      if ((native[i] = nano_callable(f)) == NULL)
+        Rf_error("`%s` must be a function or list of functions, or 'package::name' C-callables", arg);
+    }
   }
 
   UNPROTECT(1);
@@ -575,6 +1067,106 @@ SEXP rnng_serial_config(SEXP klass, SEXP sfunc, SEXP ufunc) {
 
 }
 
+SEXP rnng_serial_config(SEXP klass, SEXP sfunc, SEXP ufunc) {
+
+  SEXP out, xptr;
+
+  if (TYPEOF(klass) != STRSXP)
+    Rf_error("`class` must be a character vector");
+
+  const R_xlen_t xlen = XLENGTH(klass);
+  if (Rf_xlength(sfunc) != xlen || Rf_xlength(ufunc) != xlen)
+    Rf_error("`class`, `sfunc` and `ufunc` must all be the same length");
+
+  int size = 8;
+  while (size < 2 * xlen) size <<= 1;
+
+  nano_serial_tab *tab = calloc(1, sizeof(nano_serial_tab));
+  if (tab == NULL)
+    Rf_error("memory allocation failed");
+  PROTECT(xptr = R_MakeExternalPtr(tab, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(xptr, serial_tab_finalizer, TRUE);
+  tab->slots = calloc(size, sizeof(int));
+  tab->hashes = calloc(xlen ? xlen : 1, sizeof(uint64_t));
+  tab->sfn = calloc(xlen ? xlen : 1, sizeof(nano_serial_fn));
+  tab->ufn = calloc(xlen ? xlen : 1, sizeof(nano_unserial_fn));
+  if (tab->slots == NULL || tab->hashes == NULL || tab->sfn == NULL || tab->ufn == NULL)
+    Rf_error("memory allocation failed");
+  tab->n = (int) xlen;
+  tab->mask = size - 1;
+
+  PROTECT(out = Rf_allocVector(VECSXP, 4));
+  SET_VECTOR_ELT(out, 0, klass);
+  SET_VECTOR_ELT(out, 1, nano_serial_funcs(sfunc, xlen, (DL_FUNC *) tab->sfn, "sfunc"));
+  SET_VECTOR_ELT(out, 2, nano_serial_funcs(ufunc, xlen, (DL_FUNC *) tab->ufn, "ufunc"));
+  SET_VECTOR_ELT(out, 3, xptr);
+
+  // duplicated classes keep the first index, as for a search in order
+  for (R_xlen_t i = 0; i < xlen; i++) {
+    const char *s = NANO_STR_N(klass, i);
+    tab->hashes[i] = nano_serial_hash(s);
+    if (nano_serial_find(tab, klass, s) >= 0) continue;
+    int j = (int) (tab->hashes[i] & tab->mask);
+    while (tab->slots[j]) j = (j + 1) & tab->mask;
+    tab->slots[j] = (int) i + 1;
+    if (tab->ufn[i] != NULL)
+      tab->native = 1;
+  }
+
+  UNPROTECT(2);
+  return out;
+
+}
+
+// native hooks for testing: serialize the raw vector 'value' of an environment,
+// writing one byte short if it begins with a zero
+
+static R_xlen_t nano_serial_test(SEXP x, void (*write)(void *, const void *, R_xlen_t), void *stream) {
+
+  const SEXP value = Rf_findVarInFrame(x, nano_ValueSymbol);
+  if (TYPEOF(value) != RAWSXP)
+    return -1;
+
+  const R_xlen_t len = XLENGTH(value);
+  if (write != NULL)
+    write(stream, RAW(value), len && RAW(value)[0] == 0 ? len - 1 : len);
+
+  return len;
+
+}
+
+static SEXP nano_unserial_test(R_xlen_t size, void (*read)(void *, void *, R_xlen_t), void *stream) {
+
+  SEXP env, value;
+  PROTECT(env = R_NewEnv(R_EmptyEnv, 0, 0));
+  PROTECT(value = Rf_allocVector(RAWSXP, size));
+  read(stream, RAW(value), size);
+  Rf_defineVar(nano_ValueSymbol, value, env);
+
+  UNPROTECT(2);
+  return env;
+
+}
+
+// internal entry for the tests only, not registered as a C-callable: replaces
+// the hooks of a configuration returned by serial_config() with the above
+
+SEXP rnng_serial_test(SEXP cfg) {
+
+  if (TYPEOF(cfg) != VECSXP || XLENGTH(cfg) != 4 || TYPEOF(NANO_VECTOR(cfg)[3]) != EXTPTRSXP)
+    Rf_error("`cfg` is not a valid serialization configuration");
+
+  nano_serial_tab *tab = (nano_serial_tab *) NANO_PTR(NANO_VECTOR(cfg)[3]);
+  for (int i = 0; i < tab->n; i++) {
+    tab->sfn[i] = nano_serial_test;
+    tab->ufn[i] = nano_unserial_test;
+  }
+  tab->native = tab->n > 0;
+
+  return cfg;
+
+}
+
 // specials --------------------------------------------------------------------
 
 SEXP rnng_advance_rng_state(void) {
@@ -588,7 +1180,6 @@ SEXP rnng_advance_rng_state(void) {
 
 SEXP rnng_fini_priors(void) {
 
-  nano_thread_shutdown();
   nano_list_do(SHUTDOWN, NULL);
   return R_NilValue;
 